@@ -5,7 +5,23 @@ CREATE TABLE IF NOT EXISTS `character_arena_replays` (
   `contentSize` int NULL DEFAULT NULL,
   `contents` longblob NULL,
   `mapId` int NULL DEFAULT NULL,
+  `winnerTeamName` varchar(255) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NULL DEFAULT NULL,
+  `winnerTeamRating` int NULL DEFAULT NULL,
+  `winnerTeamMMR` int NULL DEFAULT NULL,
+  `loserTeamName` varchar(255) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NULL DEFAULT NULL,
+  `loserTeamRating` int NULL DEFAULT NULL,
+  `loserTeamMMR` int NULL DEFAULT NULL,
+  `winnerPlayerGuids` varchar(255) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NULL DEFAULT NULL,
+  `loserPlayerGuids` varchar(255) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NULL DEFAULT NULL,
+  `timesWatched` int NOT NULL DEFAULT 0,
   `savedBy` varchar(255) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NULL DEFAULT '0',
   `timestamp` timestamp NULL DEFAULT CURRENT_TIMESTAMP,
   PRIMARY KEY (`id`) USING BTREE
-) ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_unicode_ci ROW_FORMAT = DYNAMIC;
\ No newline at end of file
+) ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_unicode_ci ROW_FORMAT = DYNAMIC;
+
+CREATE TABLE IF NOT EXISTS `character_saved_replays` (
+  `id` int NOT NULL AUTO_INCREMENT,
+  `character_id` int NOT NULL,
+  `replay_id` int NOT NULL,
+  PRIMARY KEY (`id`)
+) ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_unicode_ci ROW_FORMAT = DYNAMIC;
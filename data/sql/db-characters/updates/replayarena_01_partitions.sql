@@ -0,0 +1,31 @@
+-- Replays are stored in one partition per week (Monday 00:00 UTC) so that expiry
+-- drops a partition instead of deleting rows. The module adds the partitions of the
+-- coming weeks and drops expired ones in the background (ArenaReplay.Storage.MaintenanceInterval).
+-- Favorites are copied to character_arena_replays_archive when they are saved.
+-- Sorts after base/replayarena.sql; every step is skipped once done, so it can run again.
+
+-- created before partitioning so the archive is a plain table with the same columns
+CREATE TABLE IF NOT EXISTS `character_arena_replays_archive` LIKE `character_arena_replays`;
+
+UPDATE `character_arena_replays` SET `timestamp` = CURRENT_TIMESTAMP WHERE `timestamp` IS NULL;
+
+-- the partitioning column has to be part of the primary key
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.KEY_COLUMN_USAGE WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays' AND CONSTRAINT_NAME = 'PRIMARY' AND COLUMN_NAME = 'timestamp') = 0,
+  'ALTER TABLE `character_arena_replays` MODIFY `timestamp` timestamp NOT NULL DEFAULT CURRENT_TIMESTAMP, DROP PRIMARY KEY, ADD PRIMARY KEY (`id`, `timestamp`)',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+-- existing replays go to p0, which expires as a whole DeleteReplaysAfterDays after this week starts
+SET @replay_week_start = UNIX_TIMESTAMP() - MOD(UNIX_TIMESTAMP() - 345600, 604800);
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.PARTITIONS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays' AND PARTITION_NAME IS NOT NULL) = 0,
+  CONCAT('ALTER TABLE `character_arena_replays` PARTITION BY RANGE (UNIX_TIMESTAMP(`timestamp`)) (',
+    'PARTITION `p0` VALUES LESS THAN (', @replay_week_start, '), ',
+    'PARTITION `pfuture` VALUES LESS THAN MAXVALUE)'),
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
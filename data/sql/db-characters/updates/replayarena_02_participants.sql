@@ -0,0 +1,33 @@
+-- One row per player of a replay, so a player's replays are found through an index
+-- instead of a LIKE scan over the comma-separated guid columns.
+-- team: 0 for the winning side, 1 for the losing side.
+-- Runs after replayarena_01_partitions.sql, which creates the archive read by the backfill.
+CREATE TABLE IF NOT EXISTS `character_arena_replay_participants` (
+  `replay_id` int NOT NULL,
+  `player_guid` int unsigned NOT NULL,
+  `team` tinyint unsigned NOT NULL,
+  `class` tinyint unsigned NOT NULL DEFAULT 0,
+  `race` tinyint unsigned NOT NULL DEFAULT 0,
+  PRIMARY KEY (`replay_id`, `player_guid`),
+  INDEX `idx_player_guid` (`player_guid`, `replay_id`)
+) ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_unicode_ci ROW_FORMAT = DYNAMIC;
+
+-- backfill from the guid lists of the replays saved before this table existed;
+-- class and race come from the characters table (0 for deleted characters); INSERT IGNORE
+-- skips the rows already there when the file runs again
+INSERT IGNORE INTO `character_arena_replay_participants` (`replay_id`, `player_guid`, `team`, `class`, `race`)
+WITH RECURSIVE `guid_lists` (`replay_id`, `team`, `rest`, `guid`) AS (
+  SELECT `id`, 0, CONCAT(REPLACE(`winnerPlayerGuids`, ' ', ''), ','), CAST(NULL AS CHAR(20)) FROM `character_arena_replays` WHERE `winnerPlayerGuids` <> ''
+  UNION ALL
+  SELECT `id`, 1, CONCAT(REPLACE(`loserPlayerGuids`, ' ', ''), ','), CAST(NULL AS CHAR(20)) FROM `character_arena_replays` WHERE `loserPlayerGuids` <> ''
+  UNION ALL
+  SELECT `id`, 0, CONCAT(REPLACE(`winnerPlayerGuids`, ' ', ''), ','), CAST(NULL AS CHAR(20)) FROM `character_arena_replays_archive` WHERE `winnerPlayerGuids` <> ''
+  UNION ALL
+  SELECT `id`, 1, CONCAT(REPLACE(`loserPlayerGuids`, ' ', ''), ','), CAST(NULL AS CHAR(20)) FROM `character_arena_replays_archive` WHERE `loserPlayerGuids` <> ''
+  UNION ALL
+  SELECT `replay_id`, `team`, SUBSTRING(`rest`, LOCATE(',', `rest`) + 1), SUBSTRING_INDEX(`rest`, ',', 1) FROM `guid_lists` WHERE `rest` <> ''
+)
+SELECT g.`replay_id`, CAST(g.`guid` AS UNSIGNED), g.`team`, COALESCE(c.`class`, 0), COALESCE(c.`race`, 0)
+FROM `guid_lists` g
+LEFT JOIN `characters` c ON c.`guid` = CAST(g.`guid` AS UNSIGNED)
+WHERE g.`guid` <> '';
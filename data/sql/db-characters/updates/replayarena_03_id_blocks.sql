@@ -0,0 +1,11 @@
+-- Blocks of replay ids reserved by the worldservers, one row per block of
+-- 100 ids starting at firstId. A server claims the next block by inserting
+-- it under a token of its own and reads firstId back by that token; two
+-- servers claiming the same block at once collide on the primary key.
+CREATE TABLE IF NOT EXISTS `character_arena_replay_id_blocks` (
+  `firstId` int unsigned NOT NULL,
+  `token` varchar(32) CHARACTER SET ascii COLLATE ascii_bin NOT NULL,
+  `claimed` timestamp NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  PRIMARY KEY (`firstId`),
+  UNIQUE INDEX `idx_token` (`token`)
+) ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_unicode_ci ROW_FORMAT = DYNAMIC;
@@ -0,0 +1,25 @@
+-- Name and gender complete the roster kept per replay participant, so the gossip lists
+-- are formatted without character cache lookups.
+-- Runs after replayarena_02_participants.sql, which creates the table; every step is
+-- skipped once done, so it can run again.
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.COLUMNS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replay_participants' AND COLUMN_NAME = 'name') = 0,
+  'ALTER TABLE `character_arena_replay_participants` ADD COLUMN `name` varchar(12) NOT NULL DEFAULT '''' AFTER `player_guid`',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.COLUMNS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replay_participants' AND COLUMN_NAME = 'gender') = 0,
+  'ALTER TABLE `character_arena_replay_participants` ADD COLUMN `gender` tinyint unsigned NOT NULL DEFAULT 0 AFTER `race`',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+-- backfill the participants saved before the columns existed
+UPDATE `character_arena_replay_participants` p
+JOIN `characters` c ON c.`guid` = p.`player_guid`
+SET p.`name` = c.`name`, p.`gender` = c.`gender`
+WHERE p.`name` = '';
@@ -0,0 +1,59 @@
+-- Indexes behind the keyset-paginated gossip lists: each "Next Page" is a range read
+-- from the last row shown, never an OFFSET. The lists read the archive too, so it gets
+-- the same indexes. Runs after replayarena_01_partitions.sql, which creates the archive;
+-- each index is only added when missing, so it can run again.
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.STATISTICS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays' AND INDEX_NAME = 'idx_type_rating') = 0,
+  'ALTER TABLE `character_arena_replays` ADD INDEX `idx_type_rating` (`arenaTypeId`, `winnerTeamRating`, `id`)',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.STATISTICS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays' AND INDEX_NAME = 'idx_type_id') = 0,
+  'ALTER TABLE `character_arena_replays` ADD INDEX `idx_type_id` (`arenaTypeId`, `id`)',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.STATISTICS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays' AND INDEX_NAME = 'idx_watched') = 0,
+  'ALTER TABLE `character_arena_replays` ADD INDEX `idx_watched` (`timesWatched`, `id`)',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.STATISTICS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays_archive' AND INDEX_NAME = 'idx_type_rating') = 0,
+  'ALTER TABLE `character_arena_replays_archive` ADD INDEX `idx_type_rating` (`arenaTypeId`, `winnerTeamRating`, `id`)',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.STATISTICS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays_archive' AND INDEX_NAME = 'idx_type_id') = 0,
+  'ALTER TABLE `character_arena_replays_archive` ADD INDEX `idx_type_id` (`arenaTypeId`, `id`)',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.STATISTICS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays_archive' AND INDEX_NAME = 'idx_watched') = 0,
+  'ALTER TABLE `character_arena_replays_archive` ADD INDEX `idx_watched` (`timesWatched`, `id`)',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.STATISTICS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_saved_replays' AND INDEX_NAME = 'idx_character') = 0,
+  'ALTER TABLE `character_saved_replays` ADD INDEX `idx_character` (`character_id`, `id`)',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
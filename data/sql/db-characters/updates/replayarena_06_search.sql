@@ -0,0 +1,20 @@
+-- Match length in seconds (start delay included) for the duration filter of the replay
+-- search. Replays saved before this column existed keep 0 and never match that filter.
+-- The archive gets it too, so favorites are still copied there with SELECT *.
+-- Runs after replayarena_01_partitions.sql, which creates the archive; each column is
+-- only added when missing, so it can run again.
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.COLUMNS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays' AND COLUMN_NAME = 'duration') = 0,
+  'ALTER TABLE `character_arena_replays` ADD COLUMN `duration` int unsigned NOT NULL DEFAULT 0',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
+
+SET @replay_sql = IF((SELECT COUNT(*) FROM information_schema.COLUMNS WHERE TABLE_SCHEMA = DATABASE()
+    AND TABLE_NAME = 'character_arena_replays_archive' AND COLUMN_NAME = 'duration') = 0,
+  'ALTER TABLE `character_arena_replays_archive` ADD COLUMN `duration` int unsigned NOT NULL DEFAULT 0',
+  'DO 0');
+PREPARE replay_stmt FROM @replay_sql;
+EXECUTE replay_stmt;
+DEALLOCATE PREPARE replay_stmt;
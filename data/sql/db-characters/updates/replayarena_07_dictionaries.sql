@@ -0,0 +1,12 @@
+-- zstd dictionaries trained by `.replay dict train`, one current dictionary per arena map.
+-- A zstd row stores the id of the dictionary it was compressed with, so older dictionaries
+-- are kept for the rows that still use them. Only needed by builds with ARENA_REPLAY_WITH_ZSTD.
+CREATE TABLE IF NOT EXISTS `character_arena_replay_dictionaries` (
+  `id` int NOT NULL,
+  `mapId` int NOT NULL,
+  `sampleCount` int NOT NULL DEFAULT 0,
+  `dictionary` longblob NOT NULL,
+  `timestamp` timestamp NULL DEFAULT CURRENT_TIMESTAMP,
+  PRIMARY KEY (`id`) USING BTREE,
+  INDEX `idx_mapId` (`mapId`)
+) ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_unicode_ci ROW_FORMAT = DYNAMIC;
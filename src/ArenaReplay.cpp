@@ -1,7 +1,9 @@
 //
 // Created by romain-p on 17/10/2021.
 //
+#include "ArenaReplayConfig.h"
 #include "ArenaReplayDatabaseConnection.h"
+#include "ArenaReplayMetrics.h"
 #include "ArenaReplay_loader.h"
 #include "ArenaTeamMgr.h"
 #include "Base32.h"
@@ -18,16 +20,37 @@
 #if __has_include("UpdateFields.h")
 #include "UpdateFields.h"
 #endif
-#include <iomanip>
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
 #include <deque>
+#include <fstream>
+#include <functional>
 #include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <shared_mutex>
+#include <span>
+#include <thread>
 #include <vector>
 #include <zlib.h>
+#if defined(ARENA_REPLAY_WITH_LIBDEFLATE) && __has_include(<libdeflate.h>)
+#include <libdeflate.h>
+#define ARENA_REPLAY_LIBDEFLATE 1
+#endif
+#if defined(ARENA_REPLAY_WITH_ZSTD) && __has_include(<zstd.h>) && __has_include(<zdict.h>)
+#include <zdict.h>
+#include <zstd.h>
+#define ARENA_REPLAY_ZSTD 1
+#endif
 
 std::vector<Opcodes> watchList =
 {
@@ -84,45 +107,100 @@ SMSG_PLAY_SPELL_VISUAL
 CMSG_ATTACKSWING
 CMSG_ATTACKSTOP*/
 
-struct PacketRecord { uint32 timestamp; WorldPacket packet; uint64 sourceGuid = 0; bool drop = false; };
+struct PacketRecord
+{
+    uint32 timestamp;
+    WorldPacket packet;
+    uint64 sourceGuid = 0;
+    bool drop = false;
+    std::vector<uint8> inflated{}; // decompressed SMSG_COMPRESSED_UPDATE_OBJECT payload, only held while loading
+};
+// Set by a streaming load: packets [0, ready) are remapped and may be played.
+// The loader publishes with release stores, playback reads with acquire, and
+// nothing but ready and done is read before ready leaves 0.
+struct ReplayLoadProgress
+{
+    std::atomic<size_t> ready = 0;
+    std::atomic<bool> done = false;
+};
 struct MatchRecord {
     BattlegroundTypeId typeId;
     uint8 arenaTypeId;
-    uint32 mapId;
+    uint32 mapId = 0;
     uint32 replayId = 0;
     std::deque<PacketRecord> packets;
     std::vector<uint64> participantGuids;
     std::unordered_map<uint64, uint64> guidRemap;
-    bool observerJoined = false;
-    bool debugLoggedStart = false;
-    size_t debugPacketsLogged = 0;
-    size_t sentPackets = 0;
-    bool maxPacketsLogged = false;
     bool invalidOpcodeLogged = false;
-    bool invalidSendOpcodeLogged = false;
     bool updateObjectParseWarningLogged = false;
     bool updateObjectLeakLogged = false;
     bool guidLeakDropLogged = false;
-    bool updateLogged = false;
     size_t updateObjectParseLogs = 0;
+    uint32 compressedUpdatePackets = 0;
+    uint32 inflateCalls = 0;
+    uint32 deflateCalls = 0;
+    uint32 inflatedPayloadReuses = 0;
+    std::shared_ptr<ReplayLoadProgress> progress; // null once loaded in full
+    size_t releasedPackets = 0; // played by every battleground showing a loaded replay and freed
+
+    // by index from the start of the replay, released packets included
+    PacketRecord const& Packet(size_t index) const { return packets[index - releasedPackets]; }
+    size_t PacketCount() const { return releasedPackets + packets.size(); }
+    size_t PlayablePackets() const { return progress ? progress->ready.load(std::memory_order_acquire) : PacketCount(); }
+    bool Loading() const { return progress && !progress->done.load(std::memory_order_acquire); }
+};
+// Playback position of one replay battleground. The loaded replay is shared
+// by every battleground showing the same replay id; only the packets all of
+// them have sent are ever removed from it.
+struct ReplayPlayback {
+    std::shared_ptr<MatchRecord> match;
+    size_t nextPacket = 0;
+    size_t sentPackets = 0;
+    size_t debugPacketsLogged = 0;
+    bool observerJoined = false;
+    bool debugLoggedStart = false;
+    bool maxPacketsLogged = false;
+    bool invalidSendOpcodeLogged = false;
+    bool updateLogged = false;
+};
+// One line of the gossip replay lists.
+struct ReplayInfo
+{
+    uint32 matchId = 0;
+    uint8 arenaTypeId = 0;
+
+    std::string winnerTeamName;
+    uint32 winnerTeamRating = 0;
+
+    std::string loserTeamName;
+    uint32 loserTeamRating = 0;
+
+    uint32 timesWatched = 0;
+    uint64 timestamp = 0;    // unix time of the save
+    std::string gossipText;  // the menu line, formatted once from the roster
 };
-struct BgPlayersGuids { std::string alliancePlayerGuids; std::string hordePlayerGuids; };
+struct LoadedReplay {
+    std::weak_ptr<MatchRecord> match;
+    ReplayInfo summary; // watch count kept current by shared loads
+};
+struct ReplayParticipant { uint32 guid; std::string name; TeamId team; uint8 playerClass; uint8 race; uint8 gender; };
+struct BgPlayersGuids { std::string alliancePlayerGuids; std::string hordePlayerGuids; std::vector<ReplayParticipant> participants; };
 std::unordered_map<uint32, MatchRecord> records;
-std::unordered_map<uint32, MatchRecord> loadedReplays;
+std::unordered_map<uint32, LoadedReplay> loadedReplays;   // by replay id, alive while any battleground plays it
+std::unordered_map<uint32, ReplayPlayback> replayPlaybacks; // by bg instance id
 std::unordered_map<uint32, uint32> bgReplayIds;
 std::unordered_map<uint32, BgPlayersGuids> bgPlayersGuids;
 
 namespace
 {
     bool ReplaceGuidInPacket(WorldPacket& packet, uint64 fromGuid, uint64 toGuid, std::unordered_map<uint64, uint8>* objectTypes = nullptr);
-    bool PacketContainsGuid(WorldPacket const& packet, uint64 guid);
-    bool Decompress(std::vector<uint8> const& input, std::vector<uint8>& output);
-    bool Compress(std::vector<uint8> const& input, std::vector<uint8>& output);
+    bool Decompress(std::span<uint8 const> input, std::vector<uint8>& output);
+    bool Compress(std::span<uint8 const> input, std::vector<uint8>& output);
     template <typename T>
-    bool ReadLittleEndian(std::vector<uint8> const& data, size_t& offset, T& value);
+    bool ReadLittleEndian(std::span<uint8 const> data, size_t& offset, T& value);
     template <typename T>
     void WriteLittleEndian(std::vector<uint8>& buffer, T value);
-    bool SkipBytes(std::vector<uint8> const& input, size_t& offset, size_t count);
+    bool SkipBytes(std::span<uint8 const> input, size_t& offset, size_t count);
 
     std::array<uint8, 8> GetGuidBytes(uint64 guid)
     {
@@ -156,38 +234,166 @@ namespace
         return false;
     }
 
-    std::vector<uint8> GetPackedGuidBytes(uint64 guid)
+    // Packed GUID encoding: a mask byte followed by the non-zero GUID bytes,
+    // held on the stack. A zero GUID has no packed bytes at all.
+    struct PackedGuidBytes
     {
-        std::array<uint8, 8> guidBytes = GetGuidBytes(guid);
-        uint8 mask = 0;
-        std::vector<uint8> packed;
-        packed.reserve(9);
+        std::array<uint8, 9> bytes{};
+        uint8 size = 0;
+
+        bool Empty() const { return size == 0; }
+        uint8 Mask() const { return bytes[0]; }
+        std::span<uint8 const> View() const { return { bytes.data(), size }; }
+    };
+
+    PackedGuidBytes GetPackedGuidBytes(uint64 guid)
+    {
+        PackedGuidBytes packed;
+        if (guid == 0)
+            return packed;
 
-        for (uint8 i = 0; i < guidBytes.size(); ++i)
+        uint8 mask = 0;
+        packed.size = 1;
+        for (uint8 i = 0; i < 8; ++i)
         {
-            if (guidBytes[i] == 0)
+            uint8 value = uint8((guid >> (i * 8)) & 0xFF);
+            if (value == 0)
                 continue;
 
             mask |= (1u << i);
-            packed.push_back(guidBytes[i]);
+            packed.bytes[packed.size++] = value;
         }
 
-        if (mask == 0)
-            return {};
-
-        packed.insert(packed.begin(), mask);
+        packed.bytes[0] = mask;
         return packed;
     }
 
     uint8 GetPackedMask(uint64 guid)
     {
-        std::vector<uint8> packed = GetPackedGuidBytes(guid);
-        if (packed.empty())
-            return 0;
+        uint8 mask = 0;
+        for (uint8 i = 0; i < 8; ++i)
+        {
+            if ((guid >> (i * 8)) & 0xFF)
+                mask |= (1u << i);
+        }
 
-        return packed.front();
+        return mask;
     }
 
+    struct GuidPatternHit
+    {
+        size_t offset;
+        uint64 guid;
+        bool packed;
+    };
+
+    // Matches the raw and packed encodings of a fixed GUID set in a single pass.
+    // Patterns are bucketed by their first byte so that most payload bytes are
+    // rejected by one table lookup before any comparison is made.
+    class GuidPatternMatcher
+    {
+    public:
+        explicit GuidPatternMatcher(std::unordered_map<uint64, uint64> const& guidRemap)
+        {
+            std::vector<Pattern> patterns;
+            patterns.reserve(guidRemap.size() * 2);
+            for (auto const& entry : guidRemap)
+            {
+                uint64 guid = entry.first;
+                if (guid == 0)
+                    continue;
+
+                Pattern raw{};
+                std::array<uint8, 8> rawBytes = GetGuidBytes(guid);
+                std::copy(rawBytes.begin(), rawBytes.end(), raw.bytes.begin());
+                raw.size = static_cast<uint8>(rawBytes.size());
+                raw.guid = guid;
+                raw.packed = false;
+                patterns.push_back(raw);
+
+                PackedGuidBytes packedBytes = GetPackedGuidBytes(guid);
+                Pattern packed{};
+                packed.bytes = packedBytes.bytes;
+                packed.size = packedBytes.size;
+                packed.guid = guid;
+                packed.packed = true;
+                patterns.push_back(packed);
+            }
+
+            std::stable_sort(patterns.begin(), patterns.end(), [](Pattern const& left, Pattern const& right)
+            {
+                return left.bytes[0] < right.bytes[0];
+            });
+
+            _patterns = std::move(patterns);
+            _bucketBegin.fill(0);
+            for (Pattern const& pattern : _patterns)
+                ++_bucketBegin[pattern.bytes[0] + 1];
+
+            for (size_t i = 1; i < _bucketBegin.size(); ++i)
+                _bucketBegin[i] += _bucketBegin[i - 1];
+        }
+
+        bool Empty() const { return _patterns.empty(); }
+
+        // Returns true if any pattern occurs in the buffer. When hits is null the
+        // scan stops at the first match, otherwise every match is appended.
+        bool Scan(uint8 const* data, size_t size, bool allowRaw, std::vector<GuidPatternHit>* hits) const
+        {
+            if (!data || _patterns.empty())
+                return false;
+
+            bool found = false;
+            for (size_t offset = 0; offset < size; ++offset)
+            {
+                uint8 first = data[offset];
+                uint16 begin = _bucketBegin[first];
+                uint16 end = _bucketBegin[first + 1];
+                if (begin == end)
+                    continue;
+
+                size_t remaining = size - offset;
+                for (uint16 i = begin; i < end; ++i)
+                {
+                    Pattern const& pattern = _patterns[i];
+                    if (!pattern.packed && !allowRaw)
+                        continue;
+
+                    if (pattern.size > remaining)
+                        continue;
+
+                    if (std::memcmp(data + offset, pattern.bytes.data(), pattern.size) != 0)
+                        continue;
+
+                    if (!hits)
+                        return true;
+
+                    hits->push_back({ offset, pattern.guid, pattern.packed });
+                    found = true;
+                }
+            }
+
+            return found;
+        }
+
+        bool Scan(std::span<uint8 const> data, bool allowRaw, std::vector<GuidPatternHit>* hits) const
+        {
+            return Scan(data.data(), data.size(), allowRaw, hits);
+        }
+
+    private:
+        struct Pattern
+        {
+            std::array<uint8, 9> bytes;
+            uint8 size;
+            uint64 guid;
+            bool packed;
+        };
+
+        std::vector<Pattern> _patterns;
+        std::array<uint16, 257> _bucketBegin{};
+    };
+
     bool IsClientOpcode(Opcodes opcode)
     {
         switch (opcode)
@@ -285,27 +491,42 @@ namespace
     constexpr uint32 MOVEFLAG_SPLINE_ELEVATION = 0x00040000;
     constexpr uint16 MOVEFLAG2_INTERPOLATED_MOVE = 0x0001;
 
-    bool IsGuidLowField(uint16 fieldIndex, uint8 objectTypeId)
-    {
-        if (objectTypeId == static_cast<uint8>(TypeId::Unit))
-            return std::find(UNIT_GUID_FIELDS_LOW.begin(), UNIT_GUID_FIELDS_LOW.end(), fieldIndex) != UNIT_GUID_FIELDS_LOW.end();
+#if __has_include("UpdateFields.h")
+    constexpr size_t GUID_FIELD_TABLE_SIZE = PLAYER_END;
+#else
+    constexpr size_t GUID_FIELD_TABLE_SIZE = 0;
+#endif
 
-        if (objectTypeId == static_cast<uint8>(TypeId::Player))
-            return std::find(PLAYER_GUID_FIELDS_LOW.begin(), PLAYER_GUID_FIELDS_LOW.end(), fieldIndex) != PLAYER_GUID_FIELDS_LOW.end();
+    using GuidFieldBitset = std::array<uint64, (GUID_FIELD_TABLE_SIZE + 63) / 64>;
 
-        if (objectTypeId == static_cast<uint8>(TypeId::GameObject))
-            return std::find(GAMEOBJECT_GUID_FIELDS_LOW.begin(), GAMEOBJECT_GUID_FIELDS_LOW.end(), fieldIndex) != GAMEOBJECT_GUID_FIELDS_LOW.end();
+    template <size_t N>
+    constexpr GuidFieldBitset BuildGuidFieldBitset(std::array<uint16, N> const& fields)
+    {
+        GuidFieldBitset bits{};
+        for (uint16 field : fields)
+            bits[field / 64] |= uint64(1) << (field % 64);
 
-        if (objectTypeId == static_cast<uint8>(TypeId::DynamicObject))
-            return std::find(DYNAMICOBJECT_GUID_FIELDS_LOW.begin(), DYNAMICOBJECT_GUID_FIELDS_LOW.end(), fieldIndex) != DYNAMICOBJECT_GUID_FIELDS_LOW.end();
+        return bits;
+    }
 
-        if (objectTypeId == static_cast<uint8>(TypeId::Corpse))
-            return std::find(CORPSE_GUID_FIELDS_LOW.begin(), CORPSE_GUID_FIELDS_LOW.end(), fieldIndex) != CORPSE_GUID_FIELDS_LOW.end();
+    // indexed by TypeId
+    constexpr std::array<GuidFieldBitset, 8> GUID_LOW_FIELDS_BY_TYPE = {
+        GuidFieldBitset{},
+        BuildGuidFieldBitset(ITEM_GUID_FIELDS_LOW),
+        BuildGuidFieldBitset(ITEM_GUID_FIELDS_LOW),
+        BuildGuidFieldBitset(UNIT_GUID_FIELDS_LOW),
+        BuildGuidFieldBitset(PLAYER_GUID_FIELDS_LOW),
+        BuildGuidFieldBitset(GAMEOBJECT_GUID_FIELDS_LOW),
+        BuildGuidFieldBitset(DYNAMICOBJECT_GUID_FIELDS_LOW),
+        BuildGuidFieldBitset(CORPSE_GUID_FIELDS_LOW)
+    };
 
-        if (objectTypeId == static_cast<uint8>(TypeId::Item) || objectTypeId == static_cast<uint8>(TypeId::Container))
-            return std::find(ITEM_GUID_FIELDS_LOW.begin(), ITEM_GUID_FIELDS_LOW.end(), fieldIndex) != ITEM_GUID_FIELDS_LOW.end();
+    bool IsGuidLowField(uint16 fieldIndex, uint8 objectTypeId)
+    {
+        if (objectTypeId >= GUID_LOW_FIELDS_BY_TYPE.size() || fieldIndex >= GUID_FIELD_TABLE_SIZE)
+            return false;
 
-        return false;
+        return (GUID_LOW_FIELDS_BY_TYPE[objectTypeId][fieldIndex / 64] >> (fieldIndex % 64)) & 1;
     }
 
     struct UpdateObjectParseStats
@@ -315,7 +536,7 @@ namespace
         size_t bytesConsumed = 0;
     };
 
-    bool CopyBytes(std::vector<uint8> const& input, size_t& offset, std::vector<uint8>& output, size_t count)
+    bool CopyBytes(std::span<uint8 const> input, size_t& offset, std::vector<uint8>& output, size_t count)
     {
         if (offset + count > input.size())
             return false;
@@ -326,7 +547,7 @@ namespace
     }
 
     template <typename T>
-    bool ReadAndWrite(std::vector<uint8> const& input, size_t& offset, std::vector<uint8>& output, T& value)
+    bool ReadAndWrite(std::span<uint8 const> input, size_t& offset, std::vector<uint8>& output, T& value)
     {
         if (!ReadLittleEndian(input, offset, value))
             return false;
@@ -335,18 +556,15 @@ namespace
         return true;
     }
 
-    bool ReadPackedGuid(std::vector<uint8> const& input, size_t& offset, uint64& guid, std::vector<uint8>* packedBytes)
+    bool ReadPackedGuid(std::span<uint8 const> input, size_t& offset, uint64& guid, PackedGuidBytes* packedBytes)
     {
         if (offset >= input.size())
             return false;
 
+        size_t start = offset;
         uint8 mask = input[offset++];
         guid = 0;
 
-        std::vector<uint8> packed;
-        packed.reserve(9);
-        packed.push_back(mask);
-
         for (uint8 i = 0; i < 8; ++i)
         {
             if ((mask & (1u << i)) == 0)
@@ -355,31 +573,32 @@ namespace
             if (offset >= input.size())
                 return false;
 
-            uint8 value = input[offset++];
-            packed.push_back(value);
-            guid |= (uint64(value) << (i * 8));
+            guid |= (uint64(input[offset++]) << (i * 8));
         }
 
         if (packedBytes)
-            *packedBytes = std::move(packed);
+        {
+            packedBytes->size = static_cast<uint8>(offset - start);
+            std::memcpy(packedBytes->bytes.data(), input.data() + start, packedBytes->size);
+        }
 
         return true;
     }
 
     void WritePackedGuid(std::vector<uint8>& output, uint64 guid)
     {
-        std::vector<uint8> packed = GetPackedGuidBytes(guid);
-        if (packed.empty())
+        PackedGuidBytes packed = GetPackedGuidBytes(guid);
+        if (packed.Empty())
         {
             output.push_back(0);
             return;
         }
 
-        output.insert(output.end(), packed.begin(), packed.end());
+        output.insert(output.end(), packed.bytes.begin(), packed.bytes.begin() + packed.size);
     }
 
-    bool CopyMovementBlock(std::vector<uint8> const& input, size_t& offset, std::vector<uint8>& output,
-        std::unordered_map<uint64, uint64> const* remap, std::unordered_set<uint64>* extracted)
+    bool CopyMovementBlock(std::span<uint8 const> input, size_t& offset, std::vector<uint8>& output,
+        std::unordered_map<uint64, uint64> const& remap)
     {
         uint32 flags = 0;
         uint16 flags2 = 0;
@@ -401,16 +620,10 @@ namespace
             if (!ReadLittleEndian(input, offset, transportGuid))
                 return false;
 
-            if (extracted && transportGuid != 0)
-                extracted->insert(transportGuid);
-
             uint64 finalTransportGuid = transportGuid;
-            if (remap)
-            {
-                auto it = remap->find(transportGuid);
-                if (it != remap->end())
-                    finalTransportGuid = it->second;
-            }
+            auto it = remap.find(transportGuid);
+            if (it != remap.end())
+                finalTransportGuid = it->second;
 
             WriteLittleEndian(output, finalTransportGuid);
 
@@ -458,46 +671,88 @@ namespace
         return true;
     }
 
-    bool CopyUpdateMaskAndValues(std::vector<uint8> const& input, size_t& offset, std::vector<uint8>& output,
-        std::unordered_map<uint64, uint64> const* remap, uint8 objectTypeId, std::unordered_set<uint64>* extracted)
+    // Walks the set bits of an update mask in field order straight from the
+    // packet bytes. Two consecutive set bits are returned as one 64-bit pair.
+    class UpdateMaskWalker
     {
-        uint8 maskCount = 0;
-        if (!ReadAndWrite(input, offset, output, maskCount))
-            return false;
-
-        std::vector<uint32> masks;
-        masks.reserve(maskCount);
-        for (uint8 i = 0; i < maskCount; ++i)
+    public:
+        explicit UpdateMaskWalker(std::span<uint8 const> maskBytes) : _maskBytes(maskBytes)
         {
-            uint32 mask = 0;
-            if (!ReadAndWrite(input, offset, output, mask))
-                return false;
-            masks.push_back(mask);
+            _maskCount = _maskBytes.size() / sizeof(uint32);
+            _current = LoadMask(0);
         }
 
-        std::vector<uint16> fields;
-        fields.reserve(static_cast<size_t>(maskCount) * 32);
-        for (uint8 maskIndex = 0; maskIndex < maskCount; ++maskIndex)
+        bool Next(uint16& fieldIndex, bool& hasHigh)
         {
-            uint32 mask = masks[maskIndex];
-            for (uint8 bit = 0; bit < 32; ++bit)
+            while (_current == 0)
             {
-                if ((mask & (1u << bit)) == 0)
-                    continue;
-                fields.push_back(static_cast<uint16>(maskIndex * 32 + bit));
+                if (++_word >= _maskCount)
+                    return false;
+
+                _current = LoadMask(_word);
+            }
+
+            uint32 bit = static_cast<uint32>(std::countr_zero(_current));
+            _current &= _current - 1;
+            fieldIndex = static_cast<uint16>(_word * 32 + bit);
+
+            if (bit < 31)
+            {
+                hasHigh = (_current & (1u << (bit + 1))) != 0;
+                if (hasHigh)
+                    _current &= _current - 1;
             }
+            else
+            {
+                hasHigh = _word + 1 < _maskCount && (LoadMask(_word + 1) & 1u) != 0;
+                if (hasHigh)
+                {
+                    ++_word;
+                    _current = LoadMask(_word) & ~1u;
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        uint32 LoadMask(size_t index) const
+        {
+            if (index >= _maskCount)
+                return 0;
+
+            uint8 const* bytes = _maskBytes.data() + index * sizeof(uint32);
+            return uint32(bytes[0]) | (uint32(bytes[1]) << 8) | (uint32(bytes[2]) << 16) | (uint32(bytes[3]) << 24);
         }
 
-        for (size_t i = 0; i < fields.size(); ++i)
+        std::span<uint8 const> _maskBytes;
+        size_t _maskCount = 0;
+        size_t _word = 0;
+        uint32 _current = 0;
+    };
+
+    bool CopyUpdateMaskAndValues(std::span<uint8 const> input, size_t& offset, std::vector<uint8>& output,
+        std::unordered_map<uint64, uint64> const& remap, uint8 objectTypeId)
+    {
+        uint8 maskCount = 0;
+        if (!ReadAndWrite(input, offset, output, maskCount))
+            return false;
+
+        size_t maskOffset = offset;
+        if (!CopyBytes(input, offset, output, static_cast<size_t>(maskCount) * sizeof(uint32)))
+            return false;
+
+        UpdateMaskWalker walker(input.subspan(maskOffset, static_cast<size_t>(maskCount) * sizeof(uint32)));
+        uint16 fieldIndex = 0;
+        bool hasHigh = false;
+        while (walker.Next(fieldIndex, hasHigh))
         {
-            uint16 fieldIndex = fields[i];
             bool isGuidField = objectTypeId != 0xFF && IsGuidLowField(fieldIndex, objectTypeId);
             uint32 lowValue = 0;
             if (!ReadLittleEndian(input, offset, lowValue))
                 return false;
 
-            bool hasHigh = (i + 1) < fields.size() && fields[i + 1] == static_cast<uint16>(fieldIndex + 1);
-            if (remap && isGuidField && !hasHigh)
+            if (isGuidField && !hasHigh)
                 return false;
             if (hasHigh)
             {
@@ -505,31 +760,18 @@ namespace
                 if (!ReadLittleEndian(input, offset, highValue))
                     return false;
 
-                uint64 guid = (uint64(highValue) << 32) | lowValue;
-                uint64 finalGuid = guid;
-                if (isGuidField && remap)
+                uint64 finalGuid = (uint64(highValue) << 32) | lowValue;
+                if (isGuidField)
                 {
-                    auto it = remap->find(guid);
-                    if (it != remap->end())
+                    auto it = remap.find(finalGuid);
+                    if (it != remap.end())
                         finalGuid = it->second;
                 }
 
-                if (extracted && guid != 0)
-                {
-                    if (isGuidField)
-                        extracted->insert(guid);
-                    else if (!remap && objectTypeId == 0xFF)
-                    {
-                        if (guid > 0xFFFFull && GetPackedMask(guid) != 0)
-                            extracted->insert(guid);
-                    }
-                }
-
                 uint32 finalLow = static_cast<uint32>(finalGuid & 0xFFFFFFFFu);
                 uint32 finalHigh = static_cast<uint32>((finalGuid >> 32) & 0xFFFFFFFFu);
                 WriteLittleEndian(output, finalLow);
                 WriteLittleEndian(output, finalHigh);
-                ++i;
                 continue;
             }
 
@@ -539,7 +781,52 @@ namespace
         return true;
     }
 
-    bool SkipMovementBlock(std::vector<uint8> const& input, size_t& offset)
+    // Same walk as CopyUpdateMaskAndValues without producing output. Values
+    // updates carry no object type, so any pair that looks like a GUID is kept.
+    bool ExtractUpdateMaskAndValues(std::span<uint8 const> input, size_t& offset, uint8 objectTypeId,
+        std::unordered_set<uint64>& extracted)
+    {
+        uint8 maskCount = 0;
+        if (!ReadLittleEndian(input, offset, maskCount))
+            return false;
+
+        size_t maskOffset = offset;
+        if (!SkipBytes(input, offset, static_cast<size_t>(maskCount) * sizeof(uint32)))
+            return false;
+
+        UpdateMaskWalker walker(input.subspan(maskOffset, static_cast<size_t>(maskCount) * sizeof(uint32)));
+        uint16 fieldIndex = 0;
+        bool hasHigh = false;
+        while (walker.Next(fieldIndex, hasHigh))
+        {
+            uint32 lowValue = 0;
+            if (!ReadLittleEndian(input, offset, lowValue))
+                return false;
+
+            if (!hasHigh)
+                continue;
+
+            uint32 highValue = 0;
+            if (!ReadLittleEndian(input, offset, highValue))
+                return false;
+
+            uint64 guid = (uint64(highValue) << 32) | lowValue;
+            if (guid == 0)
+                continue;
+
+            if (objectTypeId != 0xFF)
+            {
+                if (IsGuidLowField(fieldIndex, objectTypeId))
+                    extracted.insert(guid);
+            }
+            else if (guid > 0xFFFFull && GetPackedMask(guid) != 0)
+                extracted.insert(guid);
+        }
+
+        return true;
+    }
+
+    bool SkipMovementBlock(std::span<uint8 const> input, size_t& offset, std::unordered_set<uint64>* extracted)
     {
         uint32 flags = 0;
         uint16 flags2 = 0;
@@ -561,6 +848,9 @@ namespace
             if (!ReadLittleEndian(input, offset, transportGuid))
                 return false;
 
+            if (extracted && transportGuid != 0)
+                extracted->insert(transportGuid);
+
             if (!SkipBytes(input, offset, sizeof(float) * 4))
                 return false;
 
@@ -605,7 +895,7 @@ namespace
         return true;
     }
 
-    bool SkipUpdateMaskAndValues(std::vector<uint8> const& input, size_t& offset)
+    bool SkipUpdateMaskAndValues(std::span<uint8 const> input, size_t& offset)
     {
         uint8 maskCount = 0;
         if (!ReadLittleEndian(input, offset, maskCount))
@@ -625,139 +915,229 @@ namespace
         return SkipBytes(input, offset, valueBytes);
     }
 
-    bool ContainsSequence(std::vector<uint8> const& buffer, std::vector<uint8> const& sequence)
+    // Skips the values like SkipUpdateMaskAndValues but fails where
+    // CopyUpdateMaskAndValues would, on a GUID field without its high half,
+    // so a pass that only records object types stops where the rewrite does.
+    bool CheckUpdateMaskAndValues(std::span<uint8 const> input, size_t& offset, uint8 objectTypeId)
+    {
+        if (objectTypeId == 0xFF)
+            return SkipUpdateMaskAndValues(input, offset);
+
+        uint8 maskCount = 0;
+        if (!ReadLittleEndian(input, offset, maskCount))
+            return false;
+
+        size_t maskOffset = offset;
+        if (!SkipBytes(input, offset, static_cast<size_t>(maskCount) * sizeof(uint32)))
+            return false;
+
+        UpdateMaskWalker walker(input.subspan(maskOffset, static_cast<size_t>(maskCount) * sizeof(uint32)));
+        uint16 fieldIndex = 0;
+        bool hasHigh = false;
+        while (walker.Next(fieldIndex, hasHigh))
+        {
+            if (!hasHigh && IsGuidLowField(fieldIndex, objectTypeId))
+                return false;
+
+            if (!SkipBytes(input, offset, hasHigh ? sizeof(uint64) : sizeof(uint32)))
+                return false;
+        }
+
+        return true;
+    }
+
+    // Finds the next occurrence of sequence at or after offset, using memchr on
+    // the first byte so that non-candidate positions are skipped in bulk.
+    size_t FindSequence(std::span<uint8 const> buffer, size_t offset, std::span<uint8 const> sequence)
+    {
+        size_t const size = sequence.size();
+        while (offset + size <= buffer.size())
+        {
+            void const* candidate = std::memchr(buffer.data() + offset, sequence.front(), buffer.size() - size - offset + 1);
+            if (!candidate)
+                break;
+
+            offset = static_cast<uint8 const*>(candidate) - buffer.data();
+            if (std::memcmp(buffer.data() + offset, sequence.data(), size) == 0)
+                return offset;
+
+            ++offset;
+        }
+
+        return std::numeric_limits<size_t>::max();
+    }
+
+    // GUID rewrites always keep the encoded length (raw GUIDs are 8 bytes and
+    // packed GUIDs are only swapped for ones with the same mask), so matches
+    // are overwritten in place and the surrounding bytes never move.
+    bool ReplaceSequence(std::span<uint8> buffer, std::span<uint8 const> from, std::span<uint8 const> to)
     {
-        if (sequence.empty() || buffer.size() < sequence.size())
+        if (from.empty() || from.size() != to.size() || std::equal(from.begin(), from.end(), to.begin()))
             return false;
 
-        return std::search(buffer.begin(), buffer.end(), sequence.begin(), sequence.end()) != buffer.end();
+        size_t match = FindSequence(buffer, 0, from);
+        if (match == std::numeric_limits<size_t>::max())
+            return false;
+
+        do
+        {
+            std::memcpy(buffer.data() + match, to.data(), to.size());
+            match = FindSequence(buffer, match + from.size(), from);
+        } while (match != std::numeric_limits<size_t>::max());
+
+        return true;
     }
 
-    bool ReplaceSequence(std::vector<uint8>& buffer, std::vector<uint8> const& from, std::vector<uint8> const& to)
+    bool SkipBytes(std::span<uint8 const> input, size_t& offset, size_t count)
     {
-        if (from.empty() || from == to)
+        if (offset + count > input.size())
             return false;
 
-        bool modified = false;
-        for (size_t i = 0; i + from.size() <= buffer.size();)
+        offset += count;
+        return true;
+    }
+
+    // Compile-time modes for ProcessUpdateObjectPayload. Rewrite copies the
+    // payload while remapping GUIDs and Extract only collects the GUIDs it
+    // walks past. Types skips whole ranges but records the TypeId of created
+    // objects under the GUID the rewrite gives them, and rejects what Rewrite
+    // would.
+    struct UpdateObjectRewriteMode
+    {
+        static constexpr bool Writes = true;
+        static constexpr bool Extracts = false;
+        static constexpr bool RecordsTypes = true;
+    };
+
+    struct UpdateObjectExtractMode
+    {
+        static constexpr bool Writes = false;
+        static constexpr bool Extracts = true;
+        static constexpr bool RecordsTypes = false;
+    };
+
+    struct UpdateObjectTypesMode
+    {
+        static constexpr bool Writes = false;
+        static constexpr bool Extracts = false;
+        static constexpr bool RecordsTypes = true;
+    };
+
+    template <typename Mode, typename T>
+    bool ReadUpdateField(std::span<uint8 const> input, size_t& offset, std::vector<uint8>* output, T& value)
+    {
+        if constexpr (Mode::Writes)
+            return ReadAndWrite(input, offset, *output, value);
+        else
+            return ReadLittleEndian(input, offset, value);
+    }
+
+    template <typename Mode>
+    bool ProcessPackedGuid(std::span<uint8 const> input, size_t& offset, std::vector<uint8>* output,
+        std::unordered_map<uint64, uint64> const* remap, std::unordered_set<uint64>* extracted, uint64& finalGuid)
+    {
+        uint64 guid = 0;
+        PackedGuidBytes packed;
+        if (!ReadPackedGuid(input, offset, guid, Mode::Writes ? &packed : nullptr))
+            return false;
+
+        finalGuid = guid;
+        if constexpr (Mode::Extracts)
         {
-            if (std::memcmp(buffer.data() + i, from.data(), from.size()) == 0)
+            if (guid != 0)
+                extracted->insert(guid);
+        }
+
+        if constexpr (Mode::Writes)
+        {
+            auto it = remap->find(guid);
+            if (it != remap->end() && it->second != guid)
             {
-                buffer.erase(buffer.begin() + i, buffer.begin() + i + from.size());
-                buffer.insert(buffer.begin() + i, to.begin(), to.end());
-                i += to.size();
-                modified = true;
+                finalGuid = it->second;
+                WritePackedGuid(*output, finalGuid);
             }
             else
-            {
-                ++i;
-            }
+                output->insert(output->end(), packed.bytes.begin(), packed.bytes.begin() + packed.size);
+        }
+        else if constexpr (Mode::RecordsTypes)
+        {
+            auto it = remap->find(guid);
+            if (it != remap->end())
+                finalGuid = it->second;
         }
 
-        return modified;
+        return true;
     }
 
-    bool SkipBytes(std::vector<uint8> const& input, size_t& offset, size_t count)
+    template <typename Mode>
+    bool ProcessMovementBlock(std::span<uint8 const> input, size_t& offset, std::vector<uint8>* output,
+        std::unordered_map<uint64, uint64> const* remap, std::unordered_set<uint64>* extracted)
     {
-        if (offset + count > input.size())
-            return false;
+        if constexpr (Mode::Writes)
+            return CopyMovementBlock(input, offset, *output, *remap);
+        else if constexpr (Mode::Extracts)
+            return SkipMovementBlock(input, offset, extracted);
+        else
+            return SkipMovementBlock(input, offset, nullptr);
+    }
 
-        offset += count;
-        return true;
+    template <typename Mode>
+    bool ProcessUpdateMaskAndValues(std::span<uint8 const> input, size_t& offset, std::vector<uint8>* output,
+        std::unordered_map<uint64, uint64> const* remap, uint8 objectTypeId, std::unordered_set<uint64>* extracted)
+    {
+        if constexpr (Mode::Writes)
+            return CopyUpdateMaskAndValues(input, offset, *output, *remap, objectTypeId);
+        else if constexpr (Mode::Extracts)
+            return ExtractUpdateMaskAndValues(input, offset, objectTypeId, *extracted);
+        else if constexpr (Mode::RecordsTypes)
+            return CheckUpdateMaskAndValues(input, offset, objectTypeId);
+        else
+            return SkipUpdateMaskAndValues(input, offset);
     }
 
-    bool ProcessUpdateObjectPayload(std::vector<uint8> const& input, std::vector<uint8>* output,
+    // output is only used by the rewrite mode, remap and objectTypes by the
+    // rewrite and types modes and extracted only by the extract mode; the
+    // other pointers may be null.
+    template <typename Mode>
+    bool ProcessUpdateObjectPayload(std::span<uint8 const> input, std::vector<uint8>* output,
         std::unordered_map<uint64, uint64> const* remap, std::unordered_set<uint64>* extracted,
         std::unordered_map<uint64, uint8>* objectTypes, UpdateObjectParseStats& stats, size_t& failureOffset)
     {
         size_t offset = 0;
-        std::vector<uint8> scratchOutput;
-        auto writeByte = [&](uint8 value)
+        auto fail = [&]()
         {
-            if (output)
-                output->push_back(value);
+            failureOffset = offset;
+            return false;
         };
 
         uint32 blockCount = 0;
-        if (!ReadLittleEndian(input, offset, blockCount))
-        {
-            failureOffset = offset;
-            return false;
-        }
+        if (!ReadUpdateField<Mode>(input, offset, output, blockCount))
+            return fail();
 
         stats.blockCount = blockCount;
-        if (output)
-            WriteLittleEndian(*output, blockCount);
 
         uint8 transportFlag = 0;
-        if (!ReadLittleEndian(input, offset, transportFlag))
-        {
-            failureOffset = offset;
-            return false;
-        }
-        writeByte(transportFlag);
-
-        for (uint32 blockIndex = 0; blockIndex < blockCount; ++blockIndex)
+        if (!ReadUpdateField<Mode>(input, offset, output, transportFlag))
+            return fail();
+
+        for (uint32 blockIndex = 0; blockIndex < blockCount; ++blockIndex)
         {
             uint8 updateTypeValue = 0;
-            if (!ReadLittleEndian(input, offset, updateTypeValue))
-            {
-                failureOffset = offset;
-                return false;
-            }
-            writeByte(updateTypeValue);
+            if (!ReadUpdateField<Mode>(input, offset, output, updateTypeValue))
+                return fail();
 
             UpdateType updateType = static_cast<UpdateType>(updateTypeValue);
             if (updateType == UpdateType::OutOfRange)
             {
                 uint32 guidCount = 0;
-                if (output)
-                {
-                    if (!ReadAndWrite(input, offset, *output, guidCount))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
-                else
-                {
-                    if (!ReadLittleEndian(input, offset, guidCount))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
+                if (!ReadUpdateField<Mode>(input, offset, output, guidCount))
+                    return fail();
 
                 for (uint32 i = 0; i < guidCount; ++i)
                 {
                     uint64 guid = 0;
-                    std::vector<uint8> packed;
-                    if (!ReadPackedGuid(input, offset, guid, output ? &packed : nullptr))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-
-                    if (extracted && guid != 0)
-                        extracted->insert(guid);
-
-                    uint64 finalGuid = guid;
-                    if (remap)
-                    {
-                        auto it = remap->find(guid);
-                        if (it != remap->end())
-                            finalGuid = it->second;
-                    }
-
-                    if (output)
-                    {
-                        if (finalGuid != guid)
-                            WritePackedGuid(*output, finalGuid);
-                        else if (!packed.empty())
-                            output->insert(output->end(), packed.begin(), packed.end());
-                        else
-                            output->push_back(0);
-                    }
+                    if (!ProcessPackedGuid<Mode>(input, offset, output, remap, extracted, guid))
+                        return fail();
                 }
 
                 ++stats.parsedBlocks;
@@ -765,158 +1145,68 @@ namespace
             }
 
             uint64 objectGuid = 0;
-            std::vector<uint8> packedGuid;
-            if (!ReadPackedGuid(input, offset, objectGuid, output ? &packedGuid : nullptr))
-            {
-                failureOffset = offset;
-                return false;
-            }
-
-            if (extracted && objectGuid != 0)
-                extracted->insert(objectGuid);
-
-            uint64 finalGuid = objectGuid;
-            if (remap)
-            {
-                auto it = remap->find(objectGuid);
-                if (it != remap->end())
-                    finalGuid = it->second;
-            }
-
-            if (output)
-            {
-                if (finalGuid != objectGuid)
-                    WritePackedGuid(*output, finalGuid);
-                else if (!packedGuid.empty())
-                    output->insert(output->end(), packedGuid.begin(), packedGuid.end());
-                else
-                    output->push_back(0);
-            }
+            if (!ProcessPackedGuid<Mode>(input, offset, output, remap, extracted, objectGuid))
+                return fail();
 
+            bool parsed = false;
             if (updateType == UpdateType::CreateObject || updateType == UpdateType::CreateObject2)
             {
                 uint8 objectTypeId = 0;
-                if (output)
-                {
-                    if (!ReadAndWrite(input, offset, *output, objectTypeId))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
-                else
-                {
-                    if (!ReadLittleEndian(input, offset, objectTypeId))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
-
-                if (objectTypes)
-                    (*objectTypes)[finalGuid] = objectTypeId;
+                if (!ReadUpdateField<Mode>(input, offset, output, objectTypeId))
+                    return fail();
 
-                if (output)
-                {
-                    if (!CopyMovementBlock(input, offset, *output, remap, extracted))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
-                else
-                {
-                    if (!CopyMovementBlock(input, offset, scratchOutput, nullptr, extracted))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
+                if constexpr (Mode::RecordsTypes)
+                    (*objectTypes)[objectGuid] = objectTypeId;
 
-                if (output)
-                {
-                    if (!CopyUpdateMaskAndValues(input, offset, *output, remap, objectTypeId, extracted))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
-                else
-                {
-                    if (!CopyUpdateMaskAndValues(input, offset, scratchOutput, nullptr, objectTypeId, extracted))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
+                parsed = ProcessMovementBlock<Mode>(input, offset, output, remap, extracted) &&
+                    ProcessUpdateMaskAndValues<Mode>(input, offset, output, remap, objectTypeId, extracted);
             }
             else if (updateType == UpdateType::Values)
             {
                 uint8 objectTypeId = 0xFF;
-                if (objectTypes)
+                if constexpr (Mode::RecordsTypes)
                 {
-                    auto typeIt = objectTypes->find(finalGuid);
+                    auto typeIt = objectTypes->find(objectGuid);
                     if (typeIt != objectTypes->end())
                         objectTypeId = typeIt->second;
                 }
 
-                if (output)
-                {
-                    if (!CopyUpdateMaskAndValues(input, offset, *output, remap, objectTypeId, extracted))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
-                else
-                {
-                    if (!CopyUpdateMaskAndValues(input, offset, scratchOutput, nullptr, objectTypeId, extracted))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
+                parsed = ProcessUpdateMaskAndValues<Mode>(input, offset, output, remap, objectTypeId, extracted);
             }
             else if (updateType == UpdateType::Movement)
-            {
-                if (output)
-                {
-                    if (!CopyMovementBlock(input, offset, *output, remap, extracted))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
-                else
-                {
-                    if (!CopyMovementBlock(input, offset, scratchOutput, nullptr, extracted))
-                    {
-                        failureOffset = offset;
-                        return false;
-                    }
-                }
-            }
-            else
-            {
-                failureOffset = offset;
-                return false;
-            }
+                parsed = ProcessMovementBlock<Mode>(input, offset, output, remap, extracted);
+
+            if (!parsed)
+                return fail();
 
             ++stats.parsedBlocks;
         }
 
         stats.bytesConsumed = offset;
         if (offset != input.size())
+            return fail();
+
+        return true;
+    }
+
+    // Replaces the packet contents with the rewritten bytes, reusing the packet
+    // storage since GUID rewrites normally keep the payload length.
+    void StorePacketContents(WorldPacket& packet, std::span<uint8 const> contents)
+    {
+        if (packet.size() == contents.size())
         {
-            failureOffset = offset;
-            return false;
+            if (!contents.empty())
+                std::memcpy(packet.contents(), contents.data(), contents.size());
+            return;
         }
 
-        return true;
+        packet.clear();
+        if (!contents.empty())
+            packet.append(contents.data(), contents.size());
     }
 
     bool RewriteUpdateObjectPacket(WorldPacket& packet, std::unordered_map<uint64, uint64> const& remap,
-        std::unordered_map<uint64, uint8>& objectTypes, UpdateObjectParseStats& stats, size_t& failureOffset)
+        std::unordered_map<uint64, uint8>& objectTypes, UpdateObjectParseStats& stats, size_t& failureOffset, std::vector<uint8>& output)
     {
         size_t packetSize = packet.size();
         if (packetSize == 0)
@@ -926,18 +1216,38 @@ namespace
         if (!contents)
             return false;
 
-        std::vector<uint8> input(contents, contents + packetSize);
-        std::vector<uint8> output;
+        std::span<uint8 const> input(contents, packetSize);
+        output.clear();
         output.reserve(input.size());
 
-        if (!ProcessUpdateObjectPayload(input, &output, &remap, nullptr, &objectTypes, stats, failureOffset))
+        if (!ProcessUpdateObjectPayload<UpdateObjectRewriteMode>(input, &output, &remap, nullptr, &objectTypes, stats, failureOffset))
+            return false;
+
+        StorePacketContents(packet, output);
+        return true;
+    }
+
+    // Rewrites an already inflated SMSG_COMPRESSED_UPDATE_OBJECT payload into rewritten.
+    // The packet is only deflated again when a GUID actually changed.
+    bool RewriteInflatedUpdateObjectPacket(WorldPacket& packet, std::span<uint8 const> payload, std::vector<uint8>& rewritten,
+        std::unordered_map<uint64, uint64> const& remap, std::unordered_map<uint64, uint8>& objectTypes, UpdateObjectParseStats& stats,
+        size_t& failureOffset, bool& deflated)
+    {
+        deflated = false;
+        rewritten.clear();
+        rewritten.reserve(payload.size());
+        if (!ProcessUpdateObjectPayload<UpdateObjectRewriteMode>(payload, &rewritten, &remap, nullptr, &objectTypes, stats, failureOffset))
             return false;
 
-        WorldPacket updated(packet.GetOpcode(), output.size());
-        if (!output.empty())
-            updated.append(output.data(), output.size());
+        if (std::equal(rewritten.begin(), rewritten.end(), payload.begin(), payload.end()))
+            return true;
+
+        std::vector<uint8> recompressed;
+        if (!Compress(rewritten, recompressed))
+            return false;
 
-        packet = std::move(updated);
+        deflated = true;
+        StorePacketContents(packet, recompressed);
         return true;
     }
 
@@ -952,37 +1262,32 @@ namespace
         if (!contents)
             return false;
 
-        std::vector<uint8> input(contents, contents + packetSize);
         std::vector<uint8> decompressed;
-
-        if (!Decompress(input, decompressed))
+        if (!Decompress({ contents, packetSize }, decompressed))
             return false;
 
         std::vector<uint8> rewritten;
-        rewritten.reserve(decompressed.size());
-        if (!ProcessUpdateObjectPayload(decompressed, &rewritten, &remap, nullptr, &objectTypes, stats, failureOffset))
-            return false;
-
-        std::vector<uint8> recompressed;
-        if (!Compress(rewritten, recompressed))
-            return false;
-
-        WorldPacket updated(packet.GetOpcode(), recompressed.size());
-        if (!recompressed.empty())
-            updated.append(recompressed.data(), recompressed.size());
-
-        packet = std::move(updated);
-        return true;
+        bool deflated = false;
+        return RewriteInflatedUpdateObjectPacket(packet, decompressed, rewritten, remap, objectTypes, stats, failureOffset, deflated);
     }
 
-    bool ExtractGuidsFromUpdateObjectPayload(std::vector<uint8> const& input, std::unordered_set<uint64>& guids,
+    bool ExtractGuidsFromUpdateObjectPayload(std::span<uint8 const> input, std::unordered_set<uint64>& guids,
         UpdateObjectParseStats& stats, size_t& failureOffset)
     {
-        return ProcessUpdateObjectPayload(input, nullptr, nullptr, &guids, nullptr, stats, failureOffset);
+        return ProcessUpdateObjectPayload<UpdateObjectExtractMode>(input, nullptr, nullptr, &guids, nullptr, stats, failureOffset);
+    }
+
+    // the object types a rewrite of input would record, without rewriting it
+    bool RecordUpdateObjectTypes(std::span<uint8 const> input, std::unordered_map<uint64, uint64> const& remap,
+        std::unordered_map<uint64, uint8>& objectTypes)
+    {
+        UpdateObjectParseStats stats;
+        size_t failureOffset = 0;
+        return ProcessUpdateObjectPayload<UpdateObjectTypesMode>(input, nullptr, &remap, nullptr, &objectTypes, stats, failureOffset);
     }
 
     bool ExtractGuidsFromPacket(WorldPacket const& packet, std::unordered_set<uint64>& guids, UpdateObjectParseStats& stats,
-        size_t& failureOffset)
+        size_t& failureOffset, std::vector<uint8>* inflatedPayload = nullptr)
     {
         size_t packetSize = packet.size();
         if (packetSize == 0)
@@ -992,14 +1297,18 @@ namespace
         if (!contents)
             return true;
 
-        std::vector<uint8> buffer(contents, contents + packetSize);
+        std::span<uint8 const> buffer(contents, packetSize);
         if (packet.GetOpcode() == SMSG_COMPRESSED_UPDATE_OBJECT)
         {
             std::vector<uint8> decompressed;
             if (!Decompress(buffer, decompressed))
                 return false;
 
-            return ExtractGuidsFromUpdateObjectPayload(decompressed, guids, stats, failureOffset);
+            bool extracted = ExtractGuidsFromUpdateObjectPayload(decompressed, guids, stats, failureOffset);
+            if (inflatedPayload)
+                *inflatedPayload = std::move(decompressed);
+
+            return extracted;
         }
 
         if (packet.GetOpcode() == SMSG_UPDATE_OBJECT)
@@ -1009,8 +1318,7 @@ namespace
         {
             size_t offset = 0;
             uint64 guid = 0;
-            std::vector<uint8> packed;
-            if (ReadPackedGuid(buffer, offset, guid, &packed))
+            if (ReadPackedGuid(buffer, offset, guid, nullptr))
             {
                 if (guid != 0)
                     guids.insert(guid);
@@ -1033,7 +1341,7 @@ namespace
     }
 
     template <typename T>
-    bool ReadLittleEndian(std::vector<uint8> const& data, size_t& offset, T& value)
+    bool ReadLittleEndian(std::span<uint8 const> data, size_t& offset, T& value)
     {
         if (offset + sizeof(T) > data.size())
             return false;
@@ -1079,7 +1387,7 @@ namespace
         MultipacketLengthField lengthField;
     };
 
-    bool ReadMultipacketLength(std::vector<uint8> const& data, size_t& offset, MultipacketLengthField lengthField, uint32& length)
+    bool ReadMultipacketLength(std::span<uint8 const> data, size_t& offset, MultipacketLengthField lengthField, uint32& length)
     {
         if (lengthField == MultipacketLengthField::Length16)
         {
@@ -1099,7 +1407,7 @@ namespace
         return true;
     }
 
-    bool TryParseMultipacketPayload(std::vector<uint8> const& payload, MultipacketLayout layout, std::vector<WorldPacket>& embeddedPackets)
+    bool TryParseMultipacketPayload(std::span<uint8 const> payload, MultipacketLayout layout, std::vector<WorldPacket>& embeddedPackets)
     {
         size_t offset = 0;
         uint32 declaredCount = 0;
@@ -1211,7 +1519,8 @@ namespace
         return true;
     }
 
-    bool MultipacketPayloadContainsGuid(std::vector<uint8> const& payload, uint64 guid)
+    bool ScanMultipacketEmbeddedPayloads(std::span<uint8 const> payload, GuidPatternMatcher const& matcher,
+        std::vector<GuidPatternHit>* hits)
     {
         std::array<MultipacketCountField, 3> countFields = {
             MultipacketCountField::None,
@@ -1227,6 +1536,9 @@ namespace
             MultipacketLengthField::Length32
         };
 
+        // Uncompressed embedded packets are covered by the raw scan of the whole
+        // payload, so only compressed update objects need to be inflated here.
+        bool found = false;
         for (MultipacketCountField countField : countFields)
         {
             for (MultipacketHeaderOrder headerOrder : headerOrders)
@@ -1240,14 +1552,25 @@ namespace
 
                     for (WorldPacket const& embedded : embeddedPackets)
                     {
-                        if (PacketContainsGuid(embedded, guid))
-                            return true;
+                        if (embedded.GetOpcode() != SMSG_COMPRESSED_UPDATE_OBJECT || embedded.size() == 0)
+                            continue;
+
+                        std::vector<uint8> decompressed;
+                        if (!Decompress({ embedded.contents(), embedded.size() }, decompressed))
+                            continue;
+
+                        if (matcher.Scan(decompressed, false, hits))
+                        {
+                            if (!hits)
+                                return true;
+                            found = true;
+                        }
                     }
                 }
             }
         }
 
-        return false;
+        return found;
     }
 
     bool RewriteMultipacketPacket(WorldPacket& packet, uint64 fromGuid, uint64 toGuid, std::unordered_map<uint64, uint8>* objectTypes)
@@ -1310,7 +1633,81 @@ namespace
         return false;
     }
 
-    bool Decompress(std::vector<uint8> const& input, std::vector<uint8>& output)
+    struct ZlibStream
+    {
+        z_stream stream;
+        bool initialized = false;
+        bool deflating = false;
+
+        ZlibStream() { std::memset(&stream, 0, sizeof(stream)); }
+        ~ZlibStream()
+        {
+            if (!initialized)
+                return;
+
+            if (deflating)
+                deflateEnd(&stream);
+            else
+                inflateEnd(&stream);
+        }
+    };
+
+#ifdef ARENA_REPLAY_LIBDEFLATE
+    struct LibdeflateDeleter
+    {
+        void operator()(libdeflate_compressor* compressor) const { libdeflate_free_compressor(compressor); }
+        void operator()(libdeflate_decompressor* decompressor) const { libdeflate_free_decompressor(decompressor); }
+    };
+
+    libdeflate_compressor* GetThreadCompressor()
+    {
+        static thread_local std::unique_ptr<libdeflate_compressor, LibdeflateDeleter> compressor(libdeflate_alloc_compressor(Z_BEST_SPEED));
+        return compressor.get();
+    }
+
+    libdeflate_decompressor* GetThreadDecompressor()
+    {
+        static thread_local std::unique_ptr<libdeflate_decompressor, LibdeflateDeleter> decompressor(libdeflate_alloc_decompressor());
+        return decompressor.get();
+    }
+#else
+    // zlib state is about 256 KB per deflate stream, so each thread keeps one
+    // inflate and one deflate stream alive and resets them between packets.
+    z_stream* GetThreadInflateStream()
+    {
+        static thread_local ZlibStream inflater;
+        if (!inflater.initialized)
+        {
+            if (inflateInit(&inflater.stream) != Z_OK)
+                return nullptr;
+
+            inflater.initialized = true;
+        }
+        else if (inflateReset(&inflater.stream) != Z_OK)
+            return nullptr;
+
+        return &inflater.stream;
+    }
+
+    z_stream* GetThreadDeflateStream()
+    {
+        static thread_local ZlibStream deflater;
+        if (!deflater.initialized)
+        {
+            if (deflateInit(&deflater.stream, Z_BEST_SPEED) != Z_OK)
+                return nullptr;
+
+            deflater.initialized = true;
+            deflater.deflating = true;
+        }
+        else if (deflateReset(&deflater.stream) != Z_OK)
+            return nullptr;
+
+        return &deflater.stream;
+    }
+#endif
+
+    bool Decompress(std::span<uint8 const> input, std::vector<uint8>& output)
     {
         if (input.size() <= sizeof(uint32))
             return false;
@@ -1322,24 +1719,34 @@ namespace
 
         output.resize(decompressedSize);
 
-        z_stream stream;
-        std::memset(&stream, 0, sizeof(stream));
-        stream.next_in = const_cast<Bytef*>(reinterpret_cast<Bytef const*>(input.data() + sizeof(uint32)));
-        stream.avail_in = static_cast<uInt>(input.size() - sizeof(uint32));
-        stream.next_out = output.data();
-        stream.avail_out = static_cast<uInt>(output.size());
+#ifdef ARENA_REPLAY_LIBDEFLATE
+        libdeflate_decompressor* decompressor = GetThreadDecompressor();
+        if (!decompressor)
+            return false;
+
+        size_t actualSize = 0;
+        if (libdeflate_zlib_decompress(decompressor, input.data() + sizeof(uint32), input.size() - sizeof(uint32),
+            output.data(), output.size(), &actualSize) != LIBDEFLATE_SUCCESS)
+            return false;
 
-        int ret = inflateInit(&stream);
-        if (ret != Z_OK)
+        output.resize(actualSize);
+        return true;
+#else
+        z_stream* stream = GetThreadInflateStream();
+        if (!stream)
             return false;
 
-        ret = inflate(&stream, Z_FINISH);
-        inflateEnd(&stream);
-        if (ret != Z_STREAM_END)
+        stream->next_in = const_cast<Bytef*>(reinterpret_cast<Bytef const*>(input.data() + sizeof(uint32)));
+        stream->avail_in = static_cast<uInt>(input.size() - sizeof(uint32));
+        stream->next_out = output.data();
+        stream->avail_out = static_cast<uInt>(output.size());
+
+        if (inflate(stream, Z_FINISH) != Z_STREAM_END)
             return false;
 
-        output.resize(stream.total_out);
+        output.resize(stream->total_out);
         return true;
+#endif
     }
 
     uint64 SplitMix64(uint64 value)
@@ -1402,88 +1809,83 @@ namespace
         return candidate;
     }
 
-    bool ContainsGuidSequences(std::vector<uint8> const& payload, uint64 guid, bool allowRaw)
-    {
-        if (payload.empty() || guid == 0)
-            return false;
-
-        auto bytesArray = GetGuidBytes(guid);
-        std::vector<uint8> raw(bytesArray.begin(), bytesArray.end());
-        std::vector<uint8> packed = GetPackedGuidBytes(guid);
-
-        if (allowRaw && ContainsSequence(payload, raw))
-            return true;
-
-        if (!packed.empty() && ContainsSequence(payload, packed))
-            return true;
-
-        return false;
-    }
-
-    bool ReplaceGuidSequences(std::vector<uint8>& payload, uint64 fromGuid, uint64 toGuid, bool allowRaw)
+    bool ReplaceGuidSequences(std::span<uint8> payload, uint64 fromGuid, uint64 toGuid, bool allowRaw)
     {
         if (payload.empty())
             return false;
 
-        auto fromBytesArray = GetGuidBytes(fromGuid);
-        auto toBytesArray = GetGuidBytes(toGuid);
-        std::vector<uint8> fromBytes(fromBytesArray.begin(), fromBytesArray.end());
-        std::vector<uint8> toBytes(toBytesArray.begin(), toBytesArray.end());
-        std::vector<uint8> fromPacked = GetPackedGuidBytes(fromGuid);
-        std::vector<uint8> toPacked = GetPackedGuidBytes(toGuid);
+        std::array<uint8, 8> fromBytes = GetGuidBytes(fromGuid);
+        std::array<uint8, 8> toBytes = GetGuidBytes(toGuid);
+        PackedGuidBytes fromPacked = GetPackedGuidBytes(fromGuid);
+        PackedGuidBytes toPacked = GetPackedGuidBytes(toGuid);
 
         bool modified = false;
         if (allowRaw)
             modified |= ReplaceSequence(payload, fromBytes, toBytes);
 
-        if (!fromPacked.empty() && !toPacked.empty())
+        if (!fromPacked.Empty() && !toPacked.Empty())
         {
-            if (fromPacked.size() == toPacked.size() && fromPacked.front() == toPacked.front())
+            if (fromPacked.size == toPacked.size && fromPacked.Mask() == toPacked.Mask())
             {
-                modified |= ReplaceSequence(payload, fromPacked, toPacked);
+                modified |= ReplaceSequence(payload, fromPacked.View(), toPacked.View());
             }
             else
             {
                 LOG_WARN("modules", "ArenaReplay: packed GUID shape mismatch (from mask {:02X} size {}, to mask {:02X} size {}), skipping packed replacement",
-                    fromPacked.front(),
-                    fromPacked.size(),
-                    toPacked.front(),
-                    toPacked.size());
+                    fromPacked.Mask(),
+                    fromPacked.size,
+                    toPacked.Mask(),
+                    toPacked.size);
             }
         }
 
         return modified;
     }
 
-    bool Compress(std::vector<uint8> const& input, std::vector<uint8>& output)
+    bool Compress(std::span<uint8 const> input, std::vector<uint8>& output)
     {
         if (input.empty())
             return false;
 
         uint32 uncompressedSize = static_cast<uint32>(input.size());
+
+#ifdef ARENA_REPLAY_LIBDEFLATE
+        libdeflate_compressor* compressor = GetThreadCompressor();
+        if (!compressor)
+            return false;
+
+        size_t maxCompressedSize = libdeflate_zlib_compress_bound(compressor, input.size());
+        output.resize(sizeof(uint32) + maxCompressedSize);
+        std::memcpy(output.data(), &uncompressedSize, sizeof(uint32));
+
+        size_t compressedSize = libdeflate_zlib_compress(compressor, input.data(), input.size(),
+            output.data() + sizeof(uint32), maxCompressedSize);
+        if (compressedSize == 0)
+            return false;
+
+        output.resize(sizeof(uint32) + compressedSize);
+        return true;
+#else
         uLongf maxCompressedSize = compressBound(uncompressedSize);
         output.resize(sizeof(uint32) + maxCompressedSize);
 
         std::memcpy(output.data(), &uncompressedSize, sizeof(uint32));
 
-        z_stream stream;
-        std::memset(&stream, 0, sizeof(stream));
-        stream.next_in = const_cast<Bytef*>(reinterpret_cast<Bytef const*>(input.data()));
-        stream.avail_in = static_cast<uInt>(input.size());
-        stream.next_out = output.data() + sizeof(uint32);
-        stream.avail_out = static_cast<uInt>(maxCompressedSize);
-
-        int ret = deflateInit(&stream, Z_BEST_SPEED);
-        if (ret != Z_OK)
+        z_stream* stream = GetThreadDeflateStream();
+        if (!stream)
             return false;
 
-        ret = deflate(&stream, Z_FINISH);
-        deflateEnd(&stream);
-        if (ret != Z_STREAM_END)
+        stream->next_in = const_cast<Bytef*>(reinterpret_cast<Bytef const*>(input.data()));
+        stream->avail_in = static_cast<uInt>(input.size());
+        stream->next_out = output.data() + sizeof(uint32);
+        stream->avail_out = static_cast<uInt>(maxCompressedSize);
+
+        if (deflate(stream, Z_FINISH) != Z_STREAM_END)
             return false;
 
-        output.resize(sizeof(uint32) + stream.total_out);
+        output.resize(sizeof(uint32) + stream->total_out);
         return true;
+#endif
     }
 
     bool RewriteCompressedPacket(WorldPacket& packet, uint64 fromGuid, uint64 toGuid)
@@ -1496,10 +1898,8 @@ namespace
         if (!contents)
             return false;
 
-        std::vector<uint8> buffer(contents, contents + packetSize);
         std::vector<uint8> decompressed;
-
-        if (!Decompress(buffer, decompressed))
+        if (!Decompress({ contents, packetSize }, decompressed))
             return false;
 
         if (!ReplaceGuidSequences(decompressed, fromGuid, toGuid, false))
@@ -1509,11 +1909,7 @@ namespace
         if (!Compress(decompressed, recompressed))
             return false;
 
-        WorldPacket updated(SMSG_COMPRESSED_UPDATE_OBJECT, recompressed.size());
-        if (!recompressed.empty())
-            updated.append(recompressed.data(), recompressed.size());
-
-        packet = std::move(updated);
+        StorePacketContents(packet, recompressed);
         return true;
     }
 
@@ -1523,24 +1919,19 @@ namespace
         if (packetSize == 0)
             return false;
 
-        uint8 const* contents = packet.contents();
+        uint8* contents = packet.contents();
         if (!contents)
             return false;
 
-        std::vector<uint8> buffer(contents, contents + packetSize);
         bool allowRaw = packet.GetOpcode() != SMSG_UPDATE_OBJECT;
-        if (!ReplaceGuidSequences(buffer, fromGuid, toGuid, allowRaw))
-            return false;
-
-        WorldPacket updated(packet.GetOpcode(), buffer.size());
-        updated.append(buffer.data(), buffer.size());
-        packet = std::move(updated);
-        return true;
+        return ReplaceGuidSequences({ contents, packetSize }, fromGuid, toGuid, allowRaw);
     }
 
-    bool PacketContainsGuid(WorldPacket const& packet, uint64 guid)
+    // Scans a packet for any GUID known to the matcher. Compressed update objects
+    // are inflated first, so hit offsets refer to the decompressed payload.
+    bool ScanPacketForGuids(WorldPacket const& packet, GuidPatternMatcher const& matcher, std::vector<GuidPatternHit>* hits)
     {
-        if (guid == 0)
+        if (matcher.Empty())
             return false;
 
         size_t packetSize = packet.size();
@@ -1551,47 +1942,31 @@ namespace
         if (!contents)
             return false;
 
-        std::vector<uint8> buffer(contents, contents + packetSize);
-
         if (packet.GetOpcode() == SMSG_COMPRESSED_UPDATE_OBJECT)
         {
             std::vector<uint8> decompressed;
-            if (!Decompress(buffer, decompressed))
+            if (!Decompress({ contents, packetSize }, decompressed))
             {
-                LOG_WARN("modules", "ArenaReplay: failed to decompress SMSG_COMPRESSED_UPDATE_OBJECT while searching for guid {}", guid);
+                LOG_WARN("modules", "ArenaReplay: failed to decompress SMSG_COMPRESSED_UPDATE_OBJECT while scanning for original GUIDs");
                 return false;
             }
 
-            return ContainsGuidSequences(decompressed, guid, false);
+            return matcher.Scan(decompressed, false, hits);
         }
 
         if (packet.GetOpcode() == SMSG_UPDATE_OBJECT)
-            return ContainsGuidSequences(buffer, guid, false);
+            return matcher.Scan(contents, packetSize, false, hits);
 
         if (packet.GetOpcode() == SMSG_MULTIPLE_PACKETS)
         {
-            if (MultipacketPayloadContainsGuid(buffer, guid))
+            bool found = ScanMultipacketEmbeddedPayloads({ contents, packetSize }, matcher, hits);
+            if (found && !hits)
                 return true;
 
-            return ContainsGuidSequences(buffer, guid, true);
-        }
-
-        return ContainsGuidSequences(buffer, guid, true);
-    }
-
-    bool PacketContainsAnyOriginalGuid(WorldPacket const& packet, std::unordered_map<uint64, uint64> const& guidRemap)
-    {
-        for (auto const& entry : guidRemap)
-        {
-            uint64 original = entry.first;
-            if (original == 0)
-                continue;
-
-            if (PacketContainsGuid(packet, original))
-                return true;
+            return matcher.Scan(contents, packetSize, true, hits) || found;
         }
 
-        return false;
+        return matcher.Scan(contents, packetSize, true, hits);
     }
 
     bool ReplaceGuidInPacket(WorldPacket& packet, uint64 fromGuid, uint64 toGuid, std::unordered_map<uint64, uint8>* objectTypes)
@@ -1613,198 +1988,3144 @@ namespace
             UpdateObjectParseStats stats;
             size_t failureOffset = 0;
             if (packet.GetOpcode() == SMSG_UPDATE_OBJECT)
-                return RewriteUpdateObjectPacket(packet, remap, typesRef, stats, failureOffset);
+            {
+                std::vector<uint8> output;
+                return RewriteUpdateObjectPacket(packet, remap, typesRef, stats, failureOffset, output);
+            }
             return RewriteCompressedUpdateObjectPacket(packet, remap, typesRef, stats, failureOffset);
         }
 
         return RewriteRawPacket(packet, fromGuid, toGuid);
     }
 
-    std::unordered_set<uint64> BuildUsedGuidSet(MatchRecord& record)
+    void AppendPlayerGuidsFromList(std::vector<uint64>& guids, std::string const& guidList)
     {
-        std::unordered_set<uint64> used;
-        used.insert(record.participantGuids.begin(), record.participantGuids.end());
-        for (PacketRecord const& packet : record.packets)
-            used.insert(packet.sourceGuid);
+        if (guidList.empty())
+            return;
 
-        for (PacketRecord const& packet : record.packets)
+        std::stringstream ss(guidList);
+        std::string entry;
+        while (std::getline(ss, entry, ','))
         {
-            UpdateObjectParseStats stats;
-            size_t failureOffset = 0;
-            if (!ExtractGuidsFromPacket(packet.packet, used, stats, failureOffset))
-            {
-                if (!record.updateObjectParseWarningLogged)
-                {
-                    LOG_WARN("modules", "ArenaReplay: failed to parse update object payload while extracting GUIDs for replay {} opcode {} packetSize {} offset {}",
-                        record.replayId,
-                        packet.packet.GetOpcode(),
-                        packet.packet.size(),
-                        failureOffset);
-                    record.updateObjectParseWarningLogged = true;
-                }
-            }
-        }
+            auto begin = entry.find_first_not_of(" \t\n\r");
+            if (begin == std::string::npos)
+                continue;
 
-        return used;
-    }
+            auto end = entry.find_last_not_of(" \t\n\r");
+            if (end == std::string::npos)
+                continue;
 
-    void RemapReplayGuids(MatchRecord& record)
+            std::string trimmed = entry.substr(begin, end - begin + 1);
+            if (trimmed.empty())
+                continue;
+
+            try
+            {
+                guids.push_back(std::stoull(trimmed));
+            }
+            catch (...)
+            {
+                continue;
+            }
+        }
+    }
+
+    // Appends packet to the recording when its opcode is on the watch list.
+    bool RecordReplayPacket(MatchRecord& record, WorldPacket const& packet, uint32 timestamp, uint64 sourceGuid)
+    {
+        if (std::find(watchList.begin(), watchList.end(), packet.GetOpcode()) == watchList.end())
+            return false;
+
+        record.packets.push_back({ timestamp, /* copy */ WorldPacket(packet), sourceGuid });
+        return true;
+    }
+
+    size_t PacketFootprint(PacketRecord const& packet)
+    {
+        return sizeof(PacketRecord) + packet.packet.size() + packet.inflated.capacity();
+    }
+
+    // Heap footprint of a recording, not counting allocator overhead.
+    size_t EstimateMatchRecordMemory(MatchRecord const& record)
+    {
+        size_t bytes = sizeof(MatchRecord) + record.participantGuids.capacity() * sizeof(uint64);
+        for (PacketRecord const& packet : record.packets)
+            bytes += PacketFootprint(packet);
+
+        return bytes;
+    }
+
+    void EraseRecording(std::unordered_map<uint32, MatchRecord>::iterator it)
+    {
+        sArenaReplayMetrics.activeRecordings.Add(-1);
+        records.erase(it);
+    }
+
+    void DiscardRecording(uint32 instanceId)
+    {
+        auto it = records.find(instanceId);
+        if (it != records.end())
+            EraseRecording(it);
+    }
+
+    // Activity counter used to skip the periodic metrics log when idle.
+    uint64 GetArenaReplayActivity()
+    {
+        ArenaReplayMetrics const& metrics = sArenaReplayMetrics;
+        uint64 recordedPackets = 0;
+        uint64 recordedBytes = 0;
+        metrics.recorded.Totals(recordedPackets, recordedBytes);
+        return recordedPackets + metrics.save.Count() + metrics.loadQuery.Count() + metrics.sentPackets.Get();
+    }
+
+    std::string FormatArenaReplayMetrics()
+    {
+        ArenaReplayMetrics const& metrics = sArenaReplayMetrics;
+        uint64 recordedPackets = 0;
+        uint64 recordedBytes = 0;
+        metrics.recorded.Totals(recordedPackets, recordedBytes);
+
+        // world thread only, like every other access to records
+        uint64 recordingMemory = 0;
+        for (auto const& [instanceId, record] : records)
+            recordingMemory += EstimateMatchRecordMemory(record);
+
+        uint64 ticks = metrics.playbackTicks.Get();
+        uint64 compressed = metrics.compressedUpdatePackets.Get();
+        return Acore::StringFormat("recordings {} ({} KB), recorded {} packets ({} KB), "
+            "saves {} (avg {:.2f} ms, max {:.2f} ms), loads {} (+{} shared, avg db {:.2f} ms, decode {:.2f} ms, remap {:.2f} ms, first chunk {:.2f} ms), "
+            "sent {} packets ({} KB) over {} ticks (avg {:.1f}, max {} per tick), "
+            "{} update packets merged, {} ticks held back by the send budget, {} waiting on the loader, "
+            "inflate {} deflate {}, inflated payload reuse {:.1f}%",
+            metrics.activeRecordings.Get(),
+            recordingMemory / 1024,
+            recordedPackets,
+            recordedBytes / 1024,
+            metrics.save.Count(),
+            metrics.save.AverageMilliseconds(),
+            metrics.save.MaxMilliseconds(),
+            metrics.loadQuery.Count(),
+            metrics.sharedLoads.Get(),
+            metrics.loadQuery.AverageMilliseconds(),
+            metrics.loadDecode.AverageMilliseconds(),
+            metrics.loadRemap.AverageMilliseconds(),
+            metrics.loadFirstChunk.AverageMilliseconds(),
+            metrics.sentPackets.Get(),
+            metrics.sentBytes.Get() / 1024,
+            ticks,
+            ticks ? double(metrics.sentPackets.Get()) / ticks : 0.0,
+            metrics.maxPacketsPerTick.Get(),
+            metrics.mergedUpdatePackets.Get(),
+            metrics.budgetLimitedTicks.Get(),
+            metrics.loaderWaitTicks.Get(),
+            metrics.inflateCalls.Get(),
+            metrics.deflateCalls.Get(),
+            compressed ? 100.0 * metrics.inflatedPayloadReuses.Get() / compressed : 0.0);
+    }
+
+    std::string FormatArenaReplayLatency(char const* name, ArenaReplayLatency const& latency)
+    {
+        return Acore::StringFormat("  {:<16} {:>9} samples  p50 {:>9.3f} ms  p99 {:>9.3f} ms  max {:>9.3f} ms",
+            name,
+            latency.Count(),
+            latency.PercentileMilliseconds(0.50),
+            latency.PercentileMilliseconds(0.99),
+            latency.MaxMilliseconds());
+    }
+
+    // Chrome trace event format, loadable in chrome://tracing or Perfetto.
+    bool WriteArenaReplayTrace(std::string const& path, size_t& spanCount)
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file)
+            return false;
+
+        std::vector<ArenaReplayTrace::Span> spans = sArenaReplayTrace.Snapshot();
+        spanCount = spans.size();
+
+        file << "{\"traceEvents\":[";
+        for (size_t i = 0; i < spans.size(); ++i)
+        {
+            ArenaReplayTrace::Span const& span = spans[i];
+            file << (i ? ",\n" : "\n")
+                << "{\"name\":\"" << span.name << "\",\"cat\":\"arena_replay\",\"ph\":\"X\""
+                << ",\"ts\":" << span.startMicroseconds
+                << ",\"dur\":" << span.durationMicroseconds
+                << ",\"pid\":1,\"tid\":" << (span.thread & 0x7FFFFFFF)
+                << ",\"args\":{\"id\":" << span.id << "}}";
+        }
+        file << "\n]}\n";
+
+        return static_cast<bool>(file);
+    }
+
+    // A plain SMSG_UPDATE_OBJECT is a block count, a transport flag and the
+    // blocks. Adjacent due packets with the same flag can go out as one packet
+    // by adding up the counts and concatenating the blocks.
+    constexpr size_t UPDATE_OBJECT_HEADER_SIZE = 5;
+    constexpr size_t MERGED_UPDATE_OBJECT_MAX_SIZE = 16 * 1024;
+
+    bool IsMergeableUpdateObject(PacketRecord const& packetRecord)
+    {
+        return !packetRecord.drop && packetRecord.packet.GetOpcode() == SMSG_UPDATE_OBJECT &&
+            packetRecord.packet.size() > UPDATE_OBJECT_HEADER_SIZE;
+    }
+
+    // Returns how many packets starting at `first` can be sent as one
+    // update object; 1 when the front packet is not mergeable. A packet that
+    // starts with an out-of-range block only ever heads a merge, so the
+    // destroy list keeps coming first in its packet.
+    size_t CountMergeableUpdateObjects(std::deque<PacketRecord> const& packets, size_t first, uint32 startTime, uint64 skippedSourceGuid, size_t maxCount)
+    {
+        PacketRecord const& firstRecord = packets[first];
+        if (!IsMergeableUpdateObject(firstRecord))
+            return 1;
+
+        uint8 transportFlag = firstRecord.packet.contents()[UPDATE_OBJECT_HEADER_SIZE - 1];
+        size_t mergedSize = firstRecord.packet.size();
+        size_t count = 1;
+        while (first + count < packets.size() && count < maxCount)
+        {
+            PacketRecord const& next = packets[first + count];
+            if (next.timestamp > startTime || !IsMergeableUpdateObject(next))
+                break;
+
+            if (skippedSourceGuid && next.sourceGuid == skippedSourceGuid)
+                break;
+
+            uint8 const* contents = next.packet.contents();
+            if (contents[UPDATE_OBJECT_HEADER_SIZE - 1] != transportFlag ||
+                contents[UPDATE_OBJECT_HEADER_SIZE] == static_cast<uint8>(UpdateType::OutOfRange))
+                break;
+
+            mergedSize += next.packet.size() - UPDATE_OBJECT_HEADER_SIZE;
+            if (mergedSize > MERGED_UPDATE_OBJECT_MAX_SIZE)
+                break;
+
+            ++count;
+        }
+
+        return count;
+    }
+
+    void MergeUpdateObjects(std::deque<PacketRecord> const& packets, size_t first, size_t count, WorldPacket& merged)
+    {
+        uint32 blockCount = 0;
+        size_t mergedSize = UPDATE_OBJECT_HEADER_SIZE;
+        for (size_t i = first; i < first + count; ++i)
+        {
+            WorldPacket const& packet = packets[i].packet;
+            size_t offset = 0;
+            uint32 packetBlocks = 0;
+            ReadLittleEndian(std::span<uint8 const>(packet.contents(), packet.size()), offset, packetBlocks);
+            blockCount += packetBlocks;
+            mergedSize += packet.size() - UPDATE_OBJECT_HEADER_SIZE;
+        }
+
+        merged.Initialize(SMSG_UPDATE_OBJECT, mergedSize);
+        merged << uint32(blockCount);
+        merged << uint8(packets[first].packet.contents()[UPDATE_OBJECT_HEADER_SIZE - 1]);
+        for (size_t i = first; i < first + count; ++i)
+        {
+            WorldPacket const& packet = packets[i].packet;
+            merged.append(packet.contents() + UPDATE_OBJECT_HEADER_SIZE, packet.size() - UPDATE_OBJECT_HEADER_SIZE);
+        }
+    }
+
+    void SerializeReplayPackets(std::deque<PacketRecord> const& packets, ByteBuffer& buffer)
+    {
+        for (auto const& packetRecord : packets)
+        {
+            uint32 headerSize = packetRecord.packet.size(); //header 4Bytes packet size
+            uint32 timestamp = packetRecord.timestamp;
+
+            const bool hasSourceGuid = packetRecord.sourceGuid != 0;
+            uint32 sizeWithFlag = headerSize;
+            if (hasSourceGuid)
+                sizeWithFlag |= 0x80000000u;
+
+            buffer << sizeWithFlag; // 4 bytes
+            buffer << timestamp; // 4 bytes
+            buffer << packetRecord.packet.GetOpcode(); // 2 bytes
+
+            if (hasSourceGuid)
+                buffer << packetRecord.sourceGuid; // 8 bytes
+
+            if (headerSize > 0)
+                buffer.append(packetRecord.packet.contents(), packetRecord.packet.size()); // headerSize bytes
+        }
+    }
+
+    // Appends every whole packet at the start of data and returns the bytes
+    // they took; a packet cut off by the end of data is left for the caller.
+    size_t ReadReplayPackets(std::span<uint8 const> data, std::deque<PacketRecord>& packets)
+    {
+        size_t consumed = 0;
+        while (consumed < data.size())
+        {
+            size_t offset = consumed;
+            uint32 packedPacketSize = 0;
+            uint32 packetTimestamp = 0;
+            uint16 opcode = 0;
+            if (!ReadLittleEndian(data, offset, packedPacketSize))
+                break;
+
+            bool hasSourceGuid = (packedPacketSize & 0x80000000u) != 0;
+            uint32 packetSize = packedPacketSize & 0x7FFFFFFFu;
+
+            if (!ReadLittleEndian(data, offset, packetTimestamp) || !ReadLittleEndian(data, offset, opcode))
+                break;
+
+            uint64 sourceGuid = 0;
+            if (hasSourceGuid && !ReadLittleEndian(data, offset, sourceGuid))
+                break;
+
+            if (data.size() - offset < packetSize)
+                break;
+
+            WorldPacket packet(opcode, packetSize);
+            if (packetSize > 0)
+                packet.append(data.data() + offset, packetSize);
+
+            consumed = offset + packetSize;
+            packets.push_back({ packetTimestamp, std::move(packet), sourceGuid });
+        }
+
+        return consumed;
+    }
+
+    // Layout of the `contents` column once Base32-decoded. Legacy rows hold the
+    // serialized packets directly. Container rows start with "ARP" and a
+    // format byte followed by the codec output; zstd rows put the uint32 id of
+    // their dictionary (0 for none) before the frame. A legacy row starts with
+    // the size word of its first packet, whose low three bytes only spell the
+    // magic for a 0x505241 byte (5 MB) packet; EncodeReplayContents stores
+    // such a replay as zlib rather than as an ambiguous legacy row.
+    enum class ReplayStorageFormat : uint8
+    {
+        Legacy = 0,
+        Zlib = 1,
+        Zstd = 2
+    };
+
+    constexpr std::array<uint8, 3> REPLAY_CONTAINER_MAGIC = { 'A', 'R', 'P' };
+    constexpr size_t REPLAY_CONTAINER_HEADER_SIZE = REPLAY_CONTAINER_MAGIC.size() + 1;
+
+    char const* GetReplayStorageFormatName(ReplayStorageFormat format)
+    {
+        switch (format)
+        {
+            case ReplayStorageFormat::Legacy:
+                return "legacy";
+            case ReplayStorageFormat::Zlib:
+                return "zlib";
+            case ReplayStorageFormat::Zstd:
+                return "zstd";
+        }
+
+        return "unknown";
+    }
+
+    bool IsReplayStorageFormatSupported(ReplayStorageFormat format)
+    {
+#ifdef ARENA_REPLAY_ZSTD
+        return format <= ReplayStorageFormat::Zstd;
+#else
+        return format <= ReplayStorageFormat::Zlib;
+#endif
+    }
+
+#ifdef ARENA_REPLAY_ZSTD
+    constexpr int REPLAY_ZSTD_LEVEL = 6;
+
+    struct ZstdDeleter
+    {
+        void operator()(ZSTD_CCtx* context) const { ZSTD_freeCCtx(context); }
+        void operator()(ZSTD_DCtx* context) const { ZSTD_freeDCtx(context); }
+    };
+
+    // Dictionaries trained on stored replays by .replay dict train. Each arena
+    // map has one current dictionary used for new saves; older ones stay
+    // loaded so the replays compressed with them still decode.
+    class ReplayDictionaryStore
+    {
+    public:
+        struct Dictionary
+        {
+            Dictionary(uint32 dictionaryId, uint32 dictionaryMapId, std::vector<uint8> dictionaryData)
+                : id(dictionaryId), mapId(dictionaryMapId), data(std::move(dictionaryData)),
+                compression(ZSTD_createCDict(data.data(), data.size(), REPLAY_ZSTD_LEVEL)),
+                decompression(ZSTD_createDDict(data.data(), data.size())) { }
+
+            ~Dictionary()
+            {
+                ZSTD_freeCDict(compression);
+                ZSTD_freeDDict(decompression);
+            }
+
+            Dictionary(Dictionary const&) = delete;
+            Dictionary& operator=(Dictionary const&) = delete;
+
+            uint32 id;
+            uint32 mapId;
+            std::vector<uint8> data;
+            ZSTD_CDict* compression;
+            ZSTD_DDict* decompression;
+        };
+
+        static ReplayDictionaryStore& Instance()
+        {
+            static ReplayDictionaryStore instance;
+            return instance;
+        }
+
+        void Load()
+        {
+            uint32 count = 0;
+            if (QueryResult result = CharacterDatabase.Query("SELECT id, mapId, dictionary FROM character_arena_replay_dictionaries ORDER BY id"))
+            {
+                do
+                {
+                    Field* fields = result->Fetch();
+                    auto data = Acore::Encoding::Base32::Decode(fields[2].Get<std::string>());
+                    if (!data || !Add(fields[0].Get<uint32>(), fields[1].Get<uint32>(), std::move(*data)))
+                    {
+                        LOG_ERROR("modules", "ArenaReplay: dictionary {} could not be loaded", fields[0].Get<uint32>());
+                        continue;
+                    }
+
+                    ++count;
+                } while (result->NextRow());
+            }
+
+            LOG_INFO("modules", "ArenaReplay: loaded {} replay compression dictionaries", count);
+        }
+
+        // the newest dictionary of a map becomes its current one
+        bool Add(uint32 id, uint32 mapId, std::vector<uint8> data)
+        {
+            auto dictionary = std::make_shared<Dictionary const>(id, mapId, std::move(data));
+            if (!dictionary->compression || !dictionary->decompression)
+                return false;
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _byId[id] = dictionary;
+            std::shared_ptr<Dictionary const>& current = _byMap[mapId];
+            if (!current || current->id < id)
+                current = dictionary;
+
+            return true;
+        }
+
+        std::shared_ptr<Dictionary const> ForMap(uint32 mapId) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _byMap.find(mapId);
+            return it != _byMap.end() ? it->second : nullptr;
+        }
+
+        std::shared_ptr<Dictionary const> ById(uint32 id) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _byId.find(id);
+            return it != _byId.end() ? it->second : nullptr;
+        }
+
+    private:
+        mutable std::mutex _mutex;
+        std::unordered_map<uint32, std::shared_ptr<Dictionary const>> _byId;
+        std::unordered_map<uint32, std::shared_ptr<Dictionary const>> _byMap;
+    };
+
+    bool CompressZstd(std::span<uint8 const> input, ReplayDictionaryStore::Dictionary const* dictionary, std::vector<uint8>& output)
+    {
+        static thread_local std::unique_ptr<ZSTD_CCtx, ZstdDeleter> context(ZSTD_createCCtx());
+        if (!context)
+            return false;
+
+        output.resize(ZSTD_compressBound(input.size()));
+        size_t size = dictionary
+            ? ZSTD_compress_usingCDict(context.get(), output.data(), output.size(), input.data(), input.size(), dictionary->compression)
+            : ZSTD_compressCCtx(context.get(), output.data(), output.size(), input.data(), input.size(), REPLAY_ZSTD_LEVEL);
+        if (ZSTD_isError(size))
+            return false;
+
+        output.resize(size);
+        return true;
+    }
+
+    // one shot, for the trainer's comparison; loads stream through ReplayContentsReader
+    bool DecompressZstd(std::span<uint8 const> input, ReplayDictionaryStore::Dictionary const* dictionary, std::vector<uint8>& output)
+    {
+        static thread_local std::unique_ptr<ZSTD_DCtx, ZstdDeleter> context(ZSTD_createDCtx());
+        if (!context)
+            return false;
+
+        unsigned long long contentSize = ZSTD_getFrameContentSize(input.data(), input.size());
+        if (contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize == ZSTD_CONTENTSIZE_UNKNOWN)
+            return false;
+
+        output.resize(contentSize);
+        size_t size = dictionary
+            ? ZSTD_decompress_usingDDict(context.get(), output.data(), output.size(), input.data(), input.size(), dictionary->decompression)
+            : ZSTD_decompressDCtx(context.get(), output.data(), output.size(), input.data(), input.size());
+        return !ZSTD_isError(size) && size == contentSize;
+    }
+#endif
+
+    ArenaReplayConfig LoadArenaReplayConfig()
+    {
+        ArenaReplayConfig config;
+        config.enable = sConfigMgr->GetOption<bool>("ArenaReplay.Enable", true);
+        config.saveBattlegrounds = sConfigMgr->GetOption<bool>("ArenaReplay.SaveBattlegrounds", true);
+        config.saveUnratedArenas = sConfigMgr->GetOption<bool>("ArenaReplay.SaveUnratedArenas", true);
+        config.validArenaDuration = sConfigMgr->GetOption<uint32>("ArenaReplay.ValidArenaDuration", 75);
+        config.maxPacketsToSend = sConfigMgr->GetOption<uint32>("ArenaReplay.MaxPacketsToSend", 0);
+        config.storageFormat = sConfigMgr->GetOption<uint8>("ArenaReplay.StorageFormat", uint8(ReplayStorageFormat::Legacy));
+        config.arena1v1Enable = sConfigMgr->GetOption<bool>("ArenaReplay.1v1.Enable", false);
+        config.arena1v1ArenaType = sConfigMgr->GetOption<uint8>("ArenaReplay.1v1.ArenaType", 1);
+        config.arena3v3SoloQEnable = sConfigMgr->GetOption<bool>("ArenaReplay.3v3soloQ.Enable", false);
+        config.arena3v3SoloQArenaType = sConfigMgr->GetOption<uint8>("ArenaReplay.3v3soloQ.ArenaType", 4);
+        config.deleteReplaysAfterDays = sConfigMgr->GetOption<uint32>("ArenaReplay.DeleteReplaysAfterDays", 30);
+        config.deleteSavedReplays = sConfigMgr->GetOption<bool>("ArenaReplay.DeleteSavedReplays", false);
+        config.storageMaintenanceInterval = sConfigMgr->GetOption<uint32>("ArenaReplay.Storage.MaintenanceInterval", 3600);
+        config.playbackMaxPacketsPerTick = sConfigMgr->GetOption<uint32>("ArenaReplay.Playback.MaxPacketsPerTick", 200);
+        config.playbackMaxBytesPerTick = sConfigMgr->GetOption<uint32>("ArenaReplay.Playback.MaxBytesPerTick", 65536);
+        config.playbackMergeUpdateObjects = sConfigMgr->GetOption<bool>("ArenaReplay.Playback.MergeUpdateObjects", true);
+        config.loadThreads = sConfigMgr->GetOption<uint32>("ArenaReplay.Load.Threads", 0);
+        config.watchCountFlushInterval = sConfigMgr->GetOption<uint32>("ArenaReplay.WatchCountFlushInterval", 60);
+        config.metricsLogInterval = sConfigMgr->GetOption<uint32>("ArenaReplay.Metrics.LogInterval", 600);
+
+        if (!IsReplayStorageFormatSupported(static_cast<ReplayStorageFormat>(config.storageFormat)))
+        {
+            LOG_ERROR("modules", "ArenaReplay: ArenaReplay.StorageFormat {} is unknown or not built in, saving replays in the legacy format",
+                uint32(config.storageFormat));
+            config.storageFormat = uint8(ReplayStorageFormat::Legacy);
+        }
+
+        return config;
+    }
+
+    // mapId picks the zstd dictionary
+    std::string EncodeReplayContents(std::vector<uint8> const& serialized, ReplayStorageFormat format, uint32 mapId)
+    {
+        if (format == ReplayStorageFormat::Legacy || !IsReplayStorageFormatSupported(format))
+        {
+            bool looksLikeContainer = serialized.size() >= REPLAY_CONTAINER_HEADER_SIZE &&
+                std::equal(REPLAY_CONTAINER_MAGIC.begin(), REPLAY_CONTAINER_MAGIC.end(), serialized.begin());
+            if (!looksLikeContainer)
+                return Acore::Encoding::Base32::Encode(serialized);
+
+            format = ReplayStorageFormat::Zlib;
+        }
+
+        std::vector<uint8> header(REPLAY_CONTAINER_MAGIC.begin(), REPLAY_CONTAINER_MAGIC.end());
+        header.push_back(static_cast<uint8>(format));
+
+        std::vector<uint8> compressed;
+        bool compressedOk = false;
+        if (format == ReplayStorageFormat::Zlib)
+            compressedOk = Compress(serialized, compressed);
+#ifdef ARENA_REPLAY_ZSTD
+        else if (format == ReplayStorageFormat::Zstd)
+        {
+            std::shared_ptr<ReplayDictionaryStore::Dictionary const> dictionary = ReplayDictionaryStore::Instance().ForMap(mapId);
+            WriteLittleEndian(header, dictionary ? dictionary->id : uint32(0));
+            compressedOk = CompressZstd(serialized, dictionary.get(), compressed);
+        }
+#else
+        (void)mapId;
+#endif
+
+        if (!compressedOk)
+            return Acore::Encoding::Base32::Encode(serialized);
+
+        std::vector<uint8> container = std::move(header);
+        container.reserve(container.size() + compressed.size());
+        container.insert(container.end(), compressed.begin(), compressed.end());
+        return Acore::Encoding::Base32::Encode(container);
+    }
+
+    constexpr size_t REPLAY_DECODE_BLOCK = 64 * 1024; // Base32 characters, whole 8 character groups
+    constexpr size_t REPLAY_INFLATE_BLOCK = 256 * 1024;
+
+    // Reads the packets of a stored replay a block at a time, so a load holds
+    // neither the whole decoded container nor the whole serialized stream:
+    // each call Base32-decodes the next block of the row, runs it through the
+    // codec and appends the packets it completes. zlib rows go through zlib's
+    // streaming inflate, libdeflate builds included, as libdeflate only
+    // decompresses whole buffers.
+    class ReplayContentsReader
+    {
+    public:
+        explicit ReplayContentsReader(std::string stored) : _stored(std::move(stored)) { }
+
+        // false once the last block was read or the contents turned out invalid
+        bool Read(std::deque<PacketRecord>& packets)
+        {
+            if (Done())
+                return false;
+
+            size_t length = std::min(REPLAY_DECODE_BLOCK, _stored.size() - _offset);
+            auto decoded = Acore::Encoding::Base32::Decode(_stored.substr(_offset, length));
+            _offset += length;
+            bool last = _offset == _stored.size();
+            size_t pending = _serialized.size();
+            _failed = !decoded || !Feed(*decoded, last);
+            if (!_failed)
+            {
+                _serializedBytes += _serialized.size() - pending;
+                size_t consumed = ReadReplayPackets(_serialized, packets);
+                _serialized.erase(_serialized.begin(), _serialized.begin() + consumed);
+                _truncated = last && !_serialized.empty();
+            }
+
+            _done = last || _failed;
+            if (_done)
+            {
+                std::string().swap(_stored);
+                std::vector<uint8>().swap(_serialized);
+            }
+
+            return !_done;
+        }
+
+        bool Done() const { return _done; }
+        // the contents are not valid Base32 or the codec stream is corrupt or cut off
+        bool Failed() const { return _failed; }
+        // the serialized packets end in the middle of a packet
+        bool Truncated() const { return _truncated; }
+        ReplayStorageFormat Format() const { return _format.value_or(ReplayStorageFormat::Legacy); }
+        // the zstd dictionary the row names, 0 for none
+        uint32 DictionaryId() const { return _dictionaryId; }
+        size_t SerializedBytes() const { return _serializedBytes; }
+
+    private:
+        // the first bytes are held until the container header and the uint32
+        // after it are complete
+        bool Feed(std::vector<uint8> const& block, bool last)
+        {
+            if (_format)
+                return Process(block, last);
+
+            _header.insert(_header.end(), block.begin(), block.end());
+            if (_header.size() < REPLAY_CONTAINER_HEADER_SIZE + sizeof(uint32) && !last)
+                return true;
+
+            std::vector<uint8> header = std::move(_header);
+            bool isContainer = header.size() >= REPLAY_CONTAINER_HEADER_SIZE &&
+                std::equal(REPLAY_CONTAINER_MAGIC.begin(), REPLAY_CONTAINER_MAGIC.end(), header.begin());
+            if (!isContainer)
+            {
+                _format = ReplayStorageFormat::Legacy;
+                return Process(header, last);
+            }
+
+            // the zlib size prefix is not needed to inflate a stream; a zstd row
+            // names its dictionary, which has to be loaded
+            size_t offset = REPLAY_CONTAINER_HEADER_SIZE;
+            uint32 word = 0;
+            _format = static_cast<ReplayStorageFormat>(header[REPLAY_CONTAINER_MAGIC.size()]);
+            if (!ReadLittleEndian(std::span<uint8 const>(header), offset, word))
+                return false;
+
+            switch (*_format)
+            {
+                case ReplayStorageFormat::Zlib:
+                    if (inflateInit(&_inflater.stream) != Z_OK)
+                        return false;
+
+                    _inflater.initialized = true;
+                    break;
+#ifdef ARENA_REPLAY_ZSTD
+                case ReplayStorageFormat::Zstd:
+                    _zstd.reset(ZSTD_createDCtx());
+                    _dictionaryId = word;
+                    if (!_zstd)
+                        return false;
+
+                    if (word)
+                    {
+                        _dictionary = ReplayDictionaryStore::Instance().ById(word);
+                        if (!_dictionary || ZSTD_isError(ZSTD_DCtx_refDDict(_zstd.get(), _dictionary->decompression)))
+                            return false;
+                    }
+
+                    break;
+#endif
+                default:
+                    return false;
+            }
+
+            return Process(std::span<uint8 const>(header).subspan(offset), last);
+        }
+
+        // appends the codec output of input to _serialized; false on a
+        // corrupt stream or one that is not complete at the last block
+        bool Process(std::span<uint8 const> input, bool last)
+        {
+            switch (*_format)
+            {
+                case ReplayStorageFormat::Legacy:
+                    _serialized.insert(_serialized.end(), input.begin(), input.end());
+                    return true;
+                case ReplayStorageFormat::Zlib:
+                {
+                    z_stream& stream = _inflater.stream;
+                    stream.next_in = const_cast<Bytef*>(reinterpret_cast<Bytef const*>(input.data()));
+                    stream.avail_in = static_cast<uInt>(input.size());
+                    while (!_ended)
+                    {
+                        size_t size = _serialized.size();
+                        _serialized.resize(size + REPLAY_INFLATE_BLOCK);
+                        stream.next_out = _serialized.data() + size;
+                        stream.avail_out = static_cast<uInt>(REPLAY_INFLATE_BLOCK);
+                        int result = inflate(&stream, Z_NO_FLUSH);
+                        _serialized.resize(size + REPLAY_INFLATE_BLOCK - stream.avail_out);
+                        if (result == Z_STREAM_END)
+                            _ended = true;
+                        else if (result != Z_OK && result != Z_BUF_ERROR)
+                            return false;
+                        else if (!stream.avail_in && stream.avail_out)
+                            break;
+                    }
+
+                    return !last || _ended;
+                }
+#ifdef ARENA_REPLAY_ZSTD
+                case ReplayStorageFormat::Zstd:
+                {
+                    ZSTD_inBuffer in = { input.data(), input.size(), 0 };
+                    while (!_ended)
+                    {
+                        size_t size = _serialized.size();
+                        _serialized.resize(size + REPLAY_INFLATE_BLOCK);
+                        ZSTD_outBuffer out = { _serialized.data() + size, REPLAY_INFLATE_BLOCK, 0 };
+                        size_t result = ZSTD_decompressStream(_zstd.get(), &out, &in);
+                        _serialized.resize(size + out.pos);
+                        if (ZSTD_isError(result))
+                            return false;
+
+                        if (!result)
+                            _ended = true;
+                        else if (in.pos == in.size && out.pos < out.size)
+                            break;
+                    }
+
+                    return !last || _ended;
+                }
+#endif
+                default:
+                    return false;
+            }
+        }
+
+        std::string _stored;
+        size_t _offset = 0;
+        bool _done = false;
+        bool _failed = false;
+        bool _truncated = false;
+        size_t _serializedBytes = 0;
+        bool _ended = false; // the codec stream is complete
+        std::optional<ReplayStorageFormat> _format;
+        uint32 _dictionaryId = 0;
+        std::vector<uint8> _header;
+        std::vector<uint8> _serialized; // codec output not yet read as packets
+        ZlibStream _inflater;
+#ifdef ARENA_REPLAY_ZSTD
+        std::shared_ptr<ReplayDictionaryStore::Dictionary const> _dictionary; // outlives the context referencing it
+        std::unique_ptr<ZSTD_DCtx, ZstdDeleter> _zstd;
+#endif
+    };
+
+    // Shared worker threads for the parallel stages of a replay load. Each
+    // worker owns a task deque: a batch is dealt round-robin across them, a
+    // worker takes from the front of its own and, once that runs dry, steals
+    // from the back of the others, so a range that turns out heavy (the
+    // opening create burst) does not leave the rest of the pool idle. The
+    // thread submitting a batch works on it too.
+    class ReplayWorkPool
+    {
+    public:
+        static ReplayWorkPool& Instance()
+        {
+            static ReplayWorkPool instance;
+            return instance;
+        }
+
+        ~ReplayWorkPool() { Resize(0); }
+
+        // runs every task and returns once all are done; threads counts the
+        // caller, so with 1 the tasks run in order on the calling thread
+        void Run(std::vector<std::function<void()>>& tasks, uint32 threads)
+        {
+            if (threads > 1 && tasks.size() > 1)
+                Resize(threads - 1);
+
+            std::shared_lock<std::shared_mutex> workersLock(_workersMutex);
+            if (threads <= 1 || tasks.size() <= 1 || _queues.empty())
+            {
+                for (std::function<void()>& task : tasks)
+                    task();
+                return;
+            }
+
+            Batch batch;
+            batch.remaining.store(tasks.size(), std::memory_order_relaxed);
+            for (std::function<void()>& task : tasks)
+            {
+                Queue& queue = *_queues[_nextQueue.fetch_add(1, std::memory_order_relaxed) % _queues.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.push_back({ &task, &batch });
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(_wakeMutex);
+                _queued += tasks.size();
+            }
+            _wake.notify_all();
+
+            while (batch.remaining.load(std::memory_order_acquire))
+                if (!RunOne(_queues.size()))
+                    std::this_thread::yield();
+        }
+
+        // starts or stops workers until there are count of them; waits for running batches
+        void Resize(size_t count)
+        {
+            {
+                std::shared_lock<std::shared_mutex> lock(_workersMutex);
+                if (_workers.size() == count)
+                    return;
+            }
+
+            std::unique_lock<std::shared_mutex> lock(_workersMutex);
+            if (_workers.size() == count)
+                return;
+
+            {
+                std::lock_guard<std::mutex> wakeLock(_wakeMutex);
+                _stop = true;
+            }
+            _wake.notify_all();
+            for (std::thread& worker : _workers)
+                worker.join();
+
+            _workers.clear();
+            _queues.clear();
+            _stop = false;
+            for (size_t i = 0; i < count; ++i)
+                _queues.push_back(std::make_unique<Queue>());
+            for (size_t i = 0; i < count; ++i)
+                _workers.emplace_back(&ReplayWorkPool::Work, this, i);
+        }
+
+    private:
+        struct Batch
+        {
+            std::atomic<size_t> remaining = 0;
+        };
+
+        struct Task
+        {
+            std::function<void()>* function = nullptr;
+            Batch* batch = nullptr;
+        };
+
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void Work(size_t self)
+        {
+            while (true)
+            {
+                if (RunOne(self))
+                    continue;
+
+                std::unique_lock<std::mutex> lock(_wakeMutex);
+                _wake.wait(lock, [this]() { return _stop || _queued > 0; });
+                if (_stop)
+                    return;
+            }
+        }
+
+        // own queue first, then steal; self == _queues.size() only steals
+        bool RunOne(size_t self)
+        {
+            Task task;
+            size_t count = _queues.size();
+            for (size_t i = 0; i < count && !task.function; ++i)
+            {
+                size_t index = (self + i) % count;
+                Queue& queue = *_queues[index];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.tasks.empty())
+                    continue;
+
+                if (index == self)
+                {
+                    task = queue.tasks.front();
+                    queue.tasks.pop_front();
+                }
+                else
+                {
+                    task = queue.tasks.back();
+                    queue.tasks.pop_back();
+                }
+            }
+
+            if (!task.function)
+                return false;
+
+            {
+                std::lock_guard<std::mutex> lock(_wakeMutex);
+                --_queued;
+            }
+
+            (*task.function)();
+            task.batch->remaining.fetch_sub(1, std::memory_order_release);
+            return true;
+        }
+
+        std::shared_mutex _workersMutex; // shared by running batches, exclusive to resize
+        std::vector<std::unique_ptr<Queue>> _queues;
+        std::vector<std::thread> _workers;
+        std::atomic<size_t> _nextQueue = 0;
+        std::mutex _wakeMutex;
+        std::condition_variable _wake;
+        size_t _queued = 0;
+        bool _stop = false;
+    };
+
+    constexpr uint32 REPLAY_LOAD_MAX_THREADS = 16;
+    constexpr size_t REPLAY_REMAP_MIN_RANGE = 256; // packets
+    constexpr size_t REPLAY_REMAP_RANGES_PER_THREAD = 4;
+
+    // ArenaReplay.Load.Threads, 0 meaning half the cores and at most 4
+    uint32 ReplayLoadThreads()
+    {
+        uint32 threads = sArenaReplayConfig.Get().loadThreads;
+        if (!threads)
+            threads = std::clamp<uint32>(std::thread::hardware_concurrency() / 2, 1, 4);
+
+        return std::min(threads, REPLAY_LOAD_MAX_THREADS);
+    }
+
+    // Rewrites the participants of a replay to ghost GUIDs, front to back in
+    // packet ranges, so a streaming load can hand each range to playback as
+    // soon as it is done. Begin picks the ghost GUIDs from the range
+    // GenerateGhostGuid draws from, clear of the participants and of the
+    // packets extracted so far, without waiting for the rest of the row.
+    // Every later range is extracted before it is rewritten, and an object
+    // of it that turns out to carry a ghost GUID gets a ghost of its own, so
+    // it never merges with the participant on the client. Those extra
+    // entries are the remapper's own; the record's guidRemap keeps the
+    // participants only, as playback reads it while later ranges load.
+    //
+    // Extraction and the rewrite split their packets into slices run on the
+    // work pool. A values block is rewritten by the TypeId of the create
+    // block that came before it, so the rewrite is preceded by a sequential
+    // pass that only records those TypeIds and hands every slice the types
+    // known at its first packet, which makes the output the same as on one
+    // thread. SMSG_MULTIPLE_PACKETS are rewritten on a copy by that pass,
+    // their embedded creates recording types the way the rewrite does.
+    class ReplayGuidRemapper
+    {
+    public:
+        ReplayGuidRemapper(MatchRecord& record, uint32 threads) : _record(record), _threads(std::max<uint32>(threads, 1)),
+            _parseWarningLogged(record.updateObjectParseWarningLogged), _leakLogged(record.updateObjectLeakLogged),
+            _leakDropLogged(record.guidLeakDropLogged), _parseLogs(record.updateObjectParseLogs) { }
+
+        // extracts the GUIDs of the packets up to, not including, last
+        void Extract(size_t last)
+        {
+            if (_record.participantGuids.empty() || _extracted >= last)
+                return;
+
+            auto extractStart = std::chrono::steady_clock::now();
+            ExtractGuids(last);
+            AddStage(_extractTime, "remap.extract", extractStart);
+        }
+
+        // picks the ghost GUIDs, clear of the packets extracted so far
+        void Begin()
+        {
+            if (_record.participantGuids.empty())
+                return;
+
+            _usedGuids.insert(_record.participantGuids.begin(), _record.participantGuids.end());
+            for (uint64 guid : _record.participantGuids)
+            {
+                if (guid == 0)
+                    continue;
+
+                if (_remap.find(guid) != _remap.end())
+                    continue;
+
+                AddGhost(guid);
+            }
+
+            for (uint64& guid : _record.participantGuids)
+            {
+                auto it = _remap.find(guid);
+                if (it != _remap.end())
+                    guid = it->second;
+            }
+
+            _record.guidRemap = _remap;
+            _originalGuids.emplace(_remap);
+            _objectTypes.reserve(2048);
+            _begun = true;
+
+            LOG_DEBUG("modules", "ArenaReplay: remapped {} participant GUIDs ({} packets) to ghost GUIDs",
+                _record.guidRemap.size(),
+                _record.packets.size());
+        }
+
+        // rewrites packets up to, not including, last, extracting those not extracted yet
+        void Remap(size_t last)
+        {
+            if (!_begun)
+            {
+                _rewritten = last;
+                return;
+            }
+
+            if (_rewritten >= last)
+                return;
+
+            Extract(last);
+            auto rewriteStart = std::chrono::steady_clock::now();
+            std::vector<Slice> slices = Split(_rewritten, last);
+            RecordObjectTypes(slices);
+            RunSlices(slices, [this](Slice& slice)
+            {
+                for (size_t i = slice.first; i < slice.last; ++i)
+                    RewritePacket(_record.packets[i], slice);
+            });
+
+            _objectTypes = std::move(slices.back().objectTypes);
+            for (Slice const& slice : slices)
+            {
+                _record.deflateCalls += slice.deflateCalls;
+                _record.inflatedPayloadReuses += slice.inflatedPayloadReuses;
+            }
+
+            _rewritten = last;
+            AddStage(_rewriteTime, "remap.rewrite", rewriteStart);
+        }
+
+        void Finish()
+        {
+            _record.updateObjectParseWarningLogged = _parseWarningLogged;
+            _record.updateObjectLeakLogged = _leakLogged;
+            _record.guidLeakDropLogged = _leakDropLogged;
+            _record.updateObjectParseLogs = std::min<size_t>(_parseLogs, 5);
+            if (!_begun)
+                return;
+
+            sArenaReplayMetrics.remapExtract.Record(_extractTime);
+            sArenaReplayMetrics.remapRewrite.Record(_rewriteTime);
+            LOG_DEBUG("modules", "ArenaReplay: replay {} load inflated {} and deflated {} times for {} compressed update packets on {} threads",
+                _record.replayId,
+                _record.inflateCalls,
+                _record.deflateCalls,
+                _record.compressedUpdatePackets,
+                _threads);
+        }
+
+    private:
+        // packets [first, last) and what one worker keeps while on them
+        struct Slice
+        {
+            size_t first = 0;
+            size_t last = 0;
+            std::unordered_set<uint64> guids;
+            std::unordered_map<uint64, uint8> objectTypes; // at first, then carried through the slice
+            std::vector<GuidPatternHit> hits;
+            std::vector<uint8> rewrittenPayload;
+            uint32 compressedUpdatePackets = 0;
+            uint32 deflateCalls = 0;
+            uint32 inflatedPayloadReuses = 0;
+        };
+
+        // a few slices per thread so the pool can balance them, none too small to be worth a task
+        std::vector<Slice> Split(size_t first, size_t last) const
+        {
+            size_t count = last - first;
+            size_t size = count;
+            if (_threads > 1)
+                size = std::max(REPLAY_REMAP_MIN_RANGE, (count + _threads * REPLAY_REMAP_RANGES_PER_THREAD - 1) / (_threads * REPLAY_REMAP_RANGES_PER_THREAD));
+
+            std::vector<Slice> slices((count + size - 1) / size);
+            for (size_t i = 0; i < slices.size(); ++i)
+            {
+                slices[i].first = first + i * size;
+                slices[i].last = std::min(last, slices[i].first + size);
+            }
+
+            return slices;
+        }
+
+        template <typename Work>
+        void RunSlices(std::vector<Slice>& slices, Work work)
+        {
+            std::vector<std::function<void()>> tasks;
+            tasks.reserve(slices.size());
+            for (Slice& slice : slices)
+                tasks.emplace_back([&work, &slice]() { work(slice); });
+
+            ReplayWorkPool::Instance().Run(tasks, _threads);
+        }
+
+        void ExtractGuids(size_t last)
+        {
+            std::vector<Slice> slices = Split(_extracted, last);
+            RunSlices(slices, [this](Slice& slice)
+            {
+                for (size_t i = slice.first; i < slice.last; ++i)
+                {
+                    PacketRecord& packet = _record.packets[i];
+                    slice.guids.insert(packet.sourceGuid);
+
+                    UpdateObjectParseStats stats;
+                    size_t failureOffset = 0;
+                    bool compressed = packet.packet.GetOpcode() == SMSG_COMPRESSED_UPDATE_OBJECT && packet.packet.size() > 0;
+                    if (compressed)
+                        ++slice.compressedUpdatePackets;
+
+                    // keep the inflated payload so the rewrite and leak check do not inflate it again
+                    if (!ExtractGuidsFromPacket(packet.packet, slice.guids, stats, failureOffset, compressed ? &packet.inflated : nullptr) &&
+                        LogOnce(_parseWarningLogged))
+                    {
+                        LOG_WARN("modules", "ArenaReplay: failed to parse update object payload while extracting GUIDs for replay {} opcode {} packetSize {} offset {}",
+                            _record.replayId,
+                            packet.packet.GetOpcode(),
+                            packet.packet.size(),
+                            failureOffset);
+                    }
+                }
+            });
+
+            std::vector<uint64> collisions;
+            for (Slice& slice : slices)
+            {
+                if (_begun)
+                    for (uint64 guid : slice.guids)
+                        if (_ghostGuids.contains(guid) && !_remap.contains(guid))
+                            collisions.push_back(guid);
+
+                _usedGuids.insert(slice.guids.begin(), slice.guids.end());
+
+                _record.compressedUpdatePackets += slice.compressedUpdatePackets;
+                _record.inflateCalls += slice.compressedUpdatePackets;
+            }
+
+            // sorted, so the ghosts handed out do not depend on how the packets were sliced
+            std::sort(collisions.begin(), collisions.end());
+            collisions.erase(std::unique(collisions.begin(), collisions.end()), collisions.end());
+            for (uint64 guid : collisions)
+                AddGhost(guid);
+
+            if (!collisions.empty())
+                LOG_DEBUG("modules", "ArenaReplay: replay {} moved {} objects off the ghost GUIDs of its participants",
+                    _record.replayId,
+                    collisions.size());
+
+            _extracted = last;
+        }
+
+        // A raw rewrite applies the entries one after the other, so an object
+        // moved off a ghost GUID is rewritten before the participant moves
+        // onto it: the newest entry first.
+        void AddGhost(uint64 guid)
+        {
+            uint64 ghostGuid = GenerateGhostGuid(guid, _usedGuids);
+            _usedGuids.insert(ghostGuid);
+            _ghostGuids.insert(ghostGuid);
+            _remap.emplace(guid, ghostGuid);
+            _rewriteOrder.insert(_rewriteOrder.begin(), { guid, ghostGuid });
+        }
+
+        // the sequential pass: each slice gets the types known at its first
+        // packet; the last one takes them over and needs no scan
+        void RecordObjectTypes(std::vector<Slice>& slices)
+        {
+            for (Slice& slice : slices)
+            {
+                if (&slice == &slices.back())
+                {
+                    slice.objectTypes = std::move(_objectTypes);
+                    break;
+                }
+
+                slice.objectTypes = _objectTypes;
+                for (size_t i = slice.first; i < slice.last; ++i)
+                {
+                    PacketRecord const& packet = _record.packets[i];
+                    if (packet.packet.GetOpcode() == SMSG_UPDATE_OBJECT && packet.packet.size() > 0 && packet.packet.contents())
+                        RecordUpdateObjectTypes({ packet.packet.contents(), packet.packet.size() }, _remap, _objectTypes);
+                    else if (packet.packet.GetOpcode() == SMSG_COMPRESSED_UPDATE_OBJECT && !packet.inflated.empty())
+                        RecordUpdateObjectTypes(packet.inflated, _remap, _objectTypes);
+                    else if (packet.packet.GetOpcode() == SMSG_MULTIPLE_PACKETS)
+                    {
+                        // embedded packets record their types one remap entry at a time, so run that rewrite on a copy
+                        WorldPacket copy(packet.packet);
+                        for (auto const& [fromGuid, toGuid] : _rewriteOrder)
+                            ReplaceGuidInPacket(copy, fromGuid, toGuid, &_objectTypes);
+                    }
+                }
+            }
+        }
+
+        void RewritePacket(PacketRecord& packet, Slice& slice)
+        {
+            auto sourceIt = _remap.find(packet.sourceGuid);
+            if (sourceIt != _remap.end())
+                packet.sourceGuid = sourceIt->second;
+
+            bool rewritten = false;
+            bool isUpdateObject = packet.packet.GetOpcode() == SMSG_UPDATE_OBJECT || packet.packet.GetOpcode() == SMSG_COMPRESSED_UPDATE_OBJECT;
+            if (isUpdateObject)
+            {
+                UpdateObjectParseStats stats;
+                size_t failureOffset = 0;
+                if (packet.packet.GetOpcode() == SMSG_UPDATE_OBJECT)
+                    rewritten = RewriteUpdateObjectPacket(packet.packet, _remap, slice.objectTypes, stats, failureOffset, slice.rewrittenPayload);
+                else if (!packet.inflated.empty())
+                {
+                    ++slice.inflatedPayloadReuses;
+                    bool deflated = false;
+                    rewritten = RewriteInflatedUpdateObjectPacket(packet.packet, packet.inflated, slice.rewrittenPayload, _remap,
+                        slice.objectTypes, stats, failureOffset, deflated);
+                    if (deflated)
+                        ++slice.deflateCalls;
+                }
+
+                if (rewritten)
+                {
+                    if (_parseLogs.load(std::memory_order_relaxed) < 5 && _parseLogs.fetch_add(1, std::memory_order_relaxed) < 5)
+                    {
+                        LOG_DEBUG("modules", "ArenaReplay: parsed update object opcode {} blocks {}/{} bytes {}",
+                            packet.packet.GetOpcode(),
+                            stats.parsedBlocks,
+                            stats.blockCount,
+                            stats.bytesConsumed);
+                    }
+                }
+                else if (LogOnce(_parseWarningLogged))
+                {
+                    LOG_WARN("modules", "ArenaReplay: failed to parse update object payload for replay {} opcode {} packetSize {} offset {}",
+                        _record.replayId,
+                        packet.packet.GetOpcode(),
+                        packet.packet.size(),
+                        failureOffset);
+                }
+            }
+            else
+            {
+                for (auto const& [fromGuid, toGuid] : _rewriteOrder)
+                    ReplaceGuidInPacket(packet.packet, fromGuid, toGuid, &slice.objectTypes);
+            }
+
+            slice.hits.clear();
+            bool leaked = false;
+            if (packet.packet.GetOpcode() == SMSG_COMPRESSED_UPDATE_OBJECT)
+            {
+                leaked = _originalGuids->Scan(rewritten ? slice.rewrittenPayload : packet.inflated, false, &slice.hits);
+                std::vector<uint8>().swap(packet.inflated);
+            }
+            else
+                leaked = ScanPacketForGuids(packet.packet, *_originalGuids, &slice.hits);
+
+            if (!leaked)
+                return;
+
+            packet.drop = true;
+            GuidPatternHit const& hit = slice.hits.front();
+            if (rewritten && LogOnce(_leakLogged))
+            {
+                LOG_ERROR("modules", "ArenaReplay: GUID leak detected in replay {} opcode {} guid {} offset {} packed {} hits {}",
+                    _record.replayId,
+                    packet.packet.GetOpcode(),
+                    hit.guid,
+                    hit.offset,
+                    hit.packed,
+                    slice.hits.size());
+            }
+
+            if (LogOnce(_leakDropLogged))
+            {
+                LOG_ERROR("modules", "ArenaReplay: GUID leak detected, dropping packet replay {} opcode {} size {} ts {} guid {} offset {}",
+                    _record.replayId,
+                    packet.packet.GetOpcode(),
+                    packet.packet.size(),
+                    packet.timestamp,
+                    hit.guid,
+                    hit.offset);
+            }
+        }
+
+        // true for the one caller that sets the flag
+        static bool LogOnce(std::atomic<bool>& logged)
+        {
+            return !logged.load(std::memory_order_relaxed) && !logged.exchange(true, std::memory_order_relaxed);
+        }
+
+        // the histograms get one sample per load, the trace one span per range
+        void AddStage(std::chrono::steady_clock::duration& total, char const* traceName, std::chrono::steady_clock::time_point start)
+        {
+            auto end = std::chrono::steady_clock::now();
+            total += end - start;
+            sArenaReplayTrace.Add(traceName, start, end, _record.replayId);
+        }
+
+        MatchRecord& _record;
+        uint32 _threads;
+        bool _begun = false;
+        size_t _extracted = 0;
+        size_t _rewritten = 0;
+        std::unordered_set<uint64> _usedGuids; // extracted so far, the participants and ghosts once begun
+        std::unordered_set<uint64> _ghostGuids;
+        std::unordered_map<uint64, uint64> _remap; // the participants, then the objects moved off a ghost GUID
+        std::vector<std::pair<uint64, uint64>> _rewriteOrder; // _remap, newest entry first
+        std::optional<GuidPatternMatcher> _originalGuids; // the participants
+        std::unordered_map<uint64, uint8> _objectTypes; // as of _rewritten
+        std::atomic<bool> _parseWarningLogged;
+        std::atomic<bool> _leakLogged;
+        std::atomic<bool> _leakDropLogged;
+        std::atomic<size_t> _parseLogs;
+        std::chrono::steady_clock::duration _extractTime{};
+        std::chrono::steady_clock::duration _rewriteTime{};
+    };
+
+    constexpr uint32 REPLAY_LOAD_CHUNK_DURATION = 5 * IN_MILLISECONDS; // of replay time
+    constexpr size_t REPLAY_RELEASE_BATCH = 512; // played packets freed at once
+
+    // end of the chunk starting at first: every packet recorded within the chunk duration
+    size_t ReplayLoadChunkEnd(std::deque<PacketRecord> const& packets, size_t first)
+    {
+        uint32 end = packets[first].timestamp + REPLAY_LOAD_CHUNK_DURATION;
+        size_t last = first + 1;
+        while (last < packets.size() && packets[last].timestamp < end)
+            ++last;
+
+        return last;
+    }
+
+    constexpr uint32 REPLAY_LOADERS = 2; // loader threads
+
+    // Decodes and remaps replays for playback on a few loader threads. A load
+    // is a series of steps: one decoded block of the row, with the GUIDs of
+    // the packets it completes extracted, until the next chunk of replay time
+    // is whole, then that chunk remapped and published through the record's
+    // progress. The ghost GUIDs are picked with the first chunk, so it plays
+    // while the rest of the row is still being decoded. A loader runs one
+    // step of a load and puts it back at the end of the queue, so a long
+    // replay does not hold up the ones requested after it.
+    class ReplayStreamLoader
+    {
+    public:
+        static ReplayStreamLoader& Instance()
+        {
+            static ReplayStreamLoader instance;
+            return instance;
+        }
+
+        ~ReplayStreamLoader() { Stop(); }
+
+        // record holds the row's metadata and participants; start is when the load was requested
+        void Load(std::shared_ptr<MatchRecord> record, std::string contents, std::chrono::steady_clock::time_point start)
+        {
+            record->progress = std::make_shared<ReplayLoadProgress>();
+            auto job = std::make_unique<Job>(std::move(record), std::move(contents), start);
+            std::lock_guard<std::mutex> lock(_mutex);
+            _jobs.push_back(std::move(job));
+            while (_threads.size() < REPLAY_LOADERS)
+                _threads.emplace_back(&ReplayStreamLoader::Run, this);
+
+            _condition.notify_one();
+        }
+
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+
+            _condition.notify_all();
+            for (std::thread& thread : _threads)
+                thread.join();
+
+            _threads.clear();
+        }
+
+    private:
+        struct Job
+        {
+            Job(std::shared_ptr<MatchRecord> loadRecord, std::string contents, std::chrono::steady_clock::time_point loadStart)
+                : record(std::move(loadRecord)), reader(std::move(contents)), remapper(*record, ReplayLoadThreads()), start(loadStart) { }
+
+            std::shared_ptr<MatchRecord> record;
+            ReplayContentsReader reader;
+            ReplayGuidRemapper remapper;
+            std::chrono::steady_clock::time_point start;
+            std::chrono::steady_clock::duration decodeTime{};
+            std::chrono::steady_clock::duration remapTime{};
+            size_t published = 0; // packets handed to playback
+        };
+
+        void Run()
+        {
+            while (true)
+            {
+                std::unique_ptr<Job> job;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _condition.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+                    if (_stop)
+                        return;
+
+                    job = std::move(_jobs.front());
+                    _jobs.pop_front();
+                }
+
+                if (Step(*job))
+                    continue;
+
+                std::lock_guard<std::mutex> lock(_mutex);
+                _jobs.push_back(std::move(job));
+                _condition.notify_one();
+            }
+        }
+
+        // runs the next step of the load; true once it is done
+        bool Step(Job& job)
+        {
+            MatchRecord& record = *job.record;
+            auto stepStart = std::chrono::steady_clock::now();
+            size_t packetCount = record.packets.size();
+            size_t last = job.published < packetCount ? ReplayLoadChunkEnd(record.packets, job.published) : packetCount;
+
+            // the next chunk is whole once a packet after it is decoded, or the whole row is
+            if (!job.reader.Done() && last == packetCount)
+            {
+                job.reader.Read(record.packets);
+                auto decoded = std::chrono::steady_clock::now();
+                job.decodeTime += decoded - stepStart;
+                sArenaReplayTrace.Add("load.decode", stepStart, decoded, record.replayId);
+                if (job.reader.Done())
+                    sArenaReplayMetrics.loadDecode.Record(job.decodeTime);
+
+                job.remapper.Extract(record.packets.size());
+                job.remapTime += std::chrono::steady_clock::now() - decoded;
+                return false;
+            }
+
+            ReplayLoadProgress& progress = *record.progress;
+            if (job.published < packetCount)
+            {
+                if (!job.published)
+                    job.remapper.Begin();
+
+                job.remapper.Remap(last);
+                auto end = std::chrono::steady_clock::now();
+                job.remapTime += end - stepStart;
+                progress.ready.store(last, std::memory_order_release);
+                if (!job.published)
+                    RecordArenaReplayStage(sArenaReplayMetrics.loadFirstChunk, "load.first", record.replayId, job.start, end);
+
+                job.published = last;
+                if (last < packetCount || !job.reader.Done())
+                    return false;
+            }
+
+            job.remapper.Finish();
+            sArenaReplayMetrics.loadRemap.Record(job.remapTime);
+            RecordArenaReplayStage(sArenaReplayMetrics.load, "load", record.replayId, job.start, std::chrono::steady_clock::now());
+            sArenaReplayMetrics.inflateCalls.Add(record.inflateCalls);
+            sArenaReplayMetrics.deflateCalls.Add(record.deflateCalls);
+            sArenaReplayMetrics.compressedUpdatePackets.Add(record.compressedUpdatePackets);
+            sArenaReplayMetrics.inflatedPayloadReuses.Add(record.inflatedPayloadReuses);
+            progress.done.store(true, std::memory_order_release);
+            return true;
+        }
+
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::deque<std::unique_ptr<Job>> _jobs;
+        std::vector<std::thread> _threads;
+        bool _stop = false;
+    };
+
+    // Replays live in the week-partitioned table until their partition
+    // expires; favorites of an expired week are moved to the archive table.
+    constexpr char const* REPLAY_TABLE = "character_arena_replays";
+    constexpr char const* REPLAY_ARCHIVE_TABLE = "character_arena_replays_archive";
+
+    // Reads a replay row from the live table, else from the archive. table
+    // receives the name of the one that had it.
+    QueryResult QueryReplayRow(std::string_view columns, uint32 replayId, char const** table = nullptr)
+    {
+        for (char const* candidate : { REPLAY_TABLE, REPLAY_ARCHIVE_TABLE })
+        {
+            if (QueryResult result = CharacterDatabase.Query("SELECT {} FROM {} WHERE id = {}", columns, candidate, replayId))
+            {
+                if (table)
+                    *table = candidate;
+
+                return result;
+            }
+        }
+
+        return nullptr;
+    }
+
+    constexpr char const* REPLAY_ID_BLOCK_TABLE = "character_arena_replay_id_blocks";
+    constexpr uint32 REPLAY_ID_BLOCK_SIZE = 100;
+    constexpr uint32 REPLAY_ID_BLOCK_ATTEMPTS = 3;
+
+    // Replay ids are handed out from blocks reserved in the DB instead of by
+    // AUTO_INCREMENT, so a save knows its id without waiting for the async
+    // insert. A block is claimed by inserting its first id, which is the
+    // primary key: of two worldservers claiming the same block at once, one
+    // insert fails and that server tries the next block.
+    class ReplayIdAllocator
+    {
+    public:
+        static ReplayIdAllocator& Instance()
+        {
+            static ReplayIdAllocator instance;
+            return instance;
+        }
+
+        // 0 when no block could be reserved
+        uint32 Next()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_next == _end && !ReserveBlock())
+                return 0;
+
+            return _next++;
+        }
+
+    private:
+        ReplayIdAllocator()
+        {
+            std::random_device random;
+            _tokenPrefix = (uint64(random()) << 32) | random();
+        }
+
+        bool ReserveBlock()
+        {
+            for (uint32 attempt = 0; attempt < REPLAY_ID_BLOCK_ATTEMPTS; ++attempt)
+            {
+                // names this claim, to find the block again from any connection
+                std::string token = Acore::StringFormat("{:016x}-{}", _tokenPrefix, ++_claims);
+                CharacterDatabase.DirectExecute("INSERT INTO {0} (firstId, token) SELECT GREATEST(COALESCE(MAX(firstId) + {1}, 1), "
+                    "COALESCE((SELECT MAX(id) FROM {2}), 0) + 1, COALESCE((SELECT MAX(id) FROM {3}), 0) + 1), '{4}' FROM {0}",
+                    REPLAY_ID_BLOCK_TABLE, REPLAY_ID_BLOCK_SIZE, REPLAY_TABLE, REPLAY_ARCHIVE_TABLE, token);
+
+                if (QueryResult result = CharacterDatabase.Query("SELECT firstId FROM {} WHERE token = '{}'", REPLAY_ID_BLOCK_TABLE, token))
+                {
+                    _next = result->Fetch()[0].Get<uint32>();
+                    _end = _next + REPLAY_ID_BLOCK_SIZE;
+                    return true;
+                }
+            }
+
+            LOG_ERROR("modules", "ArenaReplay: could not reserve replay ids in {}. Apply updates/replayarena_03_id_blocks.sql.", REPLAY_ID_BLOCK_TABLE);
+            return false;
+        }
+
+        std::mutex _mutex;
+        uint64 _tokenPrefix = 0;
+        uint32 _claims = 0;
+        uint32 _next = 0;
+        uint32 _end = 0;
+    };
+
+    constexpr char const* REPLAY_INFO_COLUMNS = "id, arenaTypeId, winnerTeamName, winnerTeamRating, "
+        "loserTeamName, loserTeamRating, timesWatched, UNIX_TIMESTAMP(timestamp)";
+    // what a ranking subquery has to carry for REPLAY_INFO_COLUMNS, without the contents blob
+    constexpr char const* REPLAY_INFO_SOURCE_COLUMNS = "id, arenaTypeId, winnerTeamName, winnerTeamRating, "
+        "loserTeamName, loserTeamRating, timesWatched, timestamp";
+
+    // Every listed replay once: the replay table, plus the favorites only left
+    // in the archive after their week was dropped, as a derived table of
+    // REPLAY_INFO_SOURCE_COLUMNS.
+    std::string ReplayInfoSource()
+    {
+        return Acore::StringFormat("(SELECT {0} FROM {1} UNION ALL SELECT {0} FROM {2} WHERE id NOT IN (SELECT id FROM {1})) replays",
+            REPLAY_INFO_SOURCE_COLUMNS, REPLAY_TABLE, REPLAY_ARCHIVE_TABLE);
+    }
+
+    // The first limit rows of REPLAY_INFO_COLUMNS matching where in that same
+    // set. Each table is ordered and limited on its own, so both can read
+    // through their indexes.
+    std::string ReplayInfoQuery(std::string_view where, std::string_view orderBy, size_t limit)
+    {
+        return Acore::StringFormat("(SELECT {0} FROM {1} WHERE {3} ORDER BY {4} LIMIT {5}) UNION ALL "
+            "(SELECT {0} FROM {2} WHERE ({3}) AND id NOT IN (SELECT id FROM {1}) ORDER BY {4} LIMIT {5}) ORDER BY {4} LIMIT {5}",
+            REPLAY_INFO_COLUMNS, REPLAY_TABLE, REPLAY_ARCHIVE_TABLE, where, orderBy, limit);
+    }
+
+    // fields from REPLAY_INFO_COLUMNS at offset; gossipText is left for FormatReplayGossipText
+    ReplayInfo ReadReplayInfo(Field* fields, size_t offset = 0)
+    {
+        ReplayInfo info;
+        info.matchId = fields[offset].Get<uint32>();
+        info.arenaTypeId = uint8(fields[offset + 1].Get<uint32>());
+        info.winnerTeamName = fields[offset + 2].Get<std::string>();
+        info.winnerTeamRating = fields[offset + 3].Get<uint32>();
+        info.loserTeamName = fields[offset + 4].Get<std::string>();
+        info.loserTeamRating = fields[offset + 5].Get<uint32>();
+        info.timesWatched = fields[offset + 6].Get<uint32>();
+        info.timestamp = fields[offset + 7].Get<uint64>();
+        return info;
+    }
+
+    std::string GetClassIconById(uint8 id)
+    {
+        switch (id)
+        {
+        case CLASS_WARRIOR:
+            return "|TInterface\\icons\\inv_sword_27";
+        case CLASS_PALADIN:
+            return "|TInterface\\icons\\inv_hammer_01";
+        case CLASS_HUNTER:
+            return "|TInterface\\icons\\inv_weapon_bow_07";
+        case CLASS_ROGUE:
+            return "|TInterface\\icons\\inv_throwingknife_04";
+        case CLASS_PRIEST:
+            return "|TInterface\\icons\\inv_staff_30";
+        case CLASS_DEATH_KNIGHT:
+            return "|TInterface\\icons\\spell_deathknight_classicon";
+        case CLASS_SHAMAN:
+            return "|TInterface\\icons\\inv_jewelry_talisman_04";
+        case CLASS_MAGE:
+            return "|TInterface\\icons\\inv_staff_13";
+        case CLASS_WARLOCK:
+            return "|TInterface\\icons\\spell_nature_drowsy";
+        case CLASS_DRUID:
+            return "|TInterface\\icons\\inv_misc_monsterclaw_04";
+        default:
+            return "";
+        }
+    }
+
+    std::string GetRaceIconById(uint8 id, uint8 gender) {
+        const std::string gender_icon = gender == GENDER_MALE ? "male" : "female";
+        switch (id) {
+        case RACE_HUMAN:
+            return "|TInterface/ICONS/achievement_character_human_" + gender_icon;
+        case RACE_ORC:
+            return "|TInterface/ICONS/achievement_character_orc_" + gender_icon;
+        case RACE_DWARF:
+            return "|TInterface/ICONS/achievement_character_dwarf_" + gender_icon;
+        case RACE_NIGHTELF:
+            return "|TInterface/ICONS/achievement_character_nightelf_" + gender_icon;
+        case RACE_UNDEAD_PLAYER:
+            return "|TInterface/ICONS/achievement_character_undead_" + gender_icon;
+        case RACE_TAUREN:
+            return "|TInterface/ICONS/achievement_character_tauren_" + gender_icon;
+        case RACE_GNOME:
+            return "|TInterface/ICONS/achievement_character_gnome_" + gender_icon;
+        case RACE_TROLL:
+            return "|TInterface/ICONS/achievement_character_troll_" + gender_icon;
+        case RACE_BLOODELF:
+            return "|TInterface/ICONS/achievement_character_bloodelf_" + gender_icon;
+        case RACE_DRAENEI:
+            return "|TInterface/ICONS/achievement_character_draenei_" + gender_icon;
+        default:
+            return "";
+        }
+    }
+
+    // Winners and losers of a replay, each ordered by guid.
+    struct ReplayRoster
+    {
+        std::vector<ReplayParticipant> winners;
+        std::vector<ReplayParticipant> losers;
+    };
+
+    std::unordered_map<uint32, ReplayRoster> LoadReplayRosters(std::vector<uint32> const& replayIds)
+    {
+        std::unordered_map<uint32, ReplayRoster> rosters;
+        if (replayIds.empty())
+            return rosters;
+
+        std::string idList;
+        for (uint32 replayId : replayIds)
+        {
+            if (!idList.empty())
+                idList += ", ";
+
+            idList += std::to_string(replayId);
+        }
+
+        QueryResult result = CharacterDatabase.Query("SELECT replay_id, team, player_guid, name, class, race, gender FROM character_arena_replay_participants "
+            "WHERE replay_id IN ({}) ORDER BY replay_id, player_guid", idList);
+        if (!result)
+            return rosters;
+
+        do
+        {
+            Field* fields = result->Fetch();
+            ReplayRoster& roster = rosters[fields[0].Get<uint32>()];
+            bool winner = fields[1].Get<uint8>() == 0;
+            ReplayParticipant participant{ fields[2].Get<uint32>(), fields[3].Get<std::string>(), winner ? TEAM_ALLIANCE : TEAM_HORDE,
+                fields[4].Get<uint8>(), fields[5].Get<uint8>(), fields[6].Get<uint8>() };
+            (winner ? roster.winners : roster.losers).push_back(std::move(participant));
+        } while (result->NextRow());
+
+        return rosters;
+    }
+
+    std::string FormatRosterIcons(std::vector<ReplayParticipant> const& side)
+    {
+        std::string icons;
+        for (ReplayParticipant const& participant : side)
+        {
+            // deleted characters were backfilled without class and race
+            if (!participant.playerClass)
+                continue;
+
+            icons += GetClassIconById(participant.playerClass) + ":14:14:05:00|t|r";
+            icons += GetRaceIconById(participant.race, participant.gender) + ":14:14:05:00|t|r ";
+        }
+
+        return icons;
+    }
+
+    std::string FormatRosterNames(std::vector<ReplayParticipant> const& side)
+    {
+        std::string names;
+        for (ReplayParticipant const& participant : side)
+        {
+            if (participant.name.empty())
+                continue;
+
+            if (!names.empty())
+                names += " ";
+
+            names += participant.name;
+        }
+
+        return names;
+    }
+
+    std::string FormatReplayGossipText(ReplayInfo const& info, ReplayRoster const& roster)
+    {
+        return "[" + std::to_string(info.matchId) + "] (" +
+            std::to_string(info.winnerTeamRating) + ")" +
+            FormatRosterIcons(roster.winners) +
+            " '|cff33691E" + info.winnerTeamName + "|r'" +
+            "\n vs (" + std::to_string(info.loserTeamRating) + ")" +
+            FormatRosterIcons(roster.losers) +
+            " '" + info.loserTeamName + "'";
+    }
+
+    enum ReplayListKind : uint8
+    {
+        REPLAY_LIST_TOP_RATED = 1,
+        REPLAY_LIST_LATEST = 2,
+        REPLAY_LIST_MOST_WATCHED = 3,
+        REPLAY_LIST_SAVED = 4
+    };
+
+    constexpr size_t REPLAY_PAGE_SIZE = 20;
+    constexpr size_t REPLAY_MOST_WATCHED_PAGE_SIZE = 28;
+    constexpr size_t REPLAY_SAVED_PAGE_SIZE = 29;
+
+    size_t ReplayListPageSize(uint8 list)
+    {
+        switch (list)
+        {
+        case REPLAY_LIST_MOST_WATCHED:
+            return REPLAY_MOST_WATCHED_PAGE_SIZE;
+        case REPLAY_LIST_SAVED:
+            return REPLAY_SAVED_PAGE_SIZE;
+        default:
+            return REPLAY_PAGE_SIZE;
+        }
+    }
+
+    // Keyset cursor of a "Next Page" gossip item: the list, its arena type,
+    // and the sort key (rating or watch count) and id of the last row shown,
+    // so the next page is a range read from that row on, as cheap at page
+    // 1000 as at page 2. The whole cursor does not fit the item's sender and
+    // action, so the gossip keeps it per player and the item only carries
+    // REPLAY_NEXT_PAGE_SENDER.
+    struct ReplayPageCursor
+    {
+        uint8 list = 0;
+        uint8 arenaTypeId = 0;
+        uint32 key = 0;
+        uint32 lastId = 0;
+    };
+
+    constexpr uint32 REPLAY_NEXT_PAGE_SENDER = GOSSIP_SENDER_MAIN + 1;
+
+    ReplayPageCursor ReplayPageCursorAfter(uint8 list, uint8 arenaTypeId, ReplayInfo const& last)
+    {
+        ReplayPageCursor cursor;
+        cursor.list = list;
+        cursor.arenaTypeId = arenaTypeId;
+        cursor.key = list == REPLAY_LIST_TOP_RATED ? last.winnerTeamRating : list == REPLAY_LIST_MOST_WATCHED ? last.timesWatched : 0;
+        cursor.lastId = last.matchId;
+        return cursor;
+    }
+
+    // Rows of REPLAY_INFO_COLUMNS, in query order, without their gossip texts.
+    std::vector<ReplayInfo> ReadReplayInfoRows(QueryResult result)
+    {
+        std::vector<ReplayInfo> infos;
+        if (!result)
+            return infos;
+
+        do
+        {
+            infos.push_back(ReadReplayInfo(result->Fetch()));
+        } while (result->NextRow());
+
+        return infos;
+    }
+
+    void FormatReplayGossipTexts(std::vector<ReplayInfo>& infos)
+    {
+        std::vector<uint32> replayIds;
+        for (ReplayInfo const& info : infos)
+            replayIds.push_back(info.matchId);
+
+        std::unordered_map<uint32, ReplayRoster> rosters = LoadReplayRosters(replayIds);
+        for (ReplayInfo& info : infos)
+            info.gossipText = FormatReplayGossipText(info, rosters[info.matchId]);
+    }
+
+    // Rows of REPLAY_INFO_COLUMNS, in query order, with their gossip texts.
+    std::vector<ReplayInfo> ReadReplayInfos(QueryResult result)
+    {
+        std::vector<ReplayInfo> infos = ReadReplayInfoRows(result);
+        FormatReplayGossipTexts(infos);
+        return infos;
+    }
+
+    // The top rated or latest rows after the cursor, in the same order as the
+    // leaderboards. Each query is a range scan of one of the indexes from
+    // replayarena_05_list_indexes.sql, on both tables.
+    std::vector<ReplayInfo> LoadReplayListPage(ReplayPageCursor const& cursor, size_t limit)
+    {
+        uint32 key = cursor.key;
+        QueryResult result;
+        switch (cursor.list)
+        {
+        case REPLAY_LIST_TOP_RATED:
+            result = CharacterDatabase.Query(ReplayInfoQuery(Acore::StringFormat("arenaTypeId = {} AND (winnerTeamRating < {} OR (winnerTeamRating = {} AND id < {}))",
+                cursor.arenaTypeId, key, key, cursor.lastId), "winnerTeamRating DESC, id DESC", limit));
+            break;
+        case REPLAY_LIST_LATEST:
+            result = CharacterDatabase.Query(ReplayInfoQuery(Acore::StringFormat("arenaTypeId = {} AND id < {} AND timestamp >= NOW() - INTERVAL 30 DAY",
+                cursor.arenaTypeId, cursor.lastId), "id DESC", limit));
+            break;
+        default:
+            break;
+        }
+
+        return ReadReplayInfos(result);
+    }
+
+    // one row past the first page, which tells whether there is a next one
+    constexpr size_t LEADERBOARD_TOP_RATED = REPLAY_PAGE_SIZE + 1;
+    constexpr size_t LEADERBOARD_LATEST = REPLAY_PAGE_SIZE + 1;
+    constexpr size_t LEADERBOARD_MOST_WATCHED = REPLAY_MOST_WATCHED_PAGE_SIZE + 1;
+    constexpr uint64 LEADERBOARD_LATEST_MAX_AGE = 30 * DAY;
+
+    // The replay lists of the gossip menu (top rated and latest per arena
+    // type, most watched), seeded from the DB at startup and after expired
+    // replays are dropped, and kept current by saves and watches in between.
+    class ReplayLeaderboards
+    {
+    public:
+        static ReplayLeaderboards& Instance()
+        {
+            static ReplayLeaderboards instance;
+            return instance;
+        }
+
+        void Seed()
+        {
+            std::unordered_map<uint8, std::vector<ReplayInfo>> topRated;
+            std::unordered_map<uint8, std::vector<ReplayInfo>> latest;
+            std::vector<ReplayInfo> mostWatched;
+
+            if (QueryResult result = CharacterDatabase.Query("SELECT {} FROM (SELECT {}, ROW_NUMBER() OVER (PARTITION BY arenaTypeId ORDER BY winnerTeamRating DESC, id DESC) AS place "
+                "FROM {}) ranked WHERE place <= {}", REPLAY_INFO_COLUMNS, REPLAY_INFO_SOURCE_COLUMNS, ReplayInfoSource(), LEADERBOARD_TOP_RATED))
+            {
+                do
+                {
+                    ReplayInfo info = ReadReplayInfo(result->Fetch());
+                    topRated[info.arenaTypeId].push_back(std::move(info));
+                } while (result->NextRow());
+            }
+
+            if (QueryResult result = CharacterDatabase.Query("SELECT {} FROM (SELECT {}, ROW_NUMBER() OVER (PARTITION BY arenaTypeId ORDER BY id DESC) AS place "
+                "FROM {} WHERE timestamp >= NOW() - INTERVAL 30 DAY) ranked WHERE place <= {}", REPLAY_INFO_COLUMNS, REPLAY_INFO_SOURCE_COLUMNS, ReplayInfoSource(), LEADERBOARD_LATEST))
+            {
+                do
+                {
+                    ReplayInfo info = ReadReplayInfo(result->Fetch());
+                    latest[info.arenaTypeId].push_back(std::move(info));
+                } while (result->NextRow());
+            }
+
+            if (QueryResult result = CharacterDatabase.Query(ReplayInfoQuery("1", "timesWatched DESC, id DESC", LEADERBOARD_MOST_WATCHED)))
+            {
+                do
+                {
+                    mostWatched.push_back(ReadReplayInfo(result->Fetch()));
+                } while (result->NextRow());
+            }
+
+            std::vector<uint32> replayIds;
+            auto collectIds = [&replayIds](std::vector<ReplayInfo> const& infos)
+            {
+                for (ReplayInfo const& info : infos)
+                    replayIds.push_back(info.matchId);
+            };
+
+            for (auto const& [arenaTypeId, infos] : topRated)
+                collectIds(infos);
+
+            for (auto const& [arenaTypeId, infos] : latest)
+                collectIds(infos);
+
+            collectIds(mostWatched);
+            std::sort(replayIds.begin(), replayIds.end());
+            replayIds.erase(std::unique(replayIds.begin(), replayIds.end()), replayIds.end());
+
+            std::unordered_map<uint32, ReplayRoster> rosters = LoadReplayRosters(replayIds);
+            auto formatTexts = [&rosters](std::vector<ReplayInfo>& infos)
+            {
+                for (ReplayInfo& info : infos)
+                    info.gossipText = FormatReplayGossipText(info, rosters[info.matchId]);
+            };
+
+            for (auto& [arenaTypeId, infos] : topRated)
+                formatTexts(infos);
+
+            for (auto& [arenaTypeId, infos] : latest)
+                formatTexts(infos);
+
+            formatTexts(mostWatched);
+
+            for (auto& [arenaTypeId, infos] : topRated)
+                std::sort(infos.begin(), infos.end(), HigherRated);
+
+            for (auto& [arenaTypeId, infos] : latest)
+                std::sort(infos.begin(), infos.end(), Newer);
+
+            std::sort(mostWatched.begin(), mostWatched.end(), MoreWatched);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _topRated = std::move(topRated);
+            _latest = std::move(latest);
+            _mostWatched = std::move(mostWatched);
+        }
+
+        void OnSaved(ReplayInfo const& info)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            Insert(_topRated[info.arenaTypeId], info, HigherRated, LEADERBOARD_TOP_RATED);
+            Insert(_latest[info.arenaTypeId], info, Newer, LEADERBOARD_LATEST);
+            Insert(_mostWatched, info, MoreWatched, LEADERBOARD_MOST_WATCHED);
+        }
+
+        // info.timesWatched is the count after this watch
+        void OnWatched(ReplayInfo const& info)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            Insert(_mostWatched, info, MoreWatched, LEADERBOARD_MOST_WATCHED);
+        }
+
+        std::vector<ReplayInfo> TopRated(uint8 arenaTypeId) const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto itr = _topRated.find(arenaTypeId);
+            return itr != _topRated.end() ? itr->second : std::vector<ReplayInfo>();
+        }
+
+        std::vector<ReplayInfo> Latest(uint8 arenaTypeId) const
+        {
+            uint64 since = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() - LEADERBOARD_LATEST_MAX_AGE;
+            std::vector<ReplayInfo> infos;
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto itr = _latest.find(arenaTypeId);
+            if (itr != _latest.end())
+                std::copy_if(itr->second.begin(), itr->second.end(), std::back_inserter(infos), [since](ReplayInfo const& info) { return info.timestamp >= since; });
+
+            return infos;
+        }
+
+        std::vector<ReplayInfo> MostWatched() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _mostWatched;
+        }
+
+    private:
+        static bool HigherRated(ReplayInfo const& left, ReplayInfo const& right)
+        {
+            return left.winnerTeamRating != right.winnerTeamRating ? left.winnerTeamRating > right.winnerTeamRating : left.matchId > right.matchId;
+        }
+
+        static bool Newer(ReplayInfo const& left, ReplayInfo const& right) { return left.matchId > right.matchId; }
+
+        static bool MoreWatched(ReplayInfo const& left, ReplayInfo const& right)
+        {
+            return left.timesWatched != right.timesWatched ? left.timesWatched > right.timesWatched : left.matchId > right.matchId;
+        }
+
+        template <typename Compare>
+        static void Insert(std::vector<ReplayInfo>& infos, ReplayInfo const& info, Compare compare, size_t limit)
+        {
+            std::erase_if(infos, [&info](ReplayInfo const& entry) { return entry.matchId == info.matchId; });
+            infos.insert(std::upper_bound(infos.begin(), infos.end(), info, compare), info);
+            if (infos.size() > limit)
+                infos.resize(limit);
+        }
+
+        mutable std::mutex _mutex;
+        std::unordered_map<uint8, std::vector<ReplayInfo>> _topRated;
+        std::unordered_map<uint8, std::vector<ReplayInfo>> _latest;
+        std::vector<ReplayInfo> _mostWatched;
+    };
+
+    // Watches not stored yet, per replay. A flush adds them to the stored
+    // counts with one UPDATE per table, so concurrent viewers never overwrite
+    // each other's increment. Both tables are updated: a favorite is in the
+    // archive and, until its week is dropped, in the replay table too.
+    class ReplayWatchCounter
+    {
+    public:
+        static ReplayWatchCounter& Instance()
+        {
+            static ReplayWatchCounter instance;
+            return instance;
+        }
+
+        ~ReplayWatchCounter()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+
+            _wake.notify_all();
+            if (_writer.joinable())
+                _writer.join();
+        }
+
+        // returns the watches of the replay not stored yet, this one included
+        uint32 Add(uint32 replayId)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            uint32 count = ++_pending[replayId];
+            auto itr = _writing.find(replayId);
+            return itr != _writing.end() ? count + itr->second : count;
+        }
+
+        // The write runs on the counter's writer thread, and Add keeps
+        // counting the watches being written until it is done, so a count
+        // read from the DB meanwhile does not drop them. A flush while the
+        // last write still runs leaves the watches for the next one. direct
+        // waits for that write and writes on the calling thread, for the
+        // flush at shutdown.
+        void Flush(bool direct = false)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (direct)
+                _wake.wait(lock, [this]() { return !_writingInProgress; });
+            else if (_writingInProgress)
+                return;
+
+            if (_pending.empty())
+                return;
+
+            _writing.swap(_pending);
+            _writingInProgress = true;
+            if (direct)
+            {
+                lock.unlock();
+                Write();
+                lock.lock();
+                _writingInProgress = false;
+                return;
+            }
+
+            if (!_writer.joinable())
+                _writer = std::thread(&ReplayWatchCounter::Run, this);
+
+            lock.unlock();
+            _wake.notify_all();
+        }
+
+        // the watches not stored yet, per replay
+        std::unordered_map<uint32, uint32> Unstored()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::unordered_map<uint32, uint32> unstored = _writing;
+            for (auto const& [replayId, count] : _pending)
+                unstored[replayId] += count;
+
+            return unstored;
+        }
+
+    private:
+        void Run()
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true)
+            {
+                _wake.wait(lock, [this]() { return _writingInProgress || _stop; });
+                if (!_writingInProgress)
+                    return;
+
+                lock.unlock();
+                Write();
+                lock.lock();
+                _writingInProgress = false;
+                _wake.notify_all();
+            }
+        }
+
+        void Write()
+        {
+            std::string cases;
+            std::string ids;
+            for (auto const& [replayId, count] : _writing)
+            {
+                cases += Acore::StringFormat(" WHEN {} THEN {}", replayId, count);
+                if (!ids.empty())
+                    ids += ", ";
+
+                ids += std::to_string(replayId);
+            }
+
+            CharacterDatabaseTransaction trans = CharacterDatabase.BeginTransaction();
+            for (char const* table : { REPLAY_TABLE, REPLAY_ARCHIVE_TABLE })
+                trans->Append("UPDATE {} SET timesWatched = timesWatched + CASE id{} ELSE 0 END WHERE id IN ({})", table, cases, ids);
+
+            CharacterDatabase.DirectCommitTransaction(trans);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _writing.clear();
+        }
+
+        std::mutex _mutex;
+        std::unordered_map<uint32, uint32> _pending;
+        std::unordered_map<uint32, uint32> _writing; // swapped out of _pending, until they are stored
+        std::condition_variable _wake;
+        bool _writingInProgress = false;
+        bool _stop = false;
+        std::thread _writer;
+    };
+
+    // The most watched rows after the cursor, ranked like the leaderboard by
+    // the stored count plus the watches not stored yet. The few replays with
+    // unstored watches are read by id and ranked here, the others come from
+    // the range scan of idx_watched.
+    std::vector<ReplayInfo> LoadMostWatchedPage(ReplayPageCursor const& cursor, size_t limit)
+    {
+        auto after = [&cursor](ReplayInfo const& info)
+        {
+            return info.timesWatched < cursor.key || (info.timesWatched == cursor.key && info.matchId < cursor.lastId);
+        };
+
+        std::unordered_map<uint32, uint32> unstored = ReplayWatchCounter::Instance().Unstored();
+        std::string unstoredIds;
+        for (auto const& [replayId, count] : unstored)
+        {
+            if (!unstoredIds.empty())
+                unstoredIds += ", ";
+
+            unstoredIds += std::to_string(replayId);
+        }
+
+        std::string where = Acore::StringFormat("(timesWatched < {} OR (timesWatched = {} AND id < {}))", cursor.key, cursor.key, cursor.lastId);
+        if (!unstoredIds.empty())
+            where += Acore::StringFormat(" AND id NOT IN ({})", unstoredIds);
+
+        std::vector<ReplayInfo> infos = ReadReplayInfoRows(CharacterDatabase.Query(ReplayInfoQuery(where, "timesWatched DESC, id DESC", limit)));
+        if (!unstoredIds.empty())
+        {
+            for (ReplayInfo& info : ReadReplayInfoRows(CharacterDatabase.Query(ReplayInfoQuery(Acore::StringFormat("id IN ({})", unstoredIds), "id DESC", unstored.size()))))
+            {
+                info.timesWatched += unstored[info.matchId];
+                if (after(info))
+                    infos.push_back(std::move(info));
+            }
+
+            std::sort(infos.begin(), infos.end(), [](ReplayInfo const& left, ReplayInfo const& right)
+            {
+                return left.timesWatched != right.timesWatched ? left.timesWatched > right.timesWatched : left.matchId > right.matchId;
+            });
+
+            if (infos.size() > limit)
+                infos.resize(limit);
+        }
+
+        FormatReplayGossipTexts(infos);
+        return infos;
+    }
+
+    constexpr size_t REPLAY_FILTER_RESULTS = 20; // replays listed by .replay search and the NPC's "Search replays"
+    constexpr uint64 REPLAY_SEARCH_COMMIT_GRACE = 10 * MINUTE; // how long a save's row may take to commit, at worst
+    constexpr uint32 REPLAY_SEARCH_BUILD_CHUNK = 50000;
+    constexpr char const* REPLAY_SEARCH_COLUMNS = "id, arenaTypeId, mapId, winnerTeamRating, UNIX_TIMESTAMP(timestamp), duration";
+    constexpr size_t REPLAY_SEARCH_CLASS_COUNT = 16;
+
+    // class letters of the composition filter, indexed by class id
+    constexpr std::string_view REPLAY_CLASS_LETTERS = "-WAHRPKSML-D";
+
+    // Filters of .replay search and the gossip search; unset ones match everything.
+    struct ReplaySearchQuery
+    {
+        std::optional<uint8> arenaTypeId;
+        std::optional<uint32> mapId;
+        uint32 minRating = 0; // winner team rating
+        uint32 maxRating = std::numeric_limits<uint32>::max();
+        uint64 since = 0;
+        uint32 minDuration = 0; // seconds
+        uint32 maxDuration = std::numeric_limits<uint32>::max();
+        std::array<uint16, 2> composition{}; // classes the two sides must have, in either order; 0 is any
+
+        bool FiltersDuration() const { return minDuration || maxDuration != std::numeric_limits<uint32>::max(); }
+    };
+
+    struct ReplaySearchRow
+    {
+        uint32 id = 0;
+        uint32 mapId = 0;
+        uint32 winnerTeamRating = 0;
+        uint32 duration = 0; // seconds, start delay included; 0 for replays saved before it was stored
+        uint64 timestamp = 0;
+        uint16 winnerClasses = 0;
+        uint16 loserClasses = 0;
+        uint8 arenaTypeId = 0;
+    };
+
+    uint16 ReplayClassBit(uint8 playerClass)
+    {
+        return playerClass < REPLAY_SEARCH_CLASS_COUNT ? uint16(1u << playerClass) : 0;
+    }
+
+    std::string FormatReplayClassLetters(uint16 classes)
+    {
+        std::string letters;
+        for (size_t playerClass = 1; playerClass < REPLAY_CLASS_LETTERS.size(); ++playerClass)
+            if (classes & ReplayClassBit(playerClass))
+                letters += REPLAY_CLASS_LETTERS[playerClass];
+
+        return letters.empty() ? "?" : letters;
+    }
+
+    bool ParseReplayClassLetters(std::string_view letters, uint16& classes)
+    {
+        classes = 0;
+        if (letters == "any")
+            return true;
+
+        for (char letter : letters)
+        {
+            size_t playerClass = REPLAY_CLASS_LETTERS.find(char(std::toupper(static_cast<unsigned char>(letter))));
+            if (!playerClass || playerClass == std::string_view::npos)
+                return false;
+
+            classes |= ReplayClassBit(playerClass);
+        }
+
+        return !letters.empty();
+    }
+
+    bool ParseReplaySearchNumber(std::string_view text, uint32& value)
+    {
+        auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return ec == std::errc() && end == text.data() + text.size();
+    }
+
+    // "1800-2200", "1800-" or "-2200"; a single number is an exact value
+    bool ParseReplaySearchRange(std::string_view text, uint32& min, uint32& max)
+    {
+        size_t dash = text.find('-');
+        if (dash == std::string_view::npos)
+            return ParseReplaySearchNumber(text, min) && ParseReplaySearchNumber(text, max);
+
+        std::string_view low = text.substr(0, dash);
+        std::string_view high = text.substr(dash + 1);
+        if (low.empty() && high.empty())
+            return false;
+
+        return (low.empty() || ParseReplaySearchNumber(low, min)) && (high.empty() || ParseReplaySearchNumber(high, max)) && min <= max;
+    }
+
+    // Space separated key=value filters, e.g. "bracket=3v3 comp=rmp-any rating=2200- days=7".
+    // The gossip code box refuses commas, so the two sides of comp are split by '-'.
+    bool ParseReplaySearchQuery(std::string_view text, ReplaySearchQuery& query, std::string& error)
+    {
+        std::string lowered(text);
+        std::transform(lowered.begin(), lowered.end(), lowered.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        std::string_view rest = lowered;
+        while (!rest.empty())
+        {
+            size_t space = rest.find(' ');
+            std::string_view token = rest.substr(0, space);
+            rest = space == std::string_view::npos ? std::string_view() : rest.substr(space + 1);
+            if (token.empty())
+                continue;
+
+            size_t equals = token.find('=');
+            std::string_view key = token.substr(0, equals);
+            std::string_view value = equals == std::string_view::npos ? std::string_view() : token.substr(equals + 1);
+            bool valid = false;
+            if (key == "bracket")
+            {
+                if (value.size() == 3 && value[1] == 'v' && value[0] == value[2])
+                    value = value.substr(0, 1);
+
+                uint32 arenaTypeId = 0;
+                valid = ParseReplaySearchNumber(value, arenaTypeId) && arenaTypeId && arenaTypeId <= 0xF;
+                query.arenaTypeId = uint8(arenaTypeId);
+            }
+            else if (key == "map")
+            {
+                uint32 mapId = 0;
+                valid = ParseReplaySearchNumber(value, mapId);
+                query.mapId = mapId;
+            }
+            else if (key == "rating")
+                valid = ParseReplaySearchRange(value, query.minRating, query.maxRating);
+            else if (key == "duration")
+                valid = ParseReplaySearchRange(value, query.minDuration, query.maxDuration);
+            else if (key == "days")
+            {
+                uint32 days = 0;
+                valid = ParseReplaySearchNumber(value, days) && days;
+                uint64 now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                query.since = now - std::min<uint64>(now, uint64(days) * DAY);
+            }
+            else if (key == "comp")
+            {
+                size_t dash = value.find('-');
+                valid = ParseReplayClassLetters(value.substr(0, dash), query.composition[0]) &&
+                    (dash == std::string_view::npos || ParseReplayClassLetters(value.substr(dash + 1), query.composition[1]));
+            }
+            else
+            {
+                error = Acore::StringFormat("Unknown filter '{}', expected bracket, map, rating, days, duration or comp.", token);
+                return false;
+            }
+
+            if (!valid)
+            {
+                error = Acore::StringFormat("Invalid filter '{}'.", token);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // In-memory index of the live replays for the multi-criteria search: the
+    // searchable columns of every replay, plus one bitmap over the row
+    // positions per arena type, map and class. A search ANDs the bitmaps of
+    // its equality filters and walks the set bits from the newest row down,
+    // checking the ranges and which side has which classes on each candidate,
+    // until it has enough results. Built from the DB in id ranges on its own
+    // thread at startup and after expired weeks are dropped. Saves are
+    // appended as they happen, in the order they were made, which is the id
+    // order of this server; the next build sorts in the ids other servers
+    // handed out meanwhile.
+    class ReplaySearchIndex
+    {
+    public:
+        static ReplaySearchIndex& Instance()
+        {
+            static ReplaySearchIndex instance;
+            return instance;
+        }
+
+        ~ReplaySearchIndex() { Stop(); }
+
+        bool Building() const { return _running; }
+
+        bool Start()
+        {
+            if (_running)
+                return false;
+
+            if (_thread.joinable())
+                _thread.join();
+
+            _running = true;
+            _stop = false;
+            _thread = std::thread([this]()
+            {
+                Build();
+                _running = false;
+            });
+            return true;
+        }
+
+        void Stop()
+        {
+            _stop = true;
+            if (_thread.joinable())
+                _thread.join();
+        }
+
+        // Replaces the index with one read from the DB, over the same
+        // replays as the lists: the replay table plus the favorites only left
+        // in the archive. The recent saves are merged in, whichever chunk
+        // their commit raced, also those made just before the build started
+        // whose rows were not committed yet.
+        void Build()
+        {
+            std::lock_guard<std::mutex> buildLock(_buildMutex);
+            auto start = std::chrono::steady_clock::now();
+            std::vector<ReplaySearchRow> rows;
+            uint32 lastId = 0;
+            while (!_stop)
+            {
+                // each table is ordered and limited on its own, like ReplayInfoQuery
+                QueryResult result = CharacterDatabase.Query("(SELECT {0} FROM {1} WHERE id > {3} ORDER BY id LIMIT {4}) UNION ALL "
+                    "(SELECT {0} FROM {2} WHERE id > {3} AND id NOT IN (SELECT id FROM {1}) ORDER BY id LIMIT {4}) ORDER BY id LIMIT {4}",
+                    REPLAY_SEARCH_COLUMNS, REPLAY_TABLE, REPLAY_ARCHIVE_TABLE, lastId, REPLAY_SEARCH_BUILD_CHUNK);
+                if (!result)
+                    break;
+
+                size_t first = rows.size();
+                ReadRows(result, rows);
+                lastId = rows.back().id;
+                LoadClasses(rows, first);
+                if (rows.size() - first < REPLAY_SEARCH_BUILD_CHUNK)
+                    break;
+            }
+
+            if (_stop)
+                return;
+
+            Table table;
+            table.rows = std::move(rows);
+            table.built = table.rows.size();
+            table.Reindex();
+
+            std::unique_lock<std::shared_mutex> lock(_mutex);
+            for (ReplaySearchRow const& row : _recentAdds)
+                if (!table.Contains(row.id))
+                    table.Append(row);
+
+            _table = std::move(table);
+            LOG_INFO("modules", "ArenaReplay: search index built over {} replays in {} ms",
+                _table.rows.size(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        void Add(ReplaySearchRow const& row)
+        {
+            std::unique_lock<std::shared_mutex> lock(_mutex);
+            while (!_recentAdds.empty() && _recentAdds.front().timestamp + REPLAY_SEARCH_COMMIT_GRACE < row.timestamp)
+                _recentAdds.pop_front();
+
+            _recentAdds.push_back(row);
+            _table.Append(row);
+        }
+
+        // A favorite just copied to the archive. Its replay is normally
+        // indexed already; when it is not, it is read from the replay table,
+        // which still has it, so it stays searchable once its week is dropped.
+        void AddFavorite(uint32 replayId)
+        {
+            {
+                std::shared_lock<std::shared_mutex> lock(_mutex);
+                if (_table.Contains(replayId))
+                    return;
+            }
+
+            std::vector<ReplaySearchRow> rows;
+            ReadRows(CharacterDatabase.Query("SELECT {} FROM {} WHERE id = {}", REPLAY_SEARCH_COLUMNS, REPLAY_TABLE, replayId), rows);
+            if (rows.empty())
+                return;
+
+            LoadClasses(rows, 0);
+            std::unique_lock<std::shared_mutex> lock(_mutex);
+            if (!_table.Contains(replayId))
+                _table.Append(rows.front());
+        }
+
+        size_t Size() const
+        {
+            std::shared_lock<std::shared_mutex> lock(_mutex);
+            return _table.rows.size();
+        }
+
+        // newest first; candidates is the number of rows that passed the bitmaps
+        std::vector<ReplaySearchRow> Search(ReplaySearchQuery const& query, size_t limit, size_t* candidates = nullptr) const
+        {
+            std::vector<ReplaySearchRow> results;
+            std::vector<Bitmap const*> bitmaps;
+            size_t checked = 0;
+
+            std::shared_lock<std::shared_mutex> lock(_mutex);
+            if (query.arenaTypeId)
+            {
+                auto itr = _table.byArenaType.find(*query.arenaTypeId);
+                if (itr == _table.byArenaType.end())
+                    return results;
+
+                bitmaps.push_back(&itr->second);
+            }
+
+            if (query.mapId)
+            {
+                auto itr = _table.byMap.find(*query.mapId);
+                if (itr == _table.byMap.end())
+                    return results;
+
+                bitmaps.push_back(&itr->second);
+            }
+
+            for (uint16 classes = query.composition[0] | query.composition[1]; classes; classes &= classes - 1)
+                bitmaps.push_back(&_table.byClass[std::countr_zero(classes)]);
+
+            size_t rowCount = _table.rows.size();
+            size_t words = (rowCount + 63) / 64;
+            for (size_t word = words; word-- > 0 && results.size() < limit;)
+            {
+                uint64 bits = word == words - 1 && rowCount % 64 ? (uint64(1) << (rowCount % 64)) - 1 : ~uint64(0);
+                for (Bitmap const* bitmap : bitmaps)
+                    bits &= word < bitmap->size() ? (*bitmap)[word] : 0;
+
+                while (bits && results.size() < limit)
+                {
+                    size_t bit = 63 - std::countl_zero(bits);
+                    bits &= ~(uint64(1) << bit);
+                    ReplaySearchRow const& row = _table.rows[word * 64 + bit];
+                    ++checked;
+                    if (Matches(row, query))
+                        results.push_back(row);
+                }
+            }
+
+            if (candidates)
+                *candidates = checked;
+
+            return results;
+        }
+
+    private:
+        using Bitmap = std::vector<uint64>;
+
+        struct Table
+        {
+            std::vector<ReplaySearchRow> rows; // by id as built, then the saves since
+            size_t built = 0; // rows[0, built) are the ones read by the build
+            std::unordered_map<uint8, Bitmap> byArenaType;
+            std::unordered_map<uint32, Bitmap> byMap;
+            std::array<Bitmap, REPLAY_SEARCH_CLASS_COUNT> byClass; // a player of the class on either side
+
+            void Append(ReplaySearchRow const& row)
+            {
+                rows.push_back(row);
+                IndexRow(rows.size() - 1);
+            }
+
+            bool Contains(uint32 id) const
+            {
+                auto end = rows.begin() + built;
+                auto itr = std::lower_bound(rows.begin(), end, id, [](ReplaySearchRow const& entry, uint32 rowId) { return entry.id < rowId; });
+                if (itr != end && itr->id == id)
+                    return true;
+
+                return std::any_of(end, rows.end(), [id](ReplaySearchRow const& entry) { return entry.id == id; });
+            }
+
+            void Reindex()
+            {
+                byArenaType.clear();
+                byMap.clear();
+                for (Bitmap& bitmap : byClass)
+                    bitmap.clear();
+
+                for (size_t position = 0; position < rows.size(); ++position)
+                    IndexRow(position);
+            }
+
+            void IndexRow(size_t position)
+            {
+                ReplaySearchRow const& row = rows[position];
+                SetBit(byArenaType[row.arenaTypeId], position);
+                SetBit(byMap[row.mapId], position);
+                for (uint16 classes = row.winnerClasses | row.loserClasses; classes; classes &= classes - 1)
+                    SetBit(byClass[std::countr_zero(classes)], position);
+            }
+
+            static void SetBit(Bitmap& bitmap, size_t position)
+            {
+                if (bitmap.size() <= position / 64)
+                    bitmap.resize(position / 64 + 1);
+
+                bitmap[position / 64] |= uint64(1) << (position % 64);
+            }
+        };
+
+        static bool Matches(ReplaySearchRow const& row, ReplaySearchQuery const& query)
+        {
+            if (row.winnerTeamRating < query.minRating || row.winnerTeamRating > query.maxRating || row.timestamp < query.since)
+                return false;
+
+            if (query.FiltersDuration() && (!row.duration || row.duration < query.minDuration || row.duration > query.maxDuration))
+                return false;
+
+            auto has = [](uint16 side, uint16 classes) { return (side & classes) == classes; };
+            auto const& [first, second] = query.composition;
+            return (has(row.winnerClasses, first) && has(row.loserClasses, second)) ||
+                (has(row.winnerClasses, second) && has(row.loserClasses, first));
+        }
+
+        // rows of REPLAY_SEARCH_COLUMNS
+        static void ReadRows(QueryResult result, std::vector<ReplaySearchRow>& rows)
+        {
+            if (!result)
+                return;
+
+            do
+            {
+                Field* fields = result->Fetch();
+                ReplaySearchRow row;
+                row.id = fields[0].Get<uint32>();
+                row.arenaTypeId = fields[1].Get<uint8>();
+                row.mapId = fields[2].Get<uint32>();
+                row.winnerTeamRating = fields[3].Get<uint32>();
+                row.timestamp = fields[4].Get<uint64>();
+                row.duration = fields[5].Get<uint32>();
+                rows.push_back(row);
+            } while (result->NextRow());
+        }
+
+        // rows[first..] is one chunk, sorted by id
+        static void LoadClasses(std::vector<ReplaySearchRow>& rows, size_t first)
+        {
+            QueryResult result = CharacterDatabase.Query("SELECT replay_id, team, class FROM character_arena_replay_participants WHERE replay_id BETWEEN {} AND {}",
+                rows[first].id, rows.back().id);
+            if (!result)
+                return;
+
+            auto chunkBegin = rows.begin() + first;
+            do
+            {
+                Field* fields = result->Fetch();
+                uint32 replayId = fields[0].Get<uint32>();
+                auto row = std::lower_bound(chunkBegin, rows.end(), replayId, [](ReplaySearchRow const& entry, uint32 id) { return entry.id < id; });
+                if (row == rows.end() || row->id != replayId)
+                    continue;
+
+                (fields[1].Get<uint8>() ? row->loserClasses : row->winnerClasses) |= ReplayClassBit(fields[2].Get<uint8>());
+            } while (result->NextRow());
+        }
+
+        mutable std::shared_mutex _mutex;
+        Table _table;
+        std::deque<ReplaySearchRow> _recentAdds; // the saves of the last REPLAY_SEARCH_COMMIT_GRACE, for the next build
+
+        std::mutex _buildMutex;
+        std::thread _thread;
+        std::atomic<bool> _running = false;
+        std::atomic<bool> _stop = false;
+    };
+
+    constexpr int64 REPLAY_PARTITION_EPOCH = 4 * DAY; // 1970-01-05, a Monday
+    constexpr int64 REPLAY_PARTITIONS_AHEAD = 2;
+
+    // Keeps character_arena_replays split into one partition per week
+    // (Monday 00:00 UTC): adds the partitions of the coming weeks and drops
+    // the weeks older than ArenaReplay.DeleteReplaysAfterDays as a whole,
+    // after copying their favorited replays to the archive table. Runs on its
+    // own thread from the world update timer, so neither startup nor a config
+    // reload waits on the DDL.
+    class ReplayPartitionMaintainer
     {
-        if (record.participantGuids.empty())
-            return;
+    public:
+        static ReplayPartitionMaintainer& Instance()
+        {
+            static ReplayPartitionMaintainer instance;
+            return instance;
+        }
+
+        ~ReplayPartitionMaintainer() { Stop(); }
 
-        std::unordered_set<uint64> usedGuids = BuildUsedGuidSet(record);
-        std::unordered_map<uint64, uint64> remap;
-        remap.reserve(record.participantGuids.size());
-        std::unordered_map<uint64, uint8> objectTypes;
-        objectTypes.reserve(2048);
+        bool Running() const { return _running; }
 
-        for (uint64 guid : record.participantGuids)
+        bool Start()
         {
-            if (guid == 0)
-                continue;
+            if (_running)
+                return false;
 
-            if (remap.find(guid) != remap.end())
-                continue;
+            if (_thread.joinable())
+                _thread.join();
 
-            uint64 ghostGuid = GenerateGhostGuid(guid, usedGuids);
-            usedGuids.insert(ghostGuid);
-            remap.emplace(guid, ghostGuid);
+            _running = true;
+            _stop = false;
+            _thread = std::thread(&ReplayPartitionMaintainer::Run, this, sArenaReplayConfig.Get());
+            return true;
         }
 
-        for (uint64& guid : record.participantGuids)
+        void Stop()
         {
-            auto it = remap.find(guid);
-            if (it != remap.end())
-                guid = it->second;
+            _stop = true;
+            if (_thread.joinable())
+                _thread.join();
         }
 
-        record.guidRemap = std::move(remap);
+    private:
+        struct Partition
+        {
+            std::string name;
+            std::optional<int64> lessThan; // unset for the MAXVALUE partition
+        };
+
+        static int64 WeekStart(int64 time)
+        {
+            return time - (time - REPLAY_PARTITION_EPOCH) % WEEK;
+        }
 
-        LOG_INFO("modules", "ArenaReplay: remapped {} participant GUIDs ({} packets) to ghost GUIDs",
-            record.guidRemap.size(),
-            record.packets.size());
+        static std::string PartitionName(int64 weekStart)
+        {
+            std::chrono::year_month_day date{ std::chrono::floor<std::chrono::days>(std::chrono::sys_seconds{ std::chrono::seconds{ weekStart } }) };
+            return Acore::StringFormat("p{:04}{:02}{:02}", int32(date.year()), uint32(date.month()), uint32(date.day()));
+        }
 
-        for (PacketRecord& packet : record.packets)
+        static std::vector<Partition> ReadPartitions()
         {
-            auto sourceIt = record.guidRemap.find(packet.sourceGuid);
-            if (sourceIt != record.guidRemap.end())
-                packet.sourceGuid = sourceIt->second;
+            std::vector<Partition> partitions;
+            QueryResult result = CharacterDatabase.Query("SELECT PARTITION_NAME, PARTITION_DESCRIPTION FROM information_schema.PARTITIONS "
+                "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = '{}' AND PARTITION_NAME IS NOT NULL ORDER BY PARTITION_ORDINAL_POSITION", REPLAY_TABLE);
+            if (!result)
+                return partitions;
 
-            if (packet.packet.GetOpcode() == SMSG_UPDATE_OBJECT || packet.packet.GetOpcode() == SMSG_COMPRESSED_UPDATE_OBJECT)
+            do
             {
-                UpdateObjectParseStats stats;
-                size_t failureOffset = 0;
-                bool rewritten = false;
-                if (packet.packet.GetOpcode() == SMSG_UPDATE_OBJECT)
-                    rewritten = RewriteUpdateObjectPacket(packet.packet, record.guidRemap, objectTypes, stats, failureOffset);
-                else
-                    rewritten = RewriteCompressedUpdateObjectPacket(packet.packet, record.guidRemap, objectTypes, stats, failureOffset);
+                Field* fields = result->Fetch();
+                Partition partition;
+                partition.name = fields[0].Get<std::string>();
+                std::string description = fields[1].Get<std::string>();
+                int64 lessThan = 0;
+                if (std::from_chars(description.data(), description.data() + description.size(), lessThan).ec == std::errc())
+                    partition.lessThan = lessThan;
+
+                partitions.push_back(std::move(partition));
+            } while (result->NextRow());
 
-                if (rewritten)
+            return partitions;
+        }
+
+        void Run(ArenaReplayConfig config)
+        {
+            auto start = std::chrono::steady_clock::now();
+            int64 now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            std::vector<Partition> partitions = ReadPartitions();
+            if (partitions.empty())
+            {
+                if (!_unpartitionedLogged)
                 {
-                    if (record.updateObjectParseLogs < 5)
-                    {
-                        LOG_INFO("modules", "ArenaReplay: parsed update object opcode {} blocks {}/{} bytes {}",
-                            packet.packet.GetOpcode(),
-                            stats.parsedBlocks,
-                            stats.blockCount,
-                            stats.bytesConsumed);
-                        ++record.updateObjectParseLogs;
-                    }
+                    LOG_WARN("modules", "ArenaReplay: {} is not partitioned, expired replays are deleted row by row. "
+                        "Apply updates/replayarena_01_partitions.sql to expire them by dropping weekly partitions.", REPLAY_TABLE);
+                    _unpartitionedLogged = true;
+                }
 
-                    if (!record.updateObjectLeakLogged)
-                    {
-                        std::vector<uint8> buffer(packet.packet.contents(), packet.packet.contents() + packet.packet.size());
-                        std::vector<uint8> payload;
-                        bool decompressed = true;
-                        if (packet.packet.GetOpcode() == SMSG_COMPRESSED_UPDATE_OBJECT)
-                        {
-                            decompressed = Decompress(buffer, payload);
-                        }
-                        else
-                        {
-                            payload = std::move(buffer);
-                        }
+                DeleteExpiredRows(config, now);
+                DeleteExpiredParticipants();
+                ReplayLeaderboards::Instance().Seed();
+                ReplaySearchIndex::Instance().Build();
+                _running = false;
+                return;
+            }
 
-                        if (decompressed)
-                        {
-                            for (auto const& entry : record.guidRemap)
-                            {
-                                if (ContainsGuidSequences(payload, entry.first, false))
-                                {
-                                    LOG_ERROR("modules", "ArenaReplay: GUID leak detected in replay {} opcode {} guid {}",
-                                        record.replayId,
-                                        packet.packet.GetOpcode(),
-                                        entry.first);
-                                    record.updateObjectLeakLogged = true;
-                                    break;
-                                }
-                            }
-                        }
+            uint32 added = AddPartitions(partitions, now);
+            uint32 archived = 0;
+            uint32 dropped = DropExpiredPartitions(partitions, config, now, archived);
+            if (dropped)
+            {
+                DeleteExpiredParticipants();
+                ReplayLeaderboards::Instance().Seed();
+                ReplaySearchIndex::Instance().Build();
+            }
+
+            if (added || dropped)
+                LOG_INFO("modules", "ArenaReplay: replay storage maintenance added {} and dropped {} weekly partitions, {} favorites archived, in {} ms",
+                    added,
+                    dropped,
+                    archived,
+                    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+            _running = false;
+        }
+
+        // Splits the MAXVALUE partition so the current week and the next
+        // REPLAY_PARTITIONS_AHEAD ones have their own partition before any
+        // replay is saved into them.
+        uint32 AddPartitions(std::vector<Partition> const& partitions, int64 now)
+        {
+            Partition const* last = nullptr;
+            Partition const* future = nullptr;
+            for (Partition const& partition : partitions)
+            {
+                if (!partition.lessThan)
+                    future = &partition;
+                else if (!last || *partition.lessThan > *last->lessThan)
+                    last = &partition;
+            }
+
+            if (!future)
+                return 0;
+
+            std::string definitions;
+            uint32 added = 0;
+            int64 horizon = WeekStart(now) + (REPLAY_PARTITIONS_AHEAD + 1) * WEEK;
+            int64 lower = last ? *last->lessThan : WeekStart(now);
+            if (!last)
+            {
+                definitions += Acore::StringFormat("PARTITION `p0` VALUES LESS THAN ({}), ", lower);
+                ++added;
+            }
+
+            while (lower < horizon)
+            {
+                int64 upper = WeekStart(lower) + WEEK;
+                definitions += Acore::StringFormat("PARTITION `{}` VALUES LESS THAN ({}), ", PartitionName(lower), upper);
+                lower = upper;
+                ++added;
+            }
+
+            if (!added)
+                return 0;
+
+            CharacterDatabase.DirectExecute("ALTER TABLE {} REORGANIZE PARTITION `{}` INTO ({}PARTITION `{}` VALUES LESS THAN MAXVALUE)",
+                REPLAY_TABLE, future->name, definitions, future->name);
+            return added;
+        }
+
+        uint32 DropExpiredPartitions(std::vector<Partition> const& partitions, ArenaReplayConfig const& config, int64 now, uint32& archived)
+        {
+            if (!config.deleteReplaysAfterDays)
+                return 0;
+
+            int64 cutoff = now - int64(config.deleteReplaysAfterDays) * DAY;
+            uint32 dropped = 0;
+            for (Partition const& partition : partitions)
+            {
+                if (_stop || !partition.lessThan || *partition.lessThan > cutoff)
+                    continue;
+
+                if (!config.deleteSavedReplays)
+                {
+                    // favorites are archived when saved; this refreshes their watch counts and
+                    // picks up favorites saved before that
+                    CharacterDatabase.DirectExecute("REPLACE INTO {} SELECT * FROM {} PARTITION (`{}`) "
+                        "WHERE id IN (SELECT replay_id FROM character_saved_replays)", REPLAY_ARCHIVE_TABLE, REPLAY_TABLE, partition.name);
+
+                    // DirectExecute does not report failures, so check that every favorite made it before dropping the week
+                    QueryResult result = CharacterDatabase.Query("SELECT "
+                        "(SELECT COUNT(*) FROM {0} PARTITION (`{2}`) WHERE id IN (SELECT replay_id FROM character_saved_replays)), "
+                        "(SELECT COUNT(*) FROM {0} PARTITION (`{2}`) WHERE id IN (SELECT replay_id FROM character_saved_replays) AND id NOT IN (SELECT id FROM {1}))",
+                        REPLAY_TABLE, REPLAY_ARCHIVE_TABLE, partition.name);
+                    if (!result || result->Fetch()[1].Get<uint64>())
+                    {
+                        LOG_ERROR("modules", "ArenaReplay: could not archive the favorites of partition {}, keeping it", partition.name);
+                        continue;
                     }
+
+                    archived += uint32(result->Fetch()[0].Get<uint64>());
                 }
-                else if (!record.updateObjectParseWarningLogged)
+
+                CharacterDatabase.DirectExecute("ALTER TABLE {} DROP PARTITION `{}`", REPLAY_TABLE, partition.name);
+                ++dropped;
+            }
+
+            if (config.deleteSavedReplays)
+                DeleteExpiredFavorites(cutoff);
+
+            return dropped;
+        }
+
+        static void DeleteExpiredFavorites(int64 cutoff)
+        {
+            CharacterDatabase.DirectExecute("DELETE FROM {} WHERE `timestamp` < FROM_UNIXTIME({})", REPLAY_ARCHIVE_TABLE, cutoff);
+            CharacterDatabase.DirectExecute("DELETE FROM character_saved_replays WHERE replay_id NOT IN (SELECT id FROM {}) AND replay_id NOT IN (SELECT id FROM {})",
+                REPLAY_TABLE, REPLAY_ARCHIVE_TABLE);
+        }
+
+        // Replay ids grow with time, so the participants of expired replays
+        // sit below the oldest live id: a range delete on the primary key.
+        static void DeleteExpiredParticipants()
+        {
+            CharacterDatabase.DirectExecute("DELETE FROM character_arena_replay_participants WHERE replay_id < COALESCE((SELECT MIN(id) FROM {}), 4294967295) "
+                "AND replay_id NOT IN (SELECT id FROM {})", REPLAY_TABLE, REPLAY_ARCHIVE_TABLE);
+        }
+
+        // the pre-partitioning expiry, for tables that were not converted
+        static void DeleteExpiredRows(ArenaReplayConfig const& config, int64 now)
+        {
+            if (!config.deleteReplaysAfterDays)
+                return;
+
+            int64 cutoff = now - int64(config.deleteReplaysAfterDays) * DAY;
+            if (config.deleteSavedReplays)
+            {
+                CharacterDatabase.DirectExecute("DELETE FROM {} WHERE `timestamp` < FROM_UNIXTIME({})", REPLAY_TABLE, cutoff);
+                DeleteExpiredFavorites(cutoff);
+            }
+            else
+                CharacterDatabase.DirectExecute("DELETE FROM {} WHERE `timestamp` < FROM_UNIXTIME({}) AND id NOT IN (SELECT replay_id FROM character_saved_replays)",
+                    REPLAY_TABLE, cutoff);
+        }
+
+        std::thread _thread;
+        std::atomic<bool> _running = false;
+        std::atomic<bool> _stop = false;
+        bool _unpartitionedLogged = false;
+    };
+
+#ifdef ARENA_REPLAY_ZSTD
+    constexpr size_t REPLAY_DICTIONARY_CAPACITY = 112 * 1024;
+    constexpr size_t REPLAY_DICTIONARY_SAMPLE_SIZE = 8 * 1024;
+    constexpr size_t REPLAY_DICTIONARY_MIN_REPLAYS = 8;
+
+    // Trains one dictionary per arena map from its latest stored replays for
+    // .replay dict train. Every fifth replay is left out of training and used
+    // to compare the new dictionary with zlib and plain zstd; a dictionary
+    // that does not beat plain zstd there is not stored.
+    class ReplayDictionaryTrainer
+    {
+    public:
+        static ReplayDictionaryTrainer& Instance()
+        {
+            static ReplayDictionaryTrainer instance;
+            return instance;
+        }
+
+        ~ReplayDictionaryTrainer() { Stop(); }
+
+        bool Running() const { return _running; }
+
+        bool Start(uint32 replaysPerMap)
+        {
+            if (_running)
+                return false;
+
+            if (_thread.joinable())
+                _thread.join();
+
+            _running = true;
+            _stop = false;
+            _thread = std::thread(&ReplayDictionaryTrainer::Run, this, replaysPerMap);
+            return true;
+        }
+
+        void Stop()
+        {
+            _stop = true;
+            if (_thread.joinable())
+                _thread.join();
+        }
+
+    private:
+        struct CodecResult
+        {
+            uint64 original = 0;
+            uint64 compressed = 0;
+            uint64 decodeNanoseconds = 0;
+            uint32 replays = 0;
+
+            double Percent() const { return original ? 100.0 * compressed / original : 0.0; }
+            double DecodeMilliseconds() const { return replays ? decodeNanoseconds / 1e6 / replays : 0.0; }
+        };
+
+        template <typename CompressFn, typename DecompressFn>
+        static void Measure(CodecResult& result, std::vector<uint8> const& serialized, CompressFn&& compress, DecompressFn&& decompress)
+        {
+            std::vector<uint8> compressed;
+            std::vector<uint8> decoded;
+            if (!compress(serialized, compressed))
+                return;
+
+            auto start = std::chrono::steady_clock::now();
+            bool decodedOk = decompress(compressed, decoded);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            if (!decodedOk || decoded != serialized)
+                return;
+
+            result.original += serialized.size();
+            result.compressed += compressed.size();
+            result.decodeNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            ++result.replays;
+        }
+
+        // the serialized packets of a stored row, read the way a load does
+        static bool ReadSerialized(std::string stored, std::vector<uint8>& serialized)
+        {
+            ReplayContentsReader reader(std::move(stored));
+            std::deque<PacketRecord> packets;
+            while (reader.Read(packets))
+                ;
+
+            if (reader.Failed() || reader.Truncated())
+                return false;
+
+            ArenaReplayByteBuffer buffer;
+            SerializeReplayPackets(packets, buffer);
+            serialized = buffer.contentsAsVector();
+            return true;
+        }
+
+        void Run(uint32 replaysPerMap)
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<uint32> mapIds;
+            if (QueryResult result = CharacterDatabase.Query("SELECT DISTINCT mapId FROM {} WHERE mapId IS NOT NULL", REPLAY_TABLE))
+            {
+                do
                 {
-                    LOG_WARN("modules", "ArenaReplay: failed to parse update object payload for replay {} opcode {} packetSize {} offset {}",
-                        record.replayId,
-                        packet.packet.GetOpcode(),
-                        packet.packet.size(),
-                        failureOffset);
-                    record.updateObjectParseWarningLogged = true;
-                }
+                    mapIds.push_back(result->Fetch()[0].Get<uint32>());
+                } while (result->NextRow());
+            }
+
+            uint32 stored = 0;
+            for (uint32 mapId : mapIds)
+            {
+                if (_stop)
+                    break;
+
+                if (TrainMap(mapId, replaysPerMap))
+                    ++stored;
+            }
+
+            LOG_INFO("modules", "ArenaReplay: dictionary training stored {} new dictionaries for {} maps in {} ms{}",
+                stored,
+                mapIds.size(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(),
+                _stop ? ", stopped early" : "");
+
+            _running = false;
+        }
+
+        bool TrainMap(uint32 mapId, uint32 replaysPerMap)
+        {
+            std::vector<std::vector<uint8>> training;
+            std::vector<std::vector<uint8>> holdout;
+            if (QueryResult result = CharacterDatabase.Query("SELECT contents FROM {} WHERE mapId = {} ORDER BY id DESC LIMIT {}", REPLAY_TABLE, mapId, replaysPerMap))
+            {
+                size_t index = 0;
+                do
+                {
+                    std::vector<uint8> serialized;
+                    if (!ReadSerialized(result->Fetch()[0].Get<std::string>(), serialized))
+                        continue;
 
-                if (PacketContainsAnyOriginalGuid(packet.packet, record.guidRemap))
+                    (index++ % 5 == 4 ? holdout : training).push_back(std::move(serialized));
+                } while (result->NextRow() && !_stop);
+            }
+
+            if (training.size() < REPLAY_DICTIONARY_MIN_REPLAYS || holdout.empty())
+            {
+                LOG_INFO("modules", "ArenaReplay: map {} has too few replays to train a dictionary ({})", mapId, training.size() + holdout.size());
+                return false;
+            }
+
+            // zstd trains on many small samples, so the replays are cut into pieces
+            std::vector<uint8> samples;
+            std::vector<size_t> sampleSizes;
+            for (std::vector<uint8> const& serialized : training)
+            {
+                for (size_t offset = 0; offset < serialized.size(); offset += REPLAY_DICTIONARY_SAMPLE_SIZE)
                 {
-                    packet.drop = true;
-                    if (!record.guidLeakDropLogged)
-                    {
-                        for (auto const& entry : record.guidRemap)
-                        {
-                            if (PacketContainsGuid(packet.packet, entry.first))
-                            {
-                                LOG_ERROR("modules", "ArenaReplay: GUID leak detected, dropping packet replay {} opcode {} size {} ts {} guid {}",
-                                    record.replayId,
-                                    packet.packet.GetOpcode(),
-                                    packet.packet.size(),
-                                    packet.timestamp,
-                                    entry.first);
-                                record.guidLeakDropLogged = true;
-                                break;
-                            }
-                        }
-                    }
+                    size_t size = std::min(REPLAY_DICTIONARY_SAMPLE_SIZE, serialized.size() - offset);
+                    samples.insert(samples.end(), serialized.begin() + offset, serialized.begin() + offset + size);
+                    sampleSizes.push_back(size);
                 }
+            }
 
-                continue;
+            std::vector<uint8> data(REPLAY_DICTIONARY_CAPACITY);
+            size_t size = ZDICT_trainFromBuffer(data.data(), data.size(), samples.data(), sampleSizes.data(), static_cast<unsigned>(sampleSizes.size()));
+            if (ZDICT_isError(size))
+            {
+                LOG_ERROR("modules", "ArenaReplay: dictionary training for map {} failed: {}", mapId, ZDICT_getErrorName(size));
+                return false;
             }
 
-            for (auto const& entry : record.guidRemap)
-                ReplaceGuidInPacket(packet.packet, entry.first, entry.second, &objectTypes);
+            data.resize(size);
 
-            if (PacketContainsAnyOriginalGuid(packet.packet, record.guidRemap))
+            // only one trainer runs at a time and nothing else writes the table
+            uint32 id = 1;
+            if (QueryResult result = CharacterDatabase.Query("SELECT MAX(id) FROM character_arena_replay_dictionaries"))
             {
-                packet.drop = true;
-                if (!record.guidLeakDropLogged)
-                {
-                    for (auto const& entry : record.guidRemap)
-                    {
-                        if (PacketContainsGuid(packet.packet, entry.first))
-                        {
-                            LOG_ERROR("modules", "ArenaReplay: GUID leak detected, dropping packet replay {} opcode {} size {} ts {} guid {}",
-                                record.replayId,
-                                packet.packet.GetOpcode(),
-                                packet.packet.size(),
-                                packet.timestamp,
-                                entry.first);
-                            record.guidLeakDropLogged = true;
-                            break;
-                        }
-                    }
-                }
+                if (!result->Fetch()[0].IsNull())
+                    id = result->Fetch()[0].Get<uint32>() + 1;
+            }
+
+            ReplayDictionaryStore::Dictionary dictionary(id, mapId, data);
+            if (!dictionary.compression || !dictionary.decompression)
+                return false;
+
+            CodecResult zlib;
+            CodecResult zstd;
+            CodecResult zstdDictionary;
+            for (std::vector<uint8> const& serialized : holdout)
+            {
+                Measure(zlib, serialized,
+                    [](std::span<uint8 const> input, std::vector<uint8>& output) { return Compress(input, output); },
+                    [](std::span<uint8 const> input, std::vector<uint8>& output) { return Decompress(input, output); });
+                Measure(zstd, serialized,
+                    [](std::span<uint8 const> input, std::vector<uint8>& output) { return CompressZstd(input, nullptr, output); },
+                    [](std::span<uint8 const> input, std::vector<uint8>& output) { return DecompressZstd(input, nullptr, output); });
+                Measure(zstdDictionary, serialized,
+                    [&](std::span<uint8 const> input, std::vector<uint8>& output) { return CompressZstd(input, &dictionary, output); },
+                    [&](std::span<uint8 const> input, std::vector<uint8>& output) { return DecompressZstd(input, &dictionary, output); });
             }
+
+            bool better = zstdDictionary.replays == holdout.size() && zstdDictionary.compressed < zstd.compressed;
+            LOG_INFO("modules", "ArenaReplay: map {} dictionary of {} KB from {} replays, on {} held out: "
+                "zlib {:.1f}% {:.2f} ms, zstd {:.1f}% {:.2f} ms, zstd with dictionary {:.1f}% {:.2f} ms (size of raw, decode per replay){}",
+                mapId,
+                data.size() / 1024,
+                training.size(),
+                holdout.size(),
+                zlib.Percent(),
+                zlib.DecodeMilliseconds(),
+                zstd.Percent(),
+                zstd.DecodeMilliseconds(),
+                zstdDictionary.Percent(),
+                zstdDictionary.DecodeMilliseconds(),
+                better ? "" : ", not stored");
+
+            if (!better)
+                return false;
+
+            CharacterDatabase.DirectExecute("INSERT INTO character_arena_replay_dictionaries (id, mapId, sampleCount, dictionary) VALUES ({}, {}, {}, \"{}\")",
+                id, mapId, uint32(training.size()), Acore::Encoding::Base32::Encode(data));
+            return ReplayDictionaryStore::Instance().Add(id, mapId, std::move(data));
         }
-    }
+
+        std::thread _thread;
+        std::atomic<bool> _running = false;
+        std::atomic<bool> _stop = false;
+    };
+#endif
 }
 
 class ArenaReplayServerScript : public ServerScript
@@ -1835,6 +5156,12 @@ public:
         if (bg->GetStatus() != BattlegroundStatus::STATUS_IN_PROGRESS)
             return true;
 
+        // this runs for every packet, so only one call in RECORD_HOOK_SAMPLE_RATE is timed
+        thread_local uint32 hookCalls = 0;
+        std::optional<ArenaReplayScopedTimer> hookTimer;
+        if (++hookCalls % RECORD_HOOK_SAMPLE_RATE == 0)
+            hookTimer.emplace(sArenaReplayMetrics.recordHook);
+
         // record packets from 1 player of each team
         // iterate just in case a player leaves and used as reference
         for (auto it : bg->GetPlayers())
@@ -1848,9 +5175,11 @@ public:
             }
         }
 
-        if (records.find(bg->GetInstanceID()) == records.end())
-            records[bg->GetInstanceID()].packets.clear();
-        MatchRecord& record = records[bg->GetInstanceID()];
+        auto [recordIt, created] = records.try_emplace(bg->GetInstanceID());
+        if (created)
+            sArenaReplayMetrics.activeRecordings.Add(1);
+
+        MatchRecord& record = recordIt->second;
 
         if (IsClientOpcode(static_cast<Opcodes>(packet.GetOpcode())))
         {
@@ -1865,15 +5194,15 @@ public:
         }
 
         // ignore packets not in watch list
-        if (std::find(watchList.begin(), watchList.end(), packet.GetOpcode()) == watchList.end())
+        uint32 timestamp = bg->GetStartTime();
+        if (!RecordReplayPacket(record, packet, timestamp, session->GetPlayer()->GetGUID().GetRawValue()))
             return true;
 
-        uint32 timestamp = bg->GetStartTime();
+        sArenaReplayMetrics.recorded.Add(packet.GetOpcode(), packet.size());
+
         record.typeId = bg->GetBgTypeID();
         record.arenaTypeId = bg->GetArenaType();
         record.mapId = bg->GetMapId();
-        // push back packet inside queue of matchId 0
-        record.packets.push_back({ timestamp, /* copy */ WorldPacket(packet), session->GetPlayer()->GetGUID().GetRawValue() });
         return true;
     }
 };
@@ -1903,16 +5232,17 @@ public:
         }) {
     }
 
-    void OnBattlegroundUpdate(Battleground* bg, uint32 /* diff */) override
+    void OnBattlegroundUpdate(Battleground* bg, uint32 diff) override
     {
         const bool isReplay = bgReplayIds.find(bg->GetInstanceID()) != bgReplayIds.end();
         if (!isReplay)
             return;
 
-        if (!bg->isArena() && !sConfigMgr->GetOption<bool>("ArenaReplay.SaveBattlegrounds", true))
+        ArenaReplayConfig const& config = sArenaReplayConfig.Get();
+        if (!bg->isArena() && !config.saveBattlegrounds)
             return;
 
-        if (!bg->isRated() && !sConfigMgr->GetOption<bool>("ArenaReplay.SaveUnratedArenas", true))
+        if (!bg->isRated() && !config.saveUnratedArenas)
             return;
 
         uint32 replayId = bgReplayIds.at(bg->GetInstanceID());
@@ -1928,52 +5258,61 @@ public:
             return;
 
         // retrieve arena replay data
-        auto it = loadedReplays.find(replayId);
-        if (it == loadedReplays.end())
+        auto it = replayPlaybacks.find(bg->GetInstanceID());
+        if (it == replayPlaybacks.end())
             return;
 
-        MatchRecord& match = it->second;
-        if (!match.debugLoggedStart)
+        ReplayPlayback& playback = it->second;
+        MatchRecord const& match = *playback.match;
+        size_t playablePackets = match.PlayablePackets();
+        bool loading = match.Loading();
+        if (loading && !playablePackets)
+        {
+            HoldReplayClock(bg, diff);
+            return;
+        }
+
+        if (!playback.debugLoggedStart)
         {
-            LOG_INFO("modules", "ArenaReplay: replay {} starting on bg instance {} map {} arenaType {} packets {} participants {} startTime {}",
+            LOG_DEBUG("modules", "ArenaReplay: replay {} starting on bg instance {} map {} arenaType {} packets {} participants {} startTime {}",
                 replayId,
                 bg->GetInstanceID(),
                 match.mapId,
                 match.arenaTypeId,
-                match.packets.size(),
+                match.PacketCount(),
                 match.participantGuids.size(),
                 bg->GetStartTime());
-            match.debugLoggedStart = true;
+            playback.debugLoggedStart = true;
         }
         auto const& spectators = bg->GetSpectators();
-        if (!match.updateLogged)
+        if (!playback.updateLogged)
         {
-            LOG_INFO("modules", "ArenaReplay: update bgInstance {} status {} players {} spectators {} startTime {} packetsLeft {}",
+            LOG_DEBUG("modules", "ArenaReplay: update bgInstance {} status {} players {} spectators {} startTime {} packetsLeft {}",
                 bg->GetInstanceID(),
                 int(bg->GetStatus()),
                 bg->GetPlayers().size(),
                 spectators.size(),
                 bg->GetStartTime(),
-                match.packets.size());
-            match.updateLogged = true;
+                match.PacketCount() - playback.nextPacket);
+            playback.updateLogged = true;
         }
 
         if (!spectators.empty() || !bg->GetPlayers().empty())
         {
-            if (!match.observerJoined)
+            if (!playback.observerJoined)
             {
-                LOG_INFO("modules", "ArenaReplay: observer joined bgInstance {} matchId {} players {} spectators {}",
+                LOG_DEBUG("modules", "ArenaReplay: observer joined bgInstance {} matchId {} players {} spectators {}",
                     bg->GetInstanceID(),
                     replayId,
                     bg->GetPlayers().size(),
                     spectators.size());
             }
-            match.observerJoined = true;
+            playback.observerJoined = true;
         }
 
-        if (match.packets.empty())
+        if (playback.nextPacket >= match.PacketCount())
         {
-            loadedReplays.erase(it);
+            replayPlaybacks.erase(it);
             bgReplayIds.erase(bg->GetInstanceID());
             return;
         }
@@ -1981,6 +5320,13 @@ public:
         if (spectators.empty() && bg->GetPlayers().empty())
             return;
 
+        // the cursor caught up with the loader and the next packet is due: wait for its chunk
+        if (playback.nextPacket >= playablePackets && match.Packet(playablePackets).timestamp <= bg->GetStartTime())
+        {
+            HoldReplayClock(bg, diff);
+            return;
+        }
+
         //send replay data to spectator
         Player* observer = nullptr;
         if (!spectators.empty())
@@ -2001,94 +5347,125 @@ public:
             observerIsParticipant = true;
         }
 
-        uint32 maxPacketsToSend = sConfigMgr->GetOption<uint32>("ArenaReplay.MaxPacketsToSend", 0);
-        if (maxPacketsToSend > 0 && match.sentPackets >= maxPacketsToSend)
+        uint32 maxPacketsToSend = config.maxPacketsToSend;
+        if (maxPacketsToSend > 0 && playback.sentPackets >= maxPacketsToSend)
         {
-            if (!match.maxPacketsLogged)
+            if (!playback.maxPacketsLogged)
             {
                 LOG_INFO("modules", "ArenaReplay: reached MaxPacketsToSend {} for replay {} last opcode {} ts {}",
                     maxPacketsToSend,
                     match.replayId,
-                    match.packets.front().packet.GetOpcode(),
-                    match.packets.front().timestamp);
-                match.maxPacketsLogged = true;
+                    match.Packet(playback.nextPacket).packet.GetOpcode(),
+                    match.Packet(playback.nextPacket).timestamp);
+                playback.maxPacketsLogged = true;
             }
             return;
         }
 
-        while (!match.packets.empty() && match.packets.front().timestamp <= bg->GetStartTime())
+        // idle ticks go into the histogram but not the trace, so they don't push load spans out of the ring
+        ArenaReplayScopedTimer tickTimer(sArenaReplayMetrics.playbackTick);
+        uint64 sentThisTick = 0;
+        uint64 sentBytesThisTick = 0;
+        while (playback.nextPacket < playablePackets && match.Packet(playback.nextPacket).timestamp <= bg->GetStartTime())
         {
             if (spectators.empty() && bg->GetPlayers().empty())
                 break;
 
-            PacketRecord const& packetRecord = match.packets.front();
+            PacketRecord const& packetRecord = match.Packet(playback.nextPacket);
             if (packetRecord.drop || packetRecord.packet.size() == 0)
             {
-                if (match.debugPacketsLogged < 50)
+                if (playback.debugPacketsLogged < 50)
                 {
-                    LOG_INFO("modules", "ArenaReplay: dropping packet opcode {} size {} ts {}",
+                    LOG_DEBUG("modules", "ArenaReplay: dropping packet opcode {} size {} ts {}",
                         packetRecord.packet.GetOpcode(),
                         packetRecord.packet.size(),
                         packetRecord.timestamp);
-                    ++match.debugPacketsLogged;
+                    ++playback.debugPacketsLogged;
                 }
-                match.packets.pop_front();
+                ++playback.nextPacket;
                 continue;
             }
             if (observerIsParticipant && packetRecord.sourceGuid != 0 && packetRecord.sourceGuid == observerGhostGuid)
             {
-                if (match.debugPacketsLogged < 50)
+                if (playback.debugPacketsLogged < 50)
                 {
-                    LOG_INFO("modules", "ArenaReplay: skipping packet opcode {} size {} ts {} sourceGuid {} (matches observer ghost guid {} real {})",
+                    LOG_DEBUG("modules", "ArenaReplay: skipping packet opcode {} size {} ts {} sourceGuid {} (matches observer ghost guid {} real {})",
                         packetRecord.packet.GetOpcode(),
                         packetRecord.packet.size(),
                         packetRecord.timestamp,
                         packetRecord.sourceGuid,
                         observerGhostGuid,
                         observerRealGuid);
-                    ++match.debugPacketsLogged;
+                    ++playback.debugPacketsLogged;
                 }
-                match.packets.pop_front();
+                ++playback.nextPacket;
                 continue;
             }
 
             if (IsClientOpcode(static_cast<Opcodes>(packetRecord.packet.GetOpcode())))
             {
-                if (!match.invalidSendOpcodeLogged)
+                if (!playback.invalidSendOpcodeLogged)
                 {
                     LOG_ERROR("modules", "ArenaReplay: skipping client opcode {} during replay {}",
                         packetRecord.packet.GetOpcode(),
                         match.replayId);
-                    match.invalidSendOpcodeLogged = true;
+                    playback.invalidSendOpcodeLogged = true;
                 }
-                match.packets.pop_front();
+                ++playback.nextPacket;
                 continue;
             }
 
-            if (maxPacketsToSend > 0 && match.sentPackets >= maxPacketsToSend)
+            if (maxPacketsToSend > 0 && playback.sentPackets >= maxPacketsToSend)
             {
-                if (!match.maxPacketsLogged)
+                if (!playback.maxPacketsLogged)
                 {
                     LOG_INFO("modules", "ArenaReplay: reached MaxPacketsToSend {} for replay {} last opcode {} ts {}",
                         maxPacketsToSend,
                         match.replayId,
                         packetRecord.packet.GetOpcode(),
                         packetRecord.timestamp);
-                    match.maxPacketsLogged = true;
+                    playback.maxPacketsLogged = true;
                 }
-                return;
+                break;
+            }
+
+            // spread bursts such as the initial object creates over several ticks; the first packet of a tick always goes out
+            if (sentThisTick && ((config.playbackMaxPacketsPerTick && sentThisTick >= config.playbackMaxPacketsPerTick) ||
+                (config.playbackMaxBytesPerTick && sentBytesThisTick >= config.playbackMaxBytesPerTick)))
+            {
+                sArenaReplayMetrics.budgetLimitedTicks.Add();
+                break;
+            }
+
+            size_t mergeCount = 1;
+            if (config.playbackMergeUpdateObjects)
+            {
+                size_t maxMergeCount = playablePackets - playback.nextPacket;
+                if (maxPacketsToSend > 0)
+                    maxMergeCount = std::min<size_t>(maxMergeCount, maxPacketsToSend - playback.sentPackets);
+
+                mergeCount = CountMergeableUpdateObjects(match.packets, playback.nextPacket - match.releasedPackets, bg->GetStartTime(),
+                    observerIsParticipant ? observerGhostGuid : 0, maxMergeCount);
             }
 
+            WorldPacket mergedPacket;
             WorldPacket const* myPacket = &packetRecord.packet;
-            if (match.debugPacketsLogged < 50)
+            if (mergeCount > 1)
+            {
+                MergeUpdateObjects(match.packets, playback.nextPacket - match.releasedPackets, mergeCount, mergedPacket);
+                myPacket = &mergedPacket;
+                sArenaReplayMetrics.mergedUpdatePackets.Add(mergeCount);
+            }
+
+            if (playback.debugPacketsLogged < 50)
             {
-                LOG_INFO("modules", "ArenaReplay: sending packet opcode {} size {} ts {} sourceGuid {} to observer guid {}",
+                LOG_DEBUG("modules", "ArenaReplay: sending packet opcode {} size {} ts {} sourceGuid {} to observer guid {}",
                     myPacket->GetOpcode(),
                     myPacket->size(),
                     packetRecord.timestamp,
                     packetRecord.sourceGuid,
                     observerRealGuid);
-                ++match.debugPacketsLogged;
+                ++playback.debugPacketsLogged;
             }
             if (!spectators.empty())
             {
@@ -2111,9 +5488,51 @@ public:
                     player->GetSession()->SendPacket(myPacket);
                 }
             }
-            ++match.sentPackets;
-            match.packets.pop_front();
+            playback.sentPackets += mergeCount;
+            ++sentThisTick;
+            sentBytesThisTick += myPacket->size();
+            playback.nextPacket += mergeCount;
+        }
+
+        if (sentThisTick)
+        {
+            tickTimer.Trace("playback.tick", replayId);
+            sArenaReplayMetrics.playbackTicks.Add();
+            sArenaReplayMetrics.sentPackets.Add(sentThisTick);
+            sArenaReplayMetrics.sentBytes.Add(sentBytesThisTick);
+            sArenaReplayMetrics.maxPacketsPerTick.Update(sentThisTick);
+        }
+
+        ReleasePlayedPackets(*playback.match, playback.nextPacket);
+    }
+
+    // Frees the packets every battleground showing a replay has sent, once
+    // it is loaded in full, so a long replay is not held in memory until its
+    // last viewer is done. A viewer arriving afterwards loads its own copy.
+    static void ReleasePlayedPackets(MatchRecord& match, size_t nextPacket)
+    {
+        if (match.Loading() || nextPacket - match.releasedPackets < REPLAY_RELEASE_BATCH)
+            return;
+
+        size_t played = nextPacket;
+        for (auto const& [instanceId, playback] : replayPlaybacks)
+        {
+            if (playback.match.get() == &match)
+                played = std::min(played, playback.nextPacket);
         }
+
+        if (played - match.releasedPackets < REPLAY_RELEASE_BATCH)
+            return;
+
+        match.packets.erase(match.packets.begin(), match.packets.begin() + (played - match.releasedPackets));
+        match.releasedPackets = played;
+    }
+
+    // Keeps the replay time where it is for this update.
+    static void HoldReplayClock(Battleground* bg, uint32 diff)
+    {
+        bg->SetStartTime(bg->GetStartTime() - std::min(diff, bg->GetStartTime()));
+        sArenaReplayMetrics.loaderWaitTicks.Add();
     }
 
     void OnBattlegroundAddPlayer(Battleground* bg, Player* player) override
@@ -2135,10 +5554,11 @@ public:
         if (player->IsSpectator())
             return;
 
-        if (!bg->isArena() && !sConfigMgr->GetOption<bool>("ArenaReplay.SaveBattlegrounds", true))
+        ArenaReplayConfig const& config = sArenaReplayConfig.Get();
+        if (!bg->isArena() && !config.saveBattlegrounds)
             return;
 
-        if (!bg->isRated() && !sConfigMgr->GetOption<bool>("ArenaReplay.SaveUnratedArenas", true))
+        if (!bg->isRated() && !config.saveUnratedArenas)
             return;
 
         if (bgPlayersGuids.find(bg->GetInstanceID()) == bgPlayersGuids.end())
@@ -2164,21 +5584,28 @@ public:
 
             bgPlayersGuids[bg->GetInstanceID()].hordePlayerGuids += playerGuid;
         }
+
+        std::vector<ReplayParticipant>& participants = bgPlayersGuids[bg->GetInstanceID()].participants;
+        uint32 guid = player->GetGUID().GetCounter();
+        if (std::none_of(participants.begin(), participants.end(), [guid](ReplayParticipant const& participant) { return participant.guid == guid; }))
+            participants.push_back({ guid, player->GetName(), bgTeamId, player->getClass(), player->getRace(), player->getGender() });
     }
 
     void OnBattlegroundEnd(Battleground* bg, TeamId winnerTeamId) override {
 
-        if (!bg->isArena() && !sConfigMgr->GetOption<bool>("ArenaReplay.SaveBattlegrounds", true))
-            return;
-
-        if (!bg->isRated() && !sConfigMgr->GetOption<bool>("ArenaReplay.SaveUnratedArenas", true))
+        ArenaReplayConfig const& config = sArenaReplayConfig.Get();
+        if ((!bg->isArena() && !config.saveBattlegrounds) ||
+            (!bg->isRated() && !config.saveUnratedArenas))
+        {
+            DiscardRecording(bg->GetInstanceID());
             return;
+        }
 
         const bool isReplay = bgReplayIds.find(bg->GetInstanceID()) != bgReplayIds.end();
 
         // only saves if arena lasted at least X secs (StartDelayTime is included - 60s StartDelayTime + X StartTime)
-        uint32 ValidArenaDuration = sConfigMgr->GetOption<uint32>("ArenaReplay.ValidArenaDuration", 75) * IN_MILLISECONDS;
-        bool ValidArena = (bg->GetStartTime()) >= ValidArenaDuration || sConfigMgr->GetOption<uint32>("ArenaReplay.ValidArenaDuration", 75) == 0;
+        uint32 ValidArenaDuration = config.validArenaDuration * IN_MILLISECONDS;
+        bool ValidArena = (bg->GetStartTime()) >= ValidArenaDuration || config.validArenaDuration == 0;
 
         // save replay when a bg ends
         if (!isReplay && ValidArena)
@@ -2187,7 +5614,9 @@ public:
             return;
         }
 
+        DiscardRecording(bg->GetInstanceID());
         bgReplayIds.erase(bg->GetInstanceID());
+        replayPlaybacks.erase(bg->GetInstanceID());
         bgPlayersGuids.erase(bg->GetInstanceID());
     }
 
@@ -2198,32 +5627,18 @@ public:
         if (it == records.end())
             return;
 
+        ArenaReplayScopedTimer saveTimer(sArenaReplayMetrics.save, "save", bg->GetInstanceID());
         MatchRecord& match = it->second;
+        uint32 replayId = ReplayIdAllocator::Instance().Next();
+        if (!replayId)
+        {
+            EraseRecording(it);
+            return;
+        }
 
         /** serialize arena replay data **/
         ArenaReplayByteBuffer buffer;
-        uint32 headerSize;
-        uint32 timestamp;
-        for (auto const& packetRecord : match.packets)
-        {
-            headerSize = packetRecord.packet.size(); //header 4Bytes packet size
-            timestamp = packetRecord.timestamp;
-
-            const bool hasSourceGuid = packetRecord.sourceGuid != 0;
-            uint32 sizeWithFlag = headerSize;
-            if (hasSourceGuid)
-                sizeWithFlag |= 0x80000000u;
-
-            buffer << sizeWithFlag; // 4 bytes
-            buffer << timestamp; // 4 bytes
-            buffer << packetRecord.packet.GetOpcode(); // 2 bytes
-
-            if (hasSourceGuid)
-                buffer << packetRecord.sourceGuid; // 8 bytes
-
-            if (headerSize > 0)
-                buffer.append(packetRecord.packet.contents(), packetRecord.packet.size()); // headerSize bytes
-        }
+        SerializeReplayPackets(match.packets, buffer);
 
         uint32 teamWinnerRating = 0;
         uint32 teamLoserRating = 0;
@@ -2245,6 +5660,14 @@ public:
             winnerGuids = bgPlayersGuids[bg->GetInstanceID()].hordePlayerGuids;
         }
 
+        ReplayRoster roster;
+        for (ReplayParticipant const& participant : bgPlayersGuids[bg->GetInstanceID()].participants)
+            (participant.team == winnerTeamId ? roster.winners : roster.losers).push_back(participant);
+
+        auto byGuid = [](ReplayParticipant const& left, ReplayParticipant const& right) { return left.guid < right.guid; };
+        std::sort(roster.winners.begin(), roster.winners.end(), byGuid);
+        std::sort(roster.losers.begin(), roster.losers.end(), byGuid);
+
         for (const auto& playerPair : bg->GetPlayers())
         {
             Player* player = playerPair.second;
@@ -2270,23 +5693,14 @@ public:
             }
 
             // Send replay ID to player after a game end
-            uint32 replayfightid = 0;
-            QueryResult qResult = CharacterDatabase.Query("SELECT MAX(`id`) AS max_id FROM `character_arena_replays`");
-            if (qResult)
-            {
-                do
-                {
-                    replayfightid = qResult->Fetch()[0].Get<uint32>();
-                } while (qResult->NextRow());
-            }
-            ChatHandler(player->GetSession()).PSendSysMessage("Replay saved. Match ID: {}", replayfightid + 1);
+            ChatHandler(player->GetSession()).PSendSysMessage("Replay saved. Match ID: {}", replayId);
         }
 
-        const uint8 ARENA_TYPE_3V3_SOLO_QUEUE = sConfigMgr->GetOption<uint8>("ArenaReplay.3v3soloQ.ArenaType", 4);
+        const uint8 ARENA_TYPE_3V3_SOLO_QUEUE = sArenaReplayConfig.Get().arena3v3SoloQArenaType;
         if (bg->isArena() && (!bg->isRated() || bg->GetArenaType() == ARENA_TYPE_3V3_SOLO_QUEUE))
         {
-            teamWinnerName = GetTeamName(winnerGuids);
-            teamLoserName = GetTeamName(loserGuids);
+            teamWinnerName = FormatRosterNames(roster.winners);
+            teamLoserName = FormatRosterNames(roster.losers);
         }
         else if (!bg->isArena())
         {
@@ -2305,31 +5719,93 @@ public:
         teamLoserMMR = 0;
         teamWinnerMMR = 0;
 
-        CharacterDatabase.Execute("INSERT INTO `character_arena_replays` "
-            //   1             2            3            4          5          6                  7                    8
-            "(`arenaTypeId`, `typeId`, `contentSize`, `contents`, `mapId`, `winnerTeamName`, `winnerTeamRating`, `winnerTeamMMR`, "
-            //    9                10                 11                 12                 13
-            "`loserTeamName`, `loserTeamRating`, `loserTeamMMR`, `winnerPlayerGuids`, `loserPlayerGuids`) "
-
-            "VALUES ({}, {}, {}, \"{}\", {}, '{}', {}, {}, '{}', {}, {}, \"{}\", \"{}\")",
-            //       1   2    3     4    5    6    7   8    9    10  11    12      13
-
-            uint32(match.arenaTypeId), // 1
-            uint32(match.typeId),      // 2
-            buffer.size(),             // 3
-            Acore::Encoding::Base32::Encode(buffer.contentsAsVector()), // 4
-            bg->GetMapId(),    // 5
-            teamWinnerName,    // 6
-            teamWinnerRating,  // 7
-            teamWinnerMMR,     // 8
-            teamLoserName,     // 9
-            teamLoserRating,   // 10
-            teamLoserMMR,      // 11
-            winnerGuids,       // 12
-            loserGuids         // 13
+        ReplayStorageFormat storageFormat = static_cast<ReplayStorageFormat>(sArenaReplayConfig.Get().storageFormat);
+        uint32 duration = bg->GetStartTime() / IN_MILLISECONDS;
+        uint64 now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        // team names come from players (arena team names, or the roster of a skirmish)
+        std::string escapedWinnerName = teamWinnerName;
+        std::string escapedLoserName = teamLoserName;
+        CharacterDatabase.EscapeString(escapedWinnerName);
+        CharacterDatabase.EscapeString(escapedLoserName);
+
+        // the replay and its participants rows go in one transaction
+        CharacterDatabaseTransaction trans = CharacterDatabase.BeginTransaction();
+        trans->Append("INSERT INTO `character_arena_replays` "
+            //      1        2             3            4          5          6          7                  8                    9
+            "(`id`, `arenaTypeId`, `typeId`, `contentSize`, `contents`, `mapId`, `winnerTeamName`, `winnerTeamRating`, `winnerTeamMMR`, "
+            //    10               11                 12                 13                 14                15
+            "`loserTeamName`, `loserTeamRating`, `loserTeamMMR`, `winnerPlayerGuids`, `loserPlayerGuids`, `duration`) "
+
+            "VALUES ({}, {}, {}, {}, \"{}\", {}, '{}', {}, {}, '{}', {}, {}, \"{}\", \"{}\", {})",
+            //       1   2   3   4     5    6    7    8   9   10   11  12    13      14   15
+
+            replayId,                  // 1
+            uint32(match.arenaTypeId), // 2
+            uint32(match.typeId),      // 3
+            buffer.size(),             // 4
+            EncodeReplayContents(buffer.contentsAsVector(), storageFormat, bg->GetMapId()), // 5
+            bg->GetMapId(),    // 6
+            escapedWinnerName, // 7
+            teamWinnerRating,  // 8
+            teamWinnerMMR,     // 9
+            escapedLoserName,  // 10
+            teamLoserRating,   // 11
+            teamLoserMMR,      // 12
+            winnerGuids,       // 13
+            loserGuids,        // 14
+            duration           // 15
         );
 
-        records.erase(it);
+        std::string participantRows;
+        auto appendParticipantRows = [&](std::vector<ReplayParticipant> const& side, uint32 team)
+        {
+            for (ReplayParticipant const& participant : side)
+            {
+                if (!participantRows.empty())
+                    participantRows += ", ";
+
+                std::string name = participant.name;
+                CharacterDatabase.EscapeString(name);
+                participantRows += Acore::StringFormat("({}, {}, '{}', {}, {}, {}, {})", replayId, participant.guid, name, team,
+                    uint32(participant.playerClass), uint32(participant.race), uint32(participant.gender));
+            }
+        };
+
+        appendParticipantRows(roster.winners, 0);
+        appendParticipantRows(roster.losers, 1);
+        if (!participantRows.empty())
+            trans->Append("INSERT INTO `character_arena_replay_participants` (`replay_id`, `player_guid`, `name`, `team`, `class`, `race`, `gender`) VALUES " + participantRows);
+
+        CharacterDatabase.CommitTransaction(trans);
+
+        ReplayInfo info;
+        info.matchId = replayId;
+        info.arenaTypeId = match.arenaTypeId;
+        info.winnerTeamName = teamWinnerName;
+        info.winnerTeamRating = teamWinnerRating;
+        info.loserTeamName = teamLoserName;
+        info.loserTeamRating = teamLoserRating;
+        info.timestamp = now;
+        info.gossipText = FormatReplayGossipText(info, roster);
+        ReplayLeaderboards::Instance().OnSaved(info);
+
+        ReplaySearchRow searchRow;
+        searchRow.id = replayId;
+        searchRow.arenaTypeId = match.arenaTypeId;
+        searchRow.mapId = bg->GetMapId();
+        searchRow.winnerTeamRating = teamWinnerRating;
+        searchRow.duration = duration;
+        searchRow.timestamp = now;
+        for (ReplayParticipant const& participant : roster.winners)
+            searchRow.winnerClasses |= ReplayClassBit(participant.playerClass);
+
+        for (ReplayParticipant const& participant : roster.losers)
+            searchRow.loserClasses |= ReplayClassBit(participant.playerClass);
+
+        ReplaySearchIndex::Instance().Add(searchRow);
+
+        EraseRecording(it);
     }
 
 private:
@@ -2344,30 +5820,6 @@ private:
         }
     }
 
-    std::string GetTeamName(std::string listPlayerGuids) {
-        std::string teamName;
-        std::stringstream ssPlayerGuids(listPlayerGuids);
-
-        std::vector<std::string> playerGuids;
-        std::string playerGuid;
-        while (std::getline(ssPlayerGuids, playerGuid, ','))
-            playerGuids.push_back(playerGuid);
-
-        for (const std::string& guid : playerGuids)
-        {
-            uint64 _guid = std::stoi(guid);
-            CharacterCacheEntry const* playerData = sCharacterCache->GetCharacterCacheByGuid(ObjectGuid(_guid));
-            if (playerData)
-                teamName += playerData->Name + " ";
-        }
-
-        // truncate last character if space
-        if (!teamName.empty() && teamName.substr(teamName.size() - 1, teamName.size()) == " ") {
-            teamName.pop_back();
-        }
-
-        return teamName;
-    }
 };
 
 enum ReplayGossips
@@ -2385,9 +5837,12 @@ enum ReplayGossips
     REPLAY_TOP_5V5_ALLTIME = 11,
     REPLAY_TOP_3V3SOLO_ALLTIME = 12,
     REPLAY_TOP_1V1_ALLTIME = 13,
-    REPLAY_MOST_WATCHED_ALLTIME = 14
+    REPLAY_MOST_WATCHED_ALLTIME = 14,
+    REPLAY_SEARCH = 15
 };
 
+constexpr uint32 REPLAY_SEARCH_LIMIT = 50;
+
 class ReplayGossip : public CreatureScript
 {
 public:
@@ -2396,14 +5851,15 @@ public:
 
     bool OnGossipHello(Player* player, Creature* creature) override
     {
-        if (!sConfigMgr->GetOption<bool>("ArenaReplay.Enable", true))
+        ArenaReplayConfig const& config = sArenaReplayConfig.Get();
+        if (!config.enable)
         {
             ChatHandler(player->GetSession()).SendSysMessage("Arena Replay disabled!");
             return true;
         }
 
-        const bool isArena1v1Enabled = sConfigMgr->GetOption<bool>("ArenaReplay.1v1.Enable", false);
-        const bool isArena3v3soloQEnabled = sConfigMgr->GetOption<bool>("ArenaReplay.3v3soloQ.Enable", false);
+        const bool isArena1v1Enabled = config.arena1v1Enable;
+        const bool isArena3v3soloQEnabled = config.arena3v3SoloQEnable;
 
         if (isArena1v1Enabled)
             AddGossipItemFor(player, GOSSIP_ICON_BATTLE, "Replay top 1v1 games of the last 30 days", GOSSIP_SENDER_MAIN, REPLAY_LATEST_1V1);
@@ -2418,6 +5874,7 @@ public:
 
         AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Replay a Match ID", GOSSIP_SENDER_MAIN, REPLAY_MATCH_ID, "", 0, true);             // maybe add command .replay 'replayID' aswell
         AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Replay list by player name", GOSSIP_SENDER_MAIN, REPLAY_LIST_BY_PLAYERNAME, "", 0, true); // to do: show a list, showing games with type, teamname and teamrating
+        AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Search replays (e.g. bracket=3v3 comp=rmp-any rating=2000- days=7)", GOSSIP_SENDER_MAIN, REPLAY_SEARCH, "", 0, true);
         AddGossipItemFor(player, GOSSIP_ICON_TRAINER, "My favorite matches", GOSSIP_SENDER_MAIN, MY_FAVORITE_MATCHES);                   // To do: somehow show teamName/TeamRating/Classes (it's a different db table)
 
         if (isArena1v1Enabled)
@@ -2438,57 +5895,72 @@ public:
         return true;
     }
 
-    bool OnGossipSelect(Player* player, Creature* creature, uint32 /* sender */, uint32 action) override
+    bool OnGossipSelect(Player* player, Creature* creature, uint32 sender, uint32 action) override
     {
-        const uint8 ARENA_TYPE_1v1 = sConfigMgr->GetOption<uint8>("ArenaReplay.1v1.ArenaType", 1);
-        const uint8 ARENA_TYPE_3V3_SOLO_QUEUE = sConfigMgr->GetOption<uint8>("ArenaReplay.3v3soloQ.ArenaType", 4);
+        const uint8 ARENA_TYPE_1v1 = sArenaReplayConfig.Get().arena1v1ArenaType;
+        const uint8 ARENA_TYPE_3V3_SOLO_QUEUE = sArenaReplayConfig.Get().arena3v3SoloQArenaType;
 
         player->PlayerTalkClass->ClearMenus();
+        if (sender == REPLAY_NEXT_PAGE_SENDER)
+        {
+            auto itr = _nextPages.find(player->GetGUID().GetCounter());
+            if (itr == _nextPages.end())
+                return OnGossipHello(player, creature);
+
+            ReplayPageCursor cursor = itr->second;
+            if (cursor.list == REPLAY_LIST_SAVED)
+                ShowSavedReplays(player, creature, cursor.lastId);
+            else
+                ShowReplayList(player, creature, cursor.list, cursor.arenaTypeId, cursor);
+
+            return true;
+        }
+
         switch (action)
         {
         case REPLAY_LATEST_2V2:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysLast30Days(player, creature, ARENA_TYPE_2v2);
+            ShowReplayList(player, creature, REPLAY_LIST_LATEST, ARENA_TYPE_2v2);
             break;
         case REPLAY_LATEST_3V3:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysLast30Days(player, creature, ARENA_TYPE_3v3);
+            ShowReplayList(player, creature, REPLAY_LIST_LATEST, ARENA_TYPE_3v3);
             break;
         case REPLAY_LATEST_5V5:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysLast30Days(player, creature, ARENA_TYPE_5v5);
+            ShowReplayList(player, creature, REPLAY_LIST_LATEST, ARENA_TYPE_5v5);
             break;
         case REPLAY_LATEST_3V3SOLO:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysLast30Days(player, creature, ARENA_TYPE_3V3_SOLO_QUEUE);
+            ShowReplayList(player, creature, REPLAY_LIST_LATEST, ARENA_TYPE_3V3_SOLO_QUEUE);
             break;
         case REPLAY_LATEST_1V1:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysLast30Days(player, creature, ARENA_TYPE_1v1);
+            ShowReplayList(player, creature, REPLAY_LIST_LATEST, ARENA_TYPE_1v1);
             break;
         case REPLAY_TOP_2V2_ALLTIME:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysAllTime(player, creature, ARENA_TYPE_2v2);
+            ShowReplayList(player, creature, REPLAY_LIST_TOP_RATED, ARENA_TYPE_2v2);
             break;
         case REPLAY_TOP_3V3_ALLTIME:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysAllTime(player, creature, ARENA_TYPE_3v3);
+            ShowReplayList(player, creature, REPLAY_LIST_TOP_RATED, ARENA_TYPE_3v3);
             break;
         case REPLAY_TOP_5V5_ALLTIME:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysAllTime(player, creature, ARENA_TYPE_5v5);
+            ShowReplayList(player, creature, REPLAY_LIST_TOP_RATED, ARENA_TYPE_5v5);
             break;
         case REPLAY_TOP_3V3SOLO_ALLTIME:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysAllTime(player, creature, ARENA_TYPE_3V3_SOLO_QUEUE);
+            ShowReplayList(player, creature, REPLAY_LIST_TOP_RATED, ARENA_TYPE_3V3_SOLO_QUEUE);
             break;
         case REPLAY_TOP_1V1_ALLTIME:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowReplaysAllTime(player, creature, ARENA_TYPE_1v1);
+            ShowReplayList(player, creature, REPLAY_LIST_TOP_RATED, ARENA_TYPE_1v1);
             break;
         case REPLAY_MOST_WATCHED_ALLTIME:
             player->PlayerTalkClass->SendCloseGossip();
-            ShowMostWatchedReplays(player, creature);
+            ShowReplayList(player, creature, REPLAY_LIST_MOST_WATCHED, 0);
             break;
         case MY_FAVORITE_MATCHES:
             player->PlayerTalkClass->SendCloseGossip();
@@ -2506,7 +5978,7 @@ public:
         return true;
     }
 
-    bool OnGossipSelectCode(Player* player, Creature* /* creature */, uint32 /* sender */, uint32 action, const char* code) override
+    bool OnGossipSelectCode(Player* player, Creature* creature, uint32 /* sender */, uint32 action, const char* code) override
     {
         if (!code)
         {
@@ -2519,7 +5991,7 @@ public:
         if (inputCode.find('\'') != std::string::npos ||
             inputCode.find('%') != std::string::npos ||
             inputCode.find(',') != std::string::npos ||
-            inputCode.length() > 50 ||
+            inputCode.length() > (action == REPLAY_SEARCH ? 100 : 50) ||
             inputCode.empty())
         {
             ChatHandler(player->GetSession()).PSendSysMessage("Invalid input.");
@@ -2532,317 +6004,131 @@ public:
         case REPLAY_MATCH_ID:
         {
             uint32 replayId;
-            try
-            {
-                replayId = std::stoi(code);
-            }
-            catch (...)
-            {
-                ChatHandler(player->GetSession()).PSendSysMessage("Invalid Match ID.");
-                CloseGossipMenuFor(player);
-                return false;
-            }
-
-            return replayArenaMatch(player, replayId);
-        }
-        case REPLAY_LIST_BY_PLAYERNAME:
-        {
-            CharacterCacheEntry const* playerData = sCharacterCache->GetCharacterCacheByName(std::string(code));
-            if (!playerData)
-            {
-                ChatHandler(player->GetSession()).PSendSysMessage("No player found with the name: {}", std::string(code));
-                CloseGossipMenuFor(player);
-                return false;
-            }
-
-            std::string playerGuidStr = std::to_string(playerData->Guid.GetRawValue());
-
-            QueryResult result = CharacterDatabase.Query("SELECT id FROM character_arena_replays WHERE winnerPlayerGuids LIKE '%{}%' OR loserPlayerGuids LIKE '%{}%'", playerGuidStr, playerGuidStr);
-            if (result)
-            {
-                ChatHandler(player->GetSession()).PSendSysMessage("Replays found for player: {}", std::string(code));
-                do
-                {
-                    Field* fields = result->Fetch();
-                    uint32 replayId = fields[0].Get<uint32>();
-                    ChatHandler(player->GetSession()).PSendSysMessage("Replay ID: {}", replayId);
-                    //AddGossipItemFor(player,) // to do: add gossips with the replays
-                } while (result->NextRow());
-
-                CloseGossipMenuFor(player);
-                return true;
-            }
-            else
-            {
-                ChatHandler(player->GetSession()).PSendSysMessage("No replays found for player: {}", std::string(code));
-                CloseGossipMenuFor(player);
-                return false;
-            }
-        }
-        case MY_FAVORITE_MATCHES:
-        {
-            try
-            {
-                uint32 NumberTyped = std::stoi(code);
-                FavoriteMatchId(player->GetGUID().GetCounter(), NumberTyped);
-                return true;
-            }
-            catch (...)
-            {
-                ChatHandler(player->GetSession()).PSendSysMessage("Invalid Match ID.");
-                CloseGossipMenuFor(player);
-                return false;
-            }
-        }
-        }
-
-        return false;
-    }
-
-private:
-
-    std::string GetClassIconById(uint8 id)
-    {
-        switch (id)
-        {
-        case CLASS_WARRIOR:
-            return "|TInterface\\icons\\inv_sword_27";
-        case CLASS_PALADIN:
-            return "|TInterface\\icons\\inv_hammer_01";
-        case CLASS_HUNTER:
-            return "|TInterface\\icons\\inv_weapon_bow_07";
-        case CLASS_ROGUE:
-            return "|TInterface\\icons\\inv_throwingknife_04";
-        case CLASS_PRIEST:
-            return "|TInterface\\icons\\inv_staff_30";
-        case CLASS_DEATH_KNIGHT:
-            return "|TInterface\\icons\\spell_deathknight_classicon";
-        case CLASS_SHAMAN:
-            return "|TInterface\\icons\\inv_jewelry_talisman_04";
-        case CLASS_MAGE:
-            return "|TInterface\\icons\\inv_staff_13";
-        case CLASS_WARLOCK:
-            return "|TInterface\\icons\\spell_nature_drowsy";
-        case CLASS_DRUID:
-            return "|TInterface\\icons\\inv_misc_monsterclaw_04";
-        default:
-            return "";
-        }
-    }
-
-    std::string GetRaceIconById(uint8 id, uint8 gender) {
-        const std::string gender_icon = gender == GENDER_MALE ? "male" : "female";
-        switch (id) {
-        case RACE_HUMAN:
-            return "|TInterface/ICONS/achievement_character_human_" + gender_icon;
-        case RACE_ORC:
-            return "|TInterface/ICONS/achievement_character_orc_" + gender_icon;
-        case RACE_DWARF:
-            return "|TInterface/ICONS/achievement_character_dwarf_" + gender_icon;
-        case RACE_NIGHTELF:
-            return "|TInterface/ICONS/achievement_character_nightelf_" + gender_icon;
-        case RACE_UNDEAD_PLAYER:
-            return "|TInterface/ICONS/achievement_character_undead_" + gender_icon;
-        case RACE_TAUREN:
-            return "|TInterface/ICONS/achievement_character_tauren_" + gender_icon;
-        case RACE_GNOME:
-            return "|TInterface/ICONS/achievement_character_gnome_" + gender_icon;
-        case RACE_TROLL:
-            return "|TInterface/ICONS/achievement_character_troll_" + gender_icon;
-        case RACE_BLOODELF:
-            return "|TInterface/ICONS/achievement_character_bloodelf_" + gender_icon;
-        case RACE_DRAENEI:
-            return "|TInterface/ICONS/achievement_character_draenei_" + gender_icon;
-        default:
-            return "";
-        }
-    }
-
-    std::string GetPlayersIconTexts(std::string playerGuids) {
-        std::string iconsTextTeam;
-        std::vector<std::string> playerGuidsTeam1;
+            try
+            {
+                replayId = std::stoi(code);
+            }
+            catch (...)
+            {
+                ChatHandler(player->GetSession()).PSendSysMessage("Invalid Match ID.");
+                CloseGossipMenuFor(player);
+                return false;
+            }
 
-        std::stringstream ssPlayerGuids(playerGuids);
-        std::string item;
+            return replayArenaMatch(player, replayId);
+        }
+        case REPLAY_LIST_BY_PLAYERNAME:
+        {
+            CharacterCacheEntry const* playerData = sCharacterCache->GetCharacterCacheByName(std::string(code));
+            if (!playerData)
+            {
+                ChatHandler(player->GetSession()).PSendSysMessage("No player found with the name: {}", std::string(code));
+                CloseGossipMenuFor(player);
+                return false;
+            }
 
-        while (std::getline(ssPlayerGuids, item, ','))
-            playerGuidsTeam1.push_back(item);
+            QueryResult result = CharacterDatabase.Query("SELECT replay_id FROM character_arena_replay_participants WHERE player_guid = {} ORDER BY replay_id DESC LIMIT {}",
+                playerData->Guid.GetCounter(), REPLAY_SEARCH_LIMIT);
+            if (result)
+            {
+                ChatHandler(player->GetSession()).PSendSysMessage("Latest replays found for player: {}", std::string(code));
+                do
+                {
+                    Field* fields = result->Fetch();
+                    uint32 replayId = fields[0].Get<uint32>();
+                    ChatHandler(player->GetSession()).PSendSysMessage("Replay ID: {}", replayId);
+                    //AddGossipItemFor(player,) // to do: add gossips with the replays
+                } while (result->NextRow());
 
-        for (const std::string& guid : playerGuidsTeam1)
-        {
-            uint64 _guid = std::stoi(guid);
-            CharacterCacheEntry const* playerData = sCharacterCache->GetCharacterCacheByGuid(ObjectGuid(_guid));
-            if (playerData)
+                CloseGossipMenuFor(player);
+                return true;
+            }
+            else
             {
-                iconsTextTeam += GetClassIconById(playerData->Class) + ":14:14:05:00|t|r";
-                iconsTextTeam += GetRaceIconById(playerData->Race, playerData->Sex) + ":14:14:05:00|t|r ";
+                ChatHandler(player->GetSession()).PSendSysMessage("No replays found for player: {}", std::string(code));
+                CloseGossipMenuFor(player);
+                return false;
             }
         }
+        case REPLAY_SEARCH:
+        {
+            ReplaySearchQuery query;
+            std::string error;
+            if (!ParseReplaySearchQuery(inputCode, query, error))
+            {
+                ChatHandler(player->GetSession()).SendSysMessage(error);
+                CloseGossipMenuFor(player);
+                return false;
+            }
 
-        if (!iconsTextTeam.empty() && iconsTextTeam.back() == '\n')
-            iconsTextTeam.pop_back();
+            std::vector<ReplaySearchRow> rows = ReplaySearchIndex::Instance().Search(query, REPLAY_FILTER_RESULTS);
+            std::vector<ReplayInfo> matchInfos;
+            if (!rows.empty())
+            {
+                std::string replayIds;
+                for (ReplaySearchRow const& row : rows)
+                {
+                    if (!replayIds.empty())
+                        replayIds += ", ";
 
-        return iconsTextTeam;
-    }
+                    replayIds += std::to_string(row.id);
+                }
 
-    void AppendPlayerGuidsFromList(std::vector<uint64>& guids, std::string const& guidList)
-    {
-        if (guidList.empty())
-            return;
+                matchInfos = ReadReplayInfos(CharacterDatabase.Query("SELECT {} FROM {} WHERE id IN ({}) ORDER BY id DESC", REPLAY_INFO_COLUMNS, REPLAY_TABLE, replayIds));
+            }
 
-        std::stringstream ss(guidList);
-        std::string entry;
-        while (std::getline(ss, entry, ','))
+            player->PlayerTalkClass->ClearMenus();
+            ShowReplays(player, creature, matchInfos, std::nullopt);
+            return true;
+        }
+        case MY_FAVORITE_MATCHES:
         {
-            auto begin = entry.find_first_not_of(" \t\n\r");
-            if (begin == std::string::npos)
-                continue;
-
-            auto end = entry.find_last_not_of(" \t\n\r");
-            if (end == std::string::npos)
-                continue;
-
-            std::string trimmed = entry.substr(begin, end - begin + 1);
-            if (trimmed.empty())
-                continue;
-
             try
             {
-                guids.push_back(std::stoull(trimmed));
+                uint32 NumberTyped = std::stoi(code);
+                FavoriteMatchId(player->GetGUID().GetCounter(), NumberTyped);
+                return true;
             }
             catch (...)
             {
-                continue;
+                ChatHandler(player->GetSession()).PSendSysMessage("Invalid Match ID.");
+                CloseGossipMenuFor(player);
+                return false;
             }
         }
-    }
-
-    struct ReplayInfo
-    {
-        uint32 matchId;
-
-        std::string winnerPlayerGuids;
-        std::string winnerTeamName;
-        uint32 winnerTeamRating;
-
-        std::string loserPlayerGuids;
-        std::string loserTeamName;
-        uint32 loserTeamRating;
-
-        //uint32 winnerMMR;
-        //uint32 loserMMR;
-    };
-
-    std::string GetGossipText(ReplayInfo info) {
-        std::string iconsTextTeam1 = GetPlayersIconTexts(info.winnerPlayerGuids);
-        std::string iconsTextTeam2 = GetPlayersIconTexts(info.loserPlayerGuids);
-
-        std::string coloredWinnerTeamName = "|cff33691E" + info.winnerTeamName + "|r";
-        std::string LoserTeamName = info.loserTeamName;
-
-        std::string gossipText = ("[" + std::to_string(info.matchId) + "] (" +
-            std::to_string(info.winnerTeamRating) + ")" +
-            iconsTextTeam1 + "" +
-            " '" + coloredWinnerTeamName + "'" +
-            "\n vs (" + std::to_string(info.loserTeamRating) + ")" +
-            iconsTextTeam2 + "" +
-            " '" + LoserTeamName + "'");
-
-        return gossipText;
-    }
-
-    void ShowReplaysAllTime(Player* player, Creature* creature, uint8 arenaTypeId)
-    {
-        auto matchInfos = loadReplaysAllTimeByArenaType(arenaTypeId);
-        ShowReplays(player, creature, matchInfos);
-    }
-
-    std::vector<ReplayInfo> loadReplaysAllTimeByArenaType(uint8 arenaTypeId)
-    {
-        std::vector<ReplayInfo> records;
-        QueryResult result = CharacterDatabase.Query("SELECT id, winnerTeamName, winnerTeamRating, winnerPlayerGuids, loserTeamName, loserTeamRating, loserPlayerGuids FROM character_arena_replays WHERE arenaTypeId = {} ORDER BY winnerTeamRating DESC LIMIT 20", arenaTypeId);
-
-        if (!result)
-            return records;
-
-        do
-        {
-            Field* fields = result->Fetch();
-            if (!fields)
-                return records;
-
-            ReplayInfo info;
-            info.matchId = fields[0].Get<uint32>();
-            info.winnerTeamName = fields[1].Get<std::string>();
-            info.winnerTeamRating = fields[2].Get<uint32>();
-            info.winnerPlayerGuids = fields[3].Get<std::string>();
-            info.loserTeamName = fields[4].Get<std::string>();
-            info.loserTeamRating = fields[5].Get<uint32>();
-            info.loserPlayerGuids = fields[6].Get<std::string>();
-
-            records.push_back(info);
-        } while (result->NextRow());
-
-        return records;
-    }
+        }
 
-    void ShowReplaysLast30Days(Player* player, Creature* creature, uint8 arenaTypeId)
-    {
-        auto matchInfos = loadReplaysLast30Days(arenaTypeId);
-        ShowReplays(player, creature, matchInfos);
+        return false;
     }
 
-    std::vector<ReplayInfo> loadReplaysLast30Days(uint8 arenaTypeId)
+private:
+    // First pages come from the leaderboards, later ones from the DB after the cursor.
+    void ShowReplayList(Player* player, Creature* creature, uint8 list, uint8 arenaTypeId, std::optional<ReplayPageCursor> after = std::nullopt)
     {
-        std::vector<ReplayInfo> records;
-
-        std::time_t now = std::time(nullptr);
-        std::tm* tmNow = std::localtime(&now);
-        tmNow->tm_mday -= 30;
-        std::mktime(tmNow);
-
-        std::stringstream ss;
-        ss << std::put_time(tmNow, "%Y-%m-%d %H:%M:%S");
-        std::string thirtyDaysAgo = ss.str();
-
-        // Only show games that are 30 days old
-        QueryResult result = CharacterDatabase.Query(
-            "SELECT id, winnerTeamName, winnerTeamRating, winnerPlayerGuids, loserTeamName, loserTeamRating, loserPlayerGuids, timestamp "
-            "FROM character_arena_replays "
-            "WHERE arenaTypeId = {} AND timestamp >= '{}' "
-            "ORDER BY id DESC LIMIT 20", arenaTypeId, thirtyDaysAgo.c_str());
-
-        if (!result)
-            return records;
+        size_t pageSize = ReplayListPageSize(list);
+        std::vector<ReplayInfo> matchInfos;
+        if (after && list == REPLAY_LIST_MOST_WATCHED)
+            matchInfos = LoadMostWatchedPage(*after, pageSize + 1);
+        else if (after)
+            matchInfos = LoadReplayListPage(*after, pageSize + 1);
+        else if (list == REPLAY_LIST_TOP_RATED)
+            matchInfos = ReplayLeaderboards::Instance().TopRated(arenaTypeId);
+        else if (list == REPLAY_LIST_LATEST)
+            matchInfos = ReplayLeaderboards::Instance().Latest(arenaTypeId);
+        else
+            matchInfos = ReplayLeaderboards::Instance().MostWatched();
 
-        do
+        std::optional<ReplayPageCursor> next;
+        if (matchInfos.size() > pageSize)
         {
-            Field* fields = result->Fetch();
-            if (!fields)
-                return records;
-
-            ReplayInfo info;
-            info.matchId = fields[0].Get<uint32>();
-            info.winnerTeamName = fields[1].Get<std::string>();
-            info.winnerTeamRating = fields[2].Get<uint32>();
-            info.winnerPlayerGuids = fields[3].Get<std::string>();
-            info.loserTeamName = fields[4].Get<std::string>();
-            info.loserTeamRating = fields[5].Get<uint32>();
-            info.loserPlayerGuids = fields[6].Get<std::string>();
-
-            records.push_back(info);
-        } while (result->NextRow());
-
-        return records;
-    }
+            matchInfos.resize(pageSize);
+            next = ReplayPageCursorAfter(list, arenaTypeId, matchInfos.back());
+        }
 
-    void ShowMostWatchedReplays(Player* player, Creature* creature)
-    {
-        auto matchInfos = loadMostWatchedReplays();
-        ShowReplays(player, creature, matchInfos);
+        ShowReplays(player, creature, matchInfos, next);
     }
 
-    void ShowReplays(Player* player, Creature* creature, std::vector<ReplayInfo> matchInfos) {
+    void ShowReplays(Player* player, Creature* creature, std::vector<ReplayInfo> const& matchInfos, std::optional<ReplayPageCursor> next) {
         if (matchInfos.empty())
             AddGossipItemFor(player, GOSSIP_ICON_TAXI, "No replays found.", GOSSIP_SENDER_MAIN, GOSSIP_ACTION_INFO_DEF);
         else
@@ -2850,75 +6136,72 @@ private:
             AddGossipItemFor(player, GOSSIP_ICON_TRAINER, "[Replay ID] (Team Rating) 'Team Name'\n----------------------------------------------", GOSSIP_SENDER_MAIN, GOSSIP_ACTION_INFO_DEF); // Back to Main Menu
             for (const auto& info : matchInfos)
             {
-                const std::string gossipText = GetGossipText(info);
                 const uint32 actionOffset = GOSSIP_ACTION_INFO_DEF + 30;
-                AddGossipItemFor(player, GOSSIP_ICON_BATTLE, gossipText, GOSSIP_SENDER_MAIN, actionOffset + info.matchId);
+                AddGossipItemFor(player, GOSSIP_ICON_BATTLE, info.gossipText, GOSSIP_SENDER_MAIN, actionOffset + info.matchId);
             }
         }
 
+        SetNextPage(player, next);
+
         AddGossipItemFor(player, GOSSIP_ICON_TAXI, "Back", GOSSIP_SENDER_MAIN, GOSSIP_ACTION_INFO_DEF);
         SendGossipMenuFor(player, DEFAULT_GOSSIP_MESSAGE, creature->GetGUID());
     }
 
-    std::vector<ReplayInfo> loadMostWatchedReplays()
+    // remembers where the menu sent to the player continues, and adds its "Next Page" item
+    void SetNextPage(Player* player, std::optional<ReplayPageCursor> const& next)
     {
-        std::vector<ReplayInfo> records;
-        QueryResult result = CharacterDatabase.Query(
-            "SELECT id, winnerTeamName, winnerTeamRating, winnerPlayerGuids, loserTeamName, loserTeamRating, loserPlayerGuids "
-            "FROM character_arena_replays "
-            "ORDER BY timesWatched DESC, winnerTeamRating DESC "
-            "LIMIT 28");
-
-        if (!result)
-            return records;
-
-        do
+        if (!next)
         {
-            Field* fields = result->Fetch();
-            if (!fields)
-                return records;
-
-            ReplayInfo info;
-            info.matchId = fields[0].Get<uint32>();
-            info.winnerTeamName = fields[1].Get<std::string>();
-            info.winnerTeamRating = fields[2].Get<uint32>();
-            info.winnerPlayerGuids = fields[3].Get<std::string>();
-            info.loserTeamName = fields[4].Get<std::string>();
-            info.loserTeamRating = fields[5].Get<uint32>();
-            info.loserPlayerGuids = fields[6].Get<std::string>();
-
-            records.push_back(info);
-        } while (result->NextRow());
+            _nextPages.erase(player->GetGUID().GetCounter());
+            return;
+        }
 
-        return records;
+        _nextPages[player->GetGUID().GetCounter()] = *next;
+        AddGossipItemFor(player, GOSSIP_ICON_TAXI, "Next Page", REPLAY_NEXT_PAGE_SENDER, GOSSIP_ACTION_INFO_DEF);
     }
 
-    void ShowSavedReplays(Player* player, Creature* creature, bool firstPage = true)
+    // afterSavedId: the character_saved_replays id of the last row of the previous page
+    void ShowSavedReplays(Player* player, Creature* creature, uint32 afterSavedId = 0)
     {
         AddGossipItemFor(player, GOSSIP_ICON_CHAT, "Favorite a Match ID", GOSSIP_SENDER_MAIN, MY_FAVORITE_MATCHES, "", 0, true);
 
-        std::string sortOrder = (firstPage) ? "ASC" : "DESC";
-        QueryResult result = CharacterDatabase.Query("SELECT replay_id FROM character_saved_replays WHERE character_id = " + std::to_string(player->GetGUID().GetCounter()) + " ORDER BY id " + sortOrder + " LIMIT 29");
+        QueryResult result = CharacterDatabase.Query("SELECT id, replay_id FROM character_saved_replays WHERE character_id = {} AND id > {} ORDER BY id LIMIT {}",
+            player->GetGUID().GetCounter(), afterSavedId, REPLAY_SAVED_PAGE_SIZE + 1);
         if (!result)
             AddGossipItemFor(player, GOSSIP_ICON_TAXI, "No saved replays found.", GOSSIP_SENDER_MAIN, GOSSIP_ACTION_INFO_DEF);
         else
         {
+            size_t shown = 0;
+            uint32 lastSavedId = 0;
+            bool more = false;
             do
             {
                 Field* fields = result->Fetch();
                 if (!fields)
                     break;
 
-                uint32 matchId = fields[0].Get<uint32>();
+                if (shown == REPLAY_SAVED_PAGE_SIZE)
+                {
+                    more = true;
+                    break;
+                }
+
+                lastSavedId = fields[0].Get<uint32>();
+                uint32 matchId = fields[1].Get<uint32>();
                 const uint32 actionOffset = GOSSIP_ACTION_INFO_DEF + 30;
                 AddGossipItemFor(player, GOSSIP_ICON_BATTLE, "Replay match " + std::to_string(matchId), GOSSIP_SENDER_MAIN, actionOffset + matchId);
-
+                ++shown;
             } while (result->NextRow());
 
-            if (firstPage) // to do
+            std::optional<ReplayPageCursor> next;
+            if (more)
             {
-                //AddGossipItemFor(player, GOSSIP_ICON_TAXI, "Next Page", GOSSIP_SENDER_MAIN, GOSSIP_ACTION_INFO_DEF + 1);
+                next.emplace();
+                next->list = REPLAY_LIST_SAVED;
+                next->lastId = lastSavedId;
             }
+
+            SetNextPage(player, next);
         }
         AddGossipItemFor(player, GOSSIP_ICON_TAXI, "Back", GOSSIP_SENDER_MAIN, GOSSIP_ACTION_INFO_DEF);
         SendGossipMenuFor(player, DEFAULT_GOSSIP_MESSAGE, creature->GetGUID());
@@ -2927,11 +6210,18 @@ private:
     void FavoriteMatchId(uint64 playerGuid, uint32 code)
     {
         // Need to check if the match exists in character_arena_replays, then insert in character_saved_replays
-        QueryResult result = CharacterDatabase.Query("SELECT id FROM character_arena_replays WHERE id = " + std::to_string(code));
+        QueryResult result = QueryReplayRow("id", code);
         if (result)
         {
-            std::string query = "INSERT INTO character_saved_replays (character_id, replay_id) VALUES (" + std::to_string(playerGuid) + ", " + std::to_string(code) + ")";
-            CharacterDatabase.Execute(query.c_str());
+            // The replay is copied to the archive with the favorite, so dropping its week
+            // can never lose it. A favorite is only stored once its replay is in the
+            // archive: when the week was dropped in between, neither row is written.
+            CharacterDatabaseTransaction trans = CharacterDatabase.BeginTransaction();
+            trans->Append("INSERT IGNORE INTO {} SELECT * FROM {} WHERE id = {}", REPLAY_ARCHIVE_TABLE, REPLAY_TABLE, code);
+            trans->Append("INSERT INTO character_saved_replays (character_id, replay_id) SELECT {}, id FROM {} WHERE id = {}",
+                playerGuid, REPLAY_ARCHIVE_TABLE, code);
+            CharacterDatabase.CommitTransaction(trans);
+            ReplaySearchIndex::Instance().AddFavorite(code);
 
             if (Player* player = ObjectAccessor::FindPlayer(ObjectGuid::Create<HighGuid::Player>(playerGuid)))
             {
@@ -2959,13 +6249,14 @@ private:
             return false;
         }
 
-        if (!loadReplayDataForPlayer(player, replayId))
+        std::shared_ptr<MatchRecord> loaded = loadReplayDataForPlayer(player, replayId);
+        if (!loaded)
         {
             CloseGossipMenuFor(player);
             return false;
         }
 
-        MatchRecord const& record = loadedReplays.at(replayId);
+        MatchRecord const& record = *loaded;
 
         Battleground* bg = sBattlegroundMgr->CreateNewBattleground(record.typeId, GetBattlegroundBracketByLevel(record.mapId, sWorld->getIntConfig(CONFIG_MAX_PLAYER_LEVEL)), record.arenaTypeId, false);
         if (!bg)
@@ -2976,6 +6267,7 @@ private:
         }
 
         bgReplayIds[bg->GetInstanceID()] = replayId;
+        replayPlaybacks[bg->GetInstanceID()] = ReplayPlayback{ std::move(loaded) };
 
         TeamId teamId = Player::TeamIdForRace(player->getRace());
         bg->IncreaseInvitedCount(teamId);
@@ -3009,14 +6301,34 @@ private:
         return true;
     }
 
-    bool loadReplayDataForPlayer(Player* p, uint32 matchId)
+    std::shared_ptr<MatchRecord> loadReplayDataForPlayer(Player* p, uint32 matchId)
     {
-        QueryResult result = CharacterDatabase.Query("SELECT id, arenaTypeId, typeId, contentSize, contents, mapId, timesWatched, winnerPlayerGuids, loserPlayerGuids FROM character_arena_replays WHERE id = {}", matchId);
+        // another battleground is playing this replay already, share its packets unless it freed the start
+        auto loadedIt = loadedReplays.find(matchId);
+        if (loadedIt != loadedReplays.end())
+        {
+            std::shared_ptr<MatchRecord> loaded = loadedIt->second.match.lock();
+            if (loaded && !loaded->releasedPackets)
+            {
+                ReplayWatchCounter::Instance().Add(matchId);
+                ReplayInfo& summary = loadedIt->second.summary;
+                ++summary.timesWatched;
+                ReplayLeaderboards::Instance().OnWatched(summary);
+
+                sArenaReplayMetrics.sharedLoads.Add();
+                return loaded;
+            }
+        }
+
+        auto queryStart = std::chrono::steady_clock::now();
+        QueryResult result = QueryReplayRow(Acore::StringFormat("id, arenaTypeId, typeId, contentSize, contents, mapId, timesWatched, winnerPlayerGuids, loserPlayerGuids, {}",
+            REPLAY_INFO_COLUMNS), matchId);
+        RecordArenaReplayStage(sArenaReplayMetrics.loadQuery, "load.db", matchId, queryStart, std::chrono::steady_clock::now());
         if (!result)
         {
             ChatHandler(p->GetSession()).PSendSysMessage("Replay data not found.");
             CloseGossipMenuFor(p);
-            return false;
+            return nullptr;
         }
 
         Field* fields = result->Fetch();
@@ -3024,120 +6336,289 @@ private:
         {
             ChatHandler(p->GetSession()).PSendSysMessage("Replay data not found.");
             CloseGossipMenuFor(p);
-            return false;
+            return nullptr;
         }
 
-        MatchRecord record;
-        record.replayId = matchId;
+        auto record = std::make_shared<MatchRecord>();
+        record->replayId = matchId;
+        record->arenaTypeId = uint8(fields[1].Get<uint32>());
+        record->typeId = BattlegroundTypeId(fields[2].Get<uint32>());
+        record->mapId = fields[5].Get<uint32>();
         if (!fields[7].IsNull())
-            AppendPlayerGuidsFromList(record.participantGuids, fields[7].Get<std::string>());
+            AppendPlayerGuidsFromList(record->participantGuids, fields[7].Get<std::string>());
 
         if (!fields[8].IsNull())
-            AppendPlayerGuidsFromList(record.participantGuids, fields[8].Get<std::string>());
+            AppendPlayerGuidsFromList(record->participantGuids, fields[8].Get<std::string>());
 
-        deserializeMatchData(record, fields);
+        // decoded and remapped on the loader thread; the battleground starts on the first chunk
+        ReplayStreamLoader::Instance().Load(record, fields[4].Get<std::string>(), queryStart);
 
-        // Update 'timesWatched' of a Replay +1 everytime someone watches it
-        uint32 timesWatched = fields[6].Get<uint32>();
-        timesWatched++;
-        CharacterDatabase.Execute("UPDATE character_arena_replays SET timesWatched = {} WHERE id = {}", timesWatched, matchId);
+        // the stored count plus the watches not stored yet, this one included
+        uint32 timesWatched = fields[6].Get<uint32>() + ReplayWatchCounter::Instance().Add(matchId);
 
-        RemapReplayGuids(record);
+        ReplayInfo summary = ReadReplayInfo(fields, 9);
+        summary.timesWatched = timesWatched;
+        summary.gossipText = FormatReplayGossipText(summary, LoadReplayRosters({ matchId })[matchId]);
+        ReplayLeaderboards::Instance().OnWatched(summary);
 
-        loadedReplays[matchId] = std::move(record);
-        return true;
+        std::erase_if(loadedReplays, [](auto const& entry) { return entry.second.match.expired(); });
+        loadedReplays[matchId] = { record, std::move(summary) };
+        return record;
     }
 
-    void deserializeMatchData(MatchRecord& record, Field* fields)
+    std::unordered_map<uint32, ReplayPageCursor> _nextPages; // by player guid, the page after the last list menu sent
+};
+
+class ConfigLoaderArenaReplay : public WorldScript
+{
+public:
+    ConfigLoaderArenaReplay() : WorldScript("config_loader_arena_replay", {
+        WORLDHOOK_ON_AFTER_CONFIG_LOAD
+        }) {
+    }
+    virtual void OnAfterConfigLoad(bool /*Reload*/) override
     {
-        record.arenaTypeId = uint8(fields[1].Get<uint32>());
-        record.typeId = BattlegroundTypeId(fields[2].Get<uint32>());
-        auto encodedData = Acore::Encoding::Base32::Decode(fields[4].Get<std::string>());
-        if (!encodedData)
-            return;
+        sArenaReplayConfig.Publish(LoadArenaReplayConfig());
+    }
+};
 
-        record.mapId = uint32(fields[5].Get<uint32>());
-        ByteBuffer buffer;
-        if (!encodedData->empty())
-            buffer.append(encodedData->data(), encodedData->size());
+class ArenaReplayWorldScript : public WorldScript
+{
+public:
+    ArenaReplayWorldScript() : WorldScript("ArenaReplayWorldScript", {
+        WORLDHOOK_ON_STARTUP,
+        WORLDHOOK_ON_UPDATE,
+        WORLDHOOK_ON_SHUTDOWN
+        }) {
+    }
 
-        /** deserialize replay binary data **/
-        uint32 packedPacketSize;
-        uint32 packetTimestamp;
-        uint16 opcode;
-        while (buffer.rpos() < buffer.size())
-        {
-            if (buffer.size() - buffer.rpos() < sizeof(uint32))
-                break;
+    void OnStartup() override
+    {
+#ifdef ARENA_REPLAY_ZSTD
+        ReplayDictionaryStore::Instance().Load();
+#endif
+        ReplayLeaderboards::Instance().Seed();
+        ReplaySearchIndex::Instance().Start();
+        if (sArenaReplayConfig.Get().storageMaintenanceInterval)
+            ReplayPartitionMaintainer::Instance().Start();
+    }
 
-            buffer >> packedPacketSize;
-            bool hasSourceGuid = (packedPacketSize & 0x80000000u) != 0;
-            uint32 packetSize = packedPacketSize & 0x7FFFFFFFu;
+    void OnUpdate(uint32 diff) override
+    {
+        ArenaReplayConfig const& config = sArenaReplayConfig.Get();
+        UpdateStorageMaintenance(config, diff);
+        UpdateWatchCountFlush(config, diff);
+        UpdateMetricsLog(config, diff);
+    }
 
-            if (buffer.size() - buffer.rpos() < sizeof(uint32) + sizeof(uint16))
-                break;
+    void OnShutdown() override
+    {
+        ReplayWatchCounter::Instance().Flush(true);
+        ReplayStreamLoader::Instance().Stop();
+        ReplayWorkPool::Instance().Resize(0);
+        ReplaySearchIndex::Instance().Stop(); // first, so a build on the maintenance thread gives up too
+        ReplayPartitionMaintainer::Instance().Stop();
+#ifdef ARENA_REPLAY_ZSTD
+        ReplayDictionaryTrainer::Instance().Stop();
+#endif
+    }
 
-            buffer >> packetTimestamp;
-            buffer >> opcode;
+private:
+    void UpdateStorageMaintenance(ArenaReplayConfig const& config, uint32 diff)
+    {
+        uint32 interval = config.storageMaintenanceInterval * IN_MILLISECONDS;
+        if (!interval)
+            return;
 
-            uint64 sourceGuid = 0;
-            if (hasSourceGuid)
-            {
-                if (buffer.size() - buffer.rpos() < sizeof(uint64))
-                    break;
+        _storageMaintenanceTimer += diff;
+        if (_storageMaintenanceTimer < interval)
+            return;
 
-                buffer >> sourceGuid;
-            }
+        _storageMaintenanceTimer = 0;
+        ReplayPartitionMaintainer::Instance().Start();
+    }
 
-            if (buffer.size() - buffer.rpos() < packetSize)
-                break;
+    void UpdateWatchCountFlush(ArenaReplayConfig const& config, uint32 diff)
+    {
+        _watchCountFlushTimer += diff;
+        if (_watchCountFlushTimer < config.watchCountFlushInterval * IN_MILLISECONDS)
+            return;
 
-            WorldPacket packet(opcode, packetSize);
+        _watchCountFlushTimer = 0;
+        ReplayWatchCounter::Instance().Flush();
+    }
 
-            if (packetSize > 0)
-            {
-                std::vector<uint8> tmp(packetSize, 0);
-                buffer.read(&tmp[0], packetSize);
-                packet.append(&tmp[0], packetSize);
-            }
+    void UpdateMetricsLog(ArenaReplayConfig const& config, uint32 diff)
+    {
+        uint32 metricsLogInterval = config.metricsLogInterval * IN_MILLISECONDS;
+        if (!metricsLogInterval)
+            return;
 
-            record.packets.push_back({ packetTimestamp, packet, sourceGuid });
-        }
+        _metricsLogTimer += diff;
+        if (_metricsLogTimer < metricsLogInterval)
+            return;
+
+        _metricsLogTimer = 0;
+        uint64 activity = GetArenaReplayActivity();
+        if (activity == _lastLoggedActivity)
+            return;
+
+        _lastLoggedActivity = activity;
+        LOG_INFO("modules", "ArenaReplay: {}", FormatArenaReplayMetrics());
     }
+
+    uint32 _storageMaintenanceTimer = 0;
+    uint32 _watchCountFlushTimer = 0;
+    uint32 _metricsLogTimer = 0;
+    uint64 _lastLoggedActivity = 0;
 };
 
-class ConfigLoaderArenaReplay : public WorldScript
+using namespace Acore::ChatCommands;
+
+class ArenaReplayCommandScript : public CommandScript
 {
 public:
-    ConfigLoaderArenaReplay() : WorldScript("config_loader_arena_replay", {
-        WORLDHOOK_ON_AFTER_CONFIG_LOAD
-        }) {
+    ArenaReplayCommandScript() : CommandScript("ArenaReplayCommandScript") { }
+
+    ChatCommandTable GetCommands() const override
+    {
+        static ChatCommandTable replayDictCommandTable =
+        {
+            { "train", HandleReplayDictTrainCommand, SEC_ADMINISTRATOR, Console::Yes }
+        };
+
+        static ChatCommandTable replayCommandTable =
+        {
+            { "dict", replayDictCommandTable },
+            { "search", HandleReplaySearchCommand, SEC_PLAYER, Console::Yes },
+            { "stats", HandleReplayStatsCommand, SEC_GAMEMASTER, Console::Yes },
+            { "trace", HandleReplayTraceCommand, SEC_ADMINISTRATOR, Console::Yes }
+        };
+
+        static ChatCommandTable commandTable =
+        {
+            { "replay", replayCommandTable }
+        };
+
+        return commandTable;
     }
-    virtual void OnAfterConfigLoad(bool /*Reload*/) override
+
+    static bool HandleReplayDictTrainCommand(ChatHandler* handler, Optional<uint32> replaysPerMap)
+    {
+#ifdef ARENA_REPLAY_ZSTD
+        if (ReplayDictionaryTrainer::Instance().Running())
+        {
+            handler->PSendSysMessage("Dictionary training is already running.");
+            handler->SetSentErrorMessage(true);
+            return false;
+        }
+
+        uint32 count = std::clamp<uint32>(replaysPerMap.value_or(200), 10, 2000);
+        ReplayDictionaryTrainer::Instance().Start(count);
+        handler->PSendSysMessage("Training dictionaries from up to {} replays per map in the background, the results are logged when done.", count);
+        return true;
+#else
+        (void)replaysPerMap;
+        handler->SendSysMessage("This build has no zstd support, rebuild with ARENA_REPLAY_WITH_ZSTD.");
+        handler->SetSentErrorMessage(true);
+        return false;
+#endif
+    }
+
+    static bool HandleReplaySearchCommand(ChatHandler* handler, Tail filters)
     {
-        DeleteOldReplays();
+        ReplaySearchQuery query;
+        std::string error;
+        if (!ParseReplaySearchQuery(filters, query, error))
+        {
+            handler->SendSysMessage(error);
+            handler->SetSentErrorMessage(true);
+            return false;
+        }
+
+        ReplaySearchIndex& index = ReplaySearchIndex::Instance();
+        size_t candidates = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<ReplaySearchRow> rows = index.Search(query, REPLAY_FILTER_RESULTS, &candidates);
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        handler->PSendSysMessage("{} replays found, newest first ({} candidates of {} indexed replays checked) in {:.3f} ms{}",
+            rows.size(), candidates, index.Size(), elapsed, index.Building() ? ", index still building" : "");
+
+        uint64 now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        for (ReplaySearchRow const& row : rows)
+        {
+            handler->PSendSysMessage("  Replay {}: type {} map {}, rating {}, {} vs {}, {}, {} hours ago",
+                row.id,
+                uint32(row.arenaTypeId),
+                row.mapId,
+                row.winnerTeamRating,
+                FormatReplayClassLetters(row.winnerClasses),
+                FormatReplayClassLetters(row.loserClasses),
+                row.duration ? Acore::StringFormat("{}s", row.duration) : std::string("unknown length"),
+                (now - std::min(now, row.timestamp)) / HOUR);
+        }
+
+        return true;
     }
 
-private:
-    void DeleteOldReplays()
+    static bool HandleReplayStatsCommand(ChatHandler* handler)
     {
-        // delete all the replays older than X days
-        const auto days = sConfigMgr->GetOption<uint32>("ArenaReplay.DeleteReplaysAfterDays", 30);
-        if (days > 0)
+        handler->PSendSysMessage("ArenaReplay: {}", FormatArenaReplayMetrics());
+
+        ArenaReplayMetrics const& metrics = sArenaReplayMetrics;
+        handler->SendSysMessage(FormatArenaReplayLatency("record (sampled)", metrics.recordHook));
+        handler->SendSysMessage(FormatArenaReplayLatency("save", metrics.save));
+        handler->SendSysMessage(FormatArenaReplayLatency("load", metrics.load));
+        handler->SendSysMessage(FormatArenaReplayLatency("load.db", metrics.loadQuery));
+        handler->SendSysMessage(FormatArenaReplayLatency("load.decode", metrics.loadDecode));
+        handler->SendSysMessage(FormatArenaReplayLatency("load.remap", metrics.loadRemap));
+        handler->SendSysMessage(FormatArenaReplayLatency("load.first", metrics.loadFirstChunk));
+        handler->SendSysMessage(FormatArenaReplayLatency("remap.extract", metrics.remapExtract));
+        handler->SendSysMessage(FormatArenaReplayLatency("remap.rewrite", metrics.remapRewrite));
+        handler->SendSysMessage(FormatArenaReplayLatency("playback.tick", metrics.playbackTick));
+
+        std::vector<std::pair<uint64, uint16>> opcodesByBytes;
+        for (uint16 opcode = 0; opcode < NUM_MSG_TYPES; ++opcode)
         {
-            std::string addition = "";
+            if (uint64 bytes = sArenaReplayMetrics.recorded.Bytes(opcode))
+                opcodesByBytes.emplace_back(bytes, opcode);
+        }
 
-            const bool deleteSavedReplays = sConfigMgr->GetOption<bool>("ArenaReplay.DeleteSavedReplays", false);
+        std::sort(opcodesByBytes.begin(), opcodesByBytes.end(), std::greater<>());
+        for (size_t i = 0; i < opcodesByBytes.size() && i < 10; ++i)
+        {
+            uint16 opcode = opcodesByBytes[i].second;
+            handler->PSendSysMessage("  {:<48} {:>9} packets {:>10} bytes recorded",
+                GetOpcodeNameForLogging(static_cast<Opcodes>(opcode)),
+                sArenaReplayMetrics.recorded.Packets(opcode),
+                opcodesByBytes[i].first);
+        }
 
-            if (!deleteSavedReplays)
-                addition = "AND `id` NOT IN (SELECT `replay_id` FROM `character_saved_replays`)";
+        return true;
+    }
 
-            const auto query = "DELETE FROM `character_arena_replays` WHERE `timestamp` < (NOW() - INTERVAL " + std::to_string(days) + " DAY) " + addition;
-            CharacterDatabase.Execute(query);
+    static bool HandleReplayTraceCommand(ChatHandler* handler, Optional<std::string> fileName)
+    {
+        // written to the worldserver working directory only
+        std::string path = fileName.value_or("arena_replay_trace.json");
+        if (path.empty() || path.find_first_of("/\\") != std::string::npos || path.find("..") != std::string::npos)
+        {
+            handler->SendSysMessage("Trace file name must not contain a path.");
+            handler->SetSentErrorMessage(true);
+            return false;
+        }
 
-            if (deleteSavedReplays)
-                CharacterDatabase.Execute("DELETE FROM `character_saved_replays` WHERE `replay_id` NOT IN (SELECT `id` FROM `character_arena_replays`)");
+        size_t spanCount = 0;
+        if (!WriteArenaReplayTrace(path, spanCount))
+        {
+            handler->PSendSysMessage("Could not write {}.", path);
+            handler->SetSentErrorMessage(true);
+            return false;
         }
+
+        handler->PSendSysMessage("Wrote {} trace spans to {}.", spanCount, path);
+        return true;
     }
 };
 
@@ -3148,4 +6629,6 @@ void AddArenaReplayScripts()
     new ArenaReplayBGScript();
     new ArenaReplayArenaScript();
     new ReplayGossip();
+    new ArenaReplayCommandScript();
+    new ArenaReplayWorldScript();
 }
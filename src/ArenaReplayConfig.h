@@ -0,0 +1,65 @@
+#ifndef _MOD_ARENA_REPLAY_CONFIG_H_
+#define _MOD_ARENA_REPLAY_CONFIG_H_
+
+#include "Define.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Typed copy of the ArenaReplay.* options, built once per config load so the
+// hooks read plain fields instead of doing a string lookup on every call.
+struct ArenaReplayConfig
+{
+    bool enable = true;
+    bool saveBattlegrounds = true;
+    bool saveUnratedArenas = true;
+    uint32 validArenaDuration = 75; // seconds, 0 saves every arena
+    uint32 maxPacketsToSend = 0;    // per replay, 0 is unlimited
+    uint8 storageFormat = 0;        // ReplayStorageFormat
+
+    uint32 playbackMaxPacketsPerTick = 200;  // 0 is unlimited
+    uint32 playbackMaxBytesPerTick = 65536;  // 0 is unlimited
+    bool playbackMergeUpdateObjects = true;
+
+    uint32 loadThreads = 0; // per replay load, 0 picks from the core count
+
+    bool arena1v1Enable = false;
+    uint8 arena1v1ArenaType = 1;
+    bool arena3v3SoloQEnable = false;
+    uint8 arena3v3SoloQArenaType = 4;
+
+    uint32 deleteReplaysAfterDays = 30;
+    bool deleteSavedReplays = false;
+    uint32 storageMaintenanceInterval = 3600; // seconds, 0 is disabled
+
+    uint32 watchCountFlushInterval = 60; // seconds, 0 flushes every world update
+    uint32 metricsLogInterval = 600;     // seconds
+};
+
+// Holds the current snapshot. A reload publishes a new one with a single
+// pointer swap; readers on map threads never lock.
+class ArenaReplayConfigStore
+{
+public:
+    ArenaReplayConfig const& Get() const { return *_current.load(std::memory_order_acquire); }
+
+    void Publish(ArenaReplayConfig const& config)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _snapshots.push_back(std::make_unique<ArenaReplayConfig const>(config));
+        _current.store(_snapshots.back().get(), std::memory_order_release);
+    }
+
+private:
+    // Retired snapshots are kept: a hook may still hold a reference to one,
+    // and a few structs per .reload config are not worth reclaiming.
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<ArenaReplayConfig const>> _snapshots;
+    ArenaReplayConfig const _defaults;
+    std::atomic<ArenaReplayConfig const*> _current{ &_defaults };
+};
+
+inline ArenaReplayConfigStore sArenaReplayConfig;
+
+#endif
@@ -0,0 +1,335 @@
+#ifndef _MOD_ARENA_REPLAY_METRICS_H_
+#define _MOD_ARENA_REPLAY_METRICS_H_
+
+#include "Define.h"
+#include "Opcodes.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counters are updated with relaxed atomics from whichever thread runs the
+// hook; readers only need eventually consistent totals.
+class ArenaReplayCounter
+{
+public:
+    void Add(uint64 value = 1) { _value.fetch_add(value, std::memory_order_relaxed); }
+    uint64 Get() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64> _value{ 0 };
+};
+
+class ArenaReplayGauge
+{
+public:
+    void Add(int64 value) { _value.fetch_add(value, std::memory_order_relaxed); }
+    int64 Get() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64> _value{ 0 };
+};
+
+class ArenaReplayMaxGauge
+{
+public:
+    void Update(uint64 value)
+    {
+        uint64 current = _value.load(std::memory_order_relaxed);
+        while (current < value && !_value.compare_exchange_weak(current, value, std::memory_order_relaxed))
+            ;
+    }
+
+    uint64 Get() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64> _value{ 0 };
+};
+
+// Latency distribution in log-linear buckets: four buckets per power of two
+// of nanoseconds, so a percentile is within about 12% of the true value.
+class ArenaReplayLatency
+{
+public:
+    void Record(std::chrono::steady_clock::duration elapsed)
+    {
+        uint64 nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        _count.Add();
+        _total.Add(nanoseconds);
+        _max.Update(nanoseconds);
+        _buckets[BucketIndex(nanoseconds)].Add();
+    }
+
+    uint64 Count() const { return _count.Get(); }
+    double AverageMilliseconds() const { return _count.Get() ? _total.Get() / 1e6 / _count.Get() : 0.0; }
+    double MaxMilliseconds() const { return _max.Get() / 1e6; }
+
+    // quantile in [0, 1]; returns the midpoint of the bucket holding it
+    double PercentileMilliseconds(double quantile) const
+    {
+        std::array<uint64, BUCKET_COUNT> counts;
+        uint64 total = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            counts[i] = _buckets[i].Get();
+            total += counts[i];
+        }
+
+        if (!total)
+            return 0.0;
+
+        uint64 rank = std::max<uint64>(1, static_cast<uint64>(quantile * total + 0.5));
+        uint64 seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+                return std::min<double>((BucketLowerBound(i) + BucketLowerBound(i + 1)) / 2.0, _max.Get()) / 1e6;
+        }
+
+        return MaxMilliseconds();
+    }
+
+private:
+    static constexpr size_t SUB_BUCKETS = 4;
+    static constexpr size_t BUCKET_COUNT = 64 * SUB_BUCKETS;
+
+    static size_t BucketIndex(uint64 value)
+    {
+        if (value < SUB_BUCKETS)
+            return static_cast<size_t>(value);
+
+        size_t exponent = std::bit_width(value) - 1;
+        size_t fraction = static_cast<size_t>(value >> (exponent - 2)) & (SUB_BUCKETS - 1);
+        return (exponent - 1) * SUB_BUCKETS + fraction;
+    }
+
+    static double BucketLowerBound(size_t index)
+    {
+        if (index < SUB_BUCKETS)
+            return static_cast<double>(index);
+
+        size_t exponent = index / SUB_BUCKETS + 1;
+        size_t fraction = index % SUB_BUCKETS;
+        return std::ldexp(1.0 + fraction / double(SUB_BUCKETS), static_cast<int>(exponent));
+    }
+
+    ArenaReplayCounter _count;
+    ArenaReplayCounter _total;
+    ArenaReplayMaxGauge _max;
+    std::array<ArenaReplayCounter, BUCKET_COUNT> _buckets;
+};
+
+// Completed spans of the slow operations (save, load and its stages, remap,
+// playback ticks), kept in a fixed ring so the latest ones can be exported
+// as Chrome trace events.
+class ArenaReplayTrace
+{
+public:
+    struct Span
+    {
+        char const* name = nullptr;
+        int64 startMicroseconds = 0;
+        int64 durationMicroseconds = 0;
+        uint64 thread = 0;
+        uint32 id = 0;
+    };
+
+    static constexpr size_t CAPACITY = 4096;
+
+    void Add(char const* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, uint32 id)
+    {
+        Span span;
+        span.name = name;
+        span.startMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(start.time_since_epoch()).count();
+        span.durationMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        span.thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+        span.id = id;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _spans[_next % CAPACITY] = span;
+        ++_next;
+    }
+
+    // oldest first
+    std::vector<Span> Snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<Span> spans;
+        size_t count = std::min<uint64>(_next, CAPACITY);
+        spans.reserve(count);
+        for (uint64 i = _next - count; i < _next; ++i)
+            spans.push_back(_spans[i % CAPACITY]);
+
+        return spans;
+    }
+
+private:
+    mutable std::mutex _mutex;
+    std::array<Span, CAPACITY> _spans{};
+    uint64 _next = 0;
+};
+
+inline ArenaReplayTrace sArenaReplayTrace;
+
+// Records the lifetime of the scope into a latency histogram and, when a
+// trace name is given, into the trace ring.
+class ArenaReplayScopedTimer
+{
+public:
+    explicit ArenaReplayScopedTimer(ArenaReplayLatency& latency, char const* traceName = nullptr, uint32 traceId = 0)
+        : _latency(latency), _traceName(traceName), _traceId(traceId), _start(std::chrono::steady_clock::now()) { }
+
+    ~ArenaReplayScopedTimer()
+    {
+        auto end = std::chrono::steady_clock::now();
+        _latency.Record(end - _start);
+        if (_traceName)
+            sArenaReplayTrace.Add(_traceName, _start, end, _traceId);
+    }
+
+    // names the span after the fact, for scopes only worth tracing when they did work
+    void Trace(char const* traceName, uint32 traceId)
+    {
+        _traceName = traceName;
+        _traceId = traceId;
+    }
+
+    ArenaReplayScopedTimer(ArenaReplayScopedTimer const&) = delete;
+    ArenaReplayScopedTimer& operator=(ArenaReplayScopedTimer const&) = delete;
+
+private:
+    ArenaReplayLatency& _latency;
+    char const* _traceName;
+    uint32 _traceId;
+    std::chrono::steady_clock::time_point _start;
+};
+
+// For stages bounded by clock reads the caller already has.
+inline void RecordArenaReplayStage(ArenaReplayLatency& latency, char const* traceName, uint32 traceId,
+    std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    latency.Record(end - start);
+    sArenaReplayTrace.Add(traceName, start, end, traceId);
+}
+
+// Per-opcode packet and byte counts for the recording hook. Each thread that
+// records owns a block and is its only writer, so an update is a relaxed load
+// and store instead of a locked add; readers sum the blocks of all threads.
+class ArenaReplayOpcodeCounters
+{
+public:
+    void Add(uint16 opcode, uint64 bytes)
+    {
+        if (opcode >= NUM_MSG_TYPES)
+            return;
+
+        Block& block = LocalBlock();
+        Bump(block.packets[opcode], 1);
+        Bump(block.bytes[opcode], bytes);
+    }
+
+    uint64 Packets(uint16 opcode) const { return Sum(&Block::packets, opcode); }
+    uint64 Bytes(uint16 opcode) const { return Sum(&Block::bytes, opcode); }
+
+    void Totals(uint64& packets, uint64& bytes) const
+    {
+        packets = 0;
+        bytes = 0;
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto const& block : _blocks)
+        {
+            for (size_t opcode = 0; opcode < NUM_MSG_TYPES; ++opcode)
+            {
+                packets += block->packets[opcode].load(std::memory_order_relaxed);
+                bytes += block->bytes[opcode].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Block
+    {
+        std::array<std::atomic<uint64>, NUM_MSG_TYPES> packets{};
+        std::array<std::atomic<uint64>, NUM_MSG_TYPES> bytes{};
+    };
+
+    static void Bump(std::atomic<uint64>& counter, uint64 value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    Block& LocalBlock()
+    {
+        thread_local Block* block = nullptr;
+        if (!block)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _blocks.push_back(std::make_unique<Block>());
+            block = _blocks.back().get();
+        }
+
+        return *block;
+    }
+
+    uint64 Sum(std::array<std::atomic<uint64>, NUM_MSG_TYPES> Block::* counters, uint16 opcode) const
+    {
+        uint64 total = 0;
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto const& block : _blocks)
+            total += ((*block).*counters)[opcode].load(std::memory_order_relaxed);
+
+        return total;
+    }
+
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<Block>> _blocks;
+};
+
+constexpr uint32 RECORD_HOOK_SAMPLE_RATE = 64;
+
+struct ArenaReplayMetrics
+{
+    // recording; the memory held by live recordings is the recorded bytes
+    // and packet records minus what finished recordings released
+    ArenaReplayOpcodeCounters recorded;
+    ArenaReplayGauge activeRecordings;
+
+    ArenaReplayLatency recordHook; // sampled, one call in RECORD_HOOK_SAMPLE_RATE
+
+    // saving and loading
+    ArenaReplayLatency save;
+    ArenaReplayLatency load;
+    ArenaReplayCounter sharedLoads; // served from a replay another battleground is playing
+    ArenaReplayLatency loadQuery;
+    ArenaReplayLatency loadDecode;
+    ArenaReplayLatency loadRemap;
+    ArenaReplayLatency loadFirstChunk; // from the request until the first chunk can be played
+    ArenaReplayLatency remapExtract;
+    ArenaReplayLatency remapRewrite;
+    ArenaReplayCounter inflateCalls;
+    ArenaReplayCounter deflateCalls;
+    ArenaReplayCounter compressedUpdatePackets;
+    ArenaReplayCounter inflatedPayloadReuses;
+
+    // playback
+    ArenaReplayLatency playbackTick;
+    ArenaReplayCounter playbackTicks;
+    ArenaReplayCounter sentPackets;
+    ArenaReplayCounter sentBytes;
+    ArenaReplayMaxGauge maxPacketsPerTick;
+    ArenaReplayCounter mergedUpdatePackets; // recorded packets sent inside a merged update object
+    ArenaReplayCounter budgetLimitedTicks;
+    ArenaReplayCounter loaderWaitTicks; // updates the replay clock was held for the streaming loader
+};
+
+inline ArenaReplayMetrics sArenaReplayMetrics;
+
+#endif
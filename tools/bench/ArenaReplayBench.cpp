@@ -0,0 +1,552 @@
+// Microbenchmarks for the replay hot paths, built against the stand-ins in
+// tools/stubs. Every benchmark reports allocs/op, the operator new calls of
+// one iteration (worker threads included). Run with
+// --benchmark_counters_tabular=true for readable per-operation counters.
+#include "ArenaReplay.cpp"
+#include "ArenaTrafficGenerator.h"
+#include "UpdateObjectValidation.h"
+#include <benchmark/benchmark.h>
+#include <new>
+#include <random>
+
+namespace
+{
+    std::atomic<uint64> allocations = 0;
+
+    // storage formats of this build: legacy, zlib and, with ARENA_REPLAY_WITH_ZSTD, zstd
+#ifdef ARENA_REPLAY_ZSTD
+    constexpr int64 REPLAY_BENCH_LAST_FORMAT = int64(ReplayStorageFormat::Zstd);
+#else
+    constexpr int64 REPLAY_BENCH_LAST_FORMAT = int64(ReplayStorageFormat::Zlib);
+#endif
+}
+
+// Every replaceable allocation function is replaced, so whatever form of
+// new or delete a call site picks, the block comes from and goes back to
+// malloc. The deletes are kept out of line: GCC would otherwise see free()
+// on a pointer it assumes came from the builtin operator new and warn.
+namespace
+{
+    void* CountedAllocate(std::size_t size, std::size_t alignment = 0) noexcept
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        size = size ? size : 1;
+        if (alignment <= alignof(std::max_align_t))
+            return std::malloc(size);
+
+        return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    }
+
+    void* CountedAllocateOrThrow(std::size_t size, std::size_t alignment = 0)
+    {
+        if (void* pointer = CountedAllocate(size, alignment))
+            return pointer;
+
+        throw std::bad_alloc();
+    }
+}
+
+void* operator new(std::size_t size) { return CountedAllocateOrThrow(size); }
+void* operator new[](std::size_t size) { return CountedAllocateOrThrow(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return CountedAllocateOrThrow(size, std::size_t(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return CountedAllocateOrThrow(size, std::size_t(alignment)); }
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept { return CountedAllocate(size); }
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept { return CountedAllocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return CountedAllocate(size, std::size_t(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return CountedAllocate(size, std::size_t(alignment)); }
+
+__attribute__((noinline)) void operator delete(void* pointer) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete[](void* pointer) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete[](void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete(void* pointer, std::nothrow_t const&) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete[](void* pointer, std::nothrow_t const&) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete(void* pointer, std::align_val_t, std::nothrow_t const&) noexcept { std::free(pointer); }
+__attribute__((noinline)) void operator delete[](void* pointer, std::align_val_t, std::nothrow_t const&) noexcept { std::free(pointer); }
+
+namespace
+{
+    // Counts the allocations of the timed part of a benchmark; work done
+    // between Pause() and Resume() is left out.
+    class AllocationCounter
+    {
+    public:
+        AllocationCounter() : _start(allocations.load(std::memory_order_relaxed)) { }
+
+        void Pause() { _counted += allocations.load(std::memory_order_relaxed) - _start; }
+        void Resume() { _start = allocations.load(std::memory_order_relaxed); }
+
+        void Report(benchmark::State& state)
+        {
+            Pause();
+            state.counters["allocs/op"] = benchmark::Counter(double(_counted), benchmark::Counter::kAvgIterations);
+        }
+
+    private:
+        uint64 _start;
+        uint64 _counted = 0;
+    };
+
+    // The GUID rewrite before it was made in-place: erase then insert at
+    // every match, which moves the tail of the buffer each time.
+    bool ReplaceSequenceEraseInsert(std::vector<uint8>& buffer, std::vector<uint8> const& from, std::vector<uint8> const& to)
+    {
+        if (from.empty() || from == to)
+            return false;
+
+        bool modified = false;
+        for (size_t i = 0; i + from.size() <= buffer.size();)
+        {
+            if (std::memcmp(buffer.data() + i, from.data(), from.size()) == 0)
+            {
+                buffer.erase(buffer.begin() + i, buffer.begin() + i + from.size());
+                buffer.insert(buffer.begin() + i, to.begin(), to.end());
+                i += to.size();
+                modified = true;
+            }
+            else
+                ++i;
+        }
+
+        return modified;
+    }
+
+    // 64 KiB of noise with 2000 copies of a packed GUID scattered through
+    // it, about what a busy SMSG_UPDATE_OBJECT burst looks like.
+    struct GuidPayload
+    {
+        std::vector<uint8> buffer;
+        std::vector<uint8> from = { 0x0F, 0x2A, 0x00, 0x00 };
+        std::vector<uint8> to = { 0x0F, 0x2B, 0x00, 0x00 };
+
+        GuidPayload()
+        {
+            std::mt19937 random(27);
+            buffer.resize(64 * 1024);
+            for (uint8& byte : buffer)
+                byte = uint8(random() % 0x0F + 0x10);
+
+            for (uint32 i = 0; i < 2000; ++i)
+            {
+                size_t offset = random() % (buffer.size() - from.size());
+                std::copy(from.begin(), from.end(), buffer.begin() + offset);
+            }
+        }
+    };
+
+    // A 3v3 arena of the given length in 100 ms ticks, as the recorder
+    // would store it.
+    MatchRecord SyntheticReplay(uint32 seconds)
+    {
+        ArenaTrafficGenerator generator(29, 1000, 3);
+        MatchRecord record;
+        record.replayId = 1;
+        record.mapId = 559;
+        record.participantGuids = generator.Players();
+        std::vector<WorldPacket> packets;
+        for (uint32 tick = 0; tick < seconds * 10; ++tick)
+        {
+            generator.NextTick(tick, packets);
+            for (WorldPacket& packet : packets)
+                record.packets.push_back({ tick * 100, std::move(packet) });
+        }
+
+        return record;
+    }
+
+    // The synthetic replay in every form the load and save stages take.
+    struct ReplayCorpus
+    {
+        MatchRecord source = SyntheticReplay(300);
+        std::vector<uint8> serialized;
+        std::string encoded;
+        size_t packetBytes = 0;
+        std::vector<std::vector<uint8>> inflatedPayloads;
+        std::vector<std::vector<uint8>> deflatedPayloads;
+        std::vector<std::span<uint8 const>> updatePayloads;
+        size_t updateBytes = 0;
+        size_t inflatedBytes = 0;
+
+        ReplayCorpus()
+        {
+            ArenaReplayByteBuffer buffer;
+            SerializeReplayPackets(source.packets, buffer);
+            serialized = buffer.contentsAsVector();
+            encoded = EncodeReplayContents(serialized, ReplayStorageFormat::Zlib, source.mapId);
+
+            for (PacketRecord const& packet : source.packets)
+            {
+                packetBytes += packet.packet.size();
+                if (packet.packet.GetOpcode() == SMSG_UPDATE_OBJECT && packet.packet.size() > 0)
+                    updatePayloads.emplace_back(packet.packet.contents(), packet.packet.size());
+                else if (packet.packet.GetOpcode() == SMSG_COMPRESSED_UPDATE_OBJECT && packet.packet.size() > 0)
+                {
+                    std::vector<uint8> inflated;
+                    if (Decompress({ packet.packet.contents(), packet.packet.size() }, inflated))
+                    {
+                        deflatedPayloads.emplace_back(packet.packet.contents(), packet.packet.contents() + packet.packet.size());
+                        inflatedPayloads.push_back(std::move(inflated));
+                    }
+                }
+            }
+
+            for (std::vector<uint8> const& payload : inflatedPayloads)
+            {
+                updatePayloads.emplace_back(payload);
+                inflatedBytes += payload.size();
+            }
+
+            for (std::span<uint8 const> payload : updatePayloads)
+                updateBytes += payload.size();
+        }
+
+        static ReplayCorpus const& Get()
+        {
+            static ReplayCorpus const corpus;
+            return corpus;
+        }
+    };
+
+    void SetProcessed(benchmark::State& state, size_t items, size_t bytes)
+    {
+        state.SetItemsProcessed(int64(state.iterations()) * items);
+        state.SetBytesProcessed(int64(state.iterations()) * bytes);
+    }
+
+    // the remap of a streamed load: the ghosts picked with the first chunk,
+    // then one chunk of replay time at a time
+    void RemapByChunk(MatchRecord& record, uint32 threads)
+    {
+        ReplayGuidRemapper remapper(record, threads);
+        for (size_t first = 0; first < record.packets.size();)
+        {
+            size_t last = ReplayLoadChunkEnd(record.packets, first);
+            remapper.Extract(last);
+            if (!first)
+                remapper.Begin();
+
+            remapper.Remap(last);
+            first = last;
+        }
+
+        remapper.Finish();
+    }
+
+    void BM_ReplaceSequenceInPlace(benchmark::State& state)
+    {
+        GuidPayload payload;
+        std::vector<uint8> buffer;
+        AllocationCounter counter;
+        for (auto _ : state)
+        {
+            buffer = payload.buffer;
+            benchmark::DoNotOptimize(ReplaceSequence(buffer, payload.from, payload.to));
+        }
+
+        counter.Report(state);
+        state.SetBytesProcessed(int64(state.iterations()) * payload.buffer.size());
+    }
+    BENCHMARK(BM_ReplaceSequenceInPlace);
+
+    void BM_ReplaceSequenceEraseInsert(benchmark::State& state)
+    {
+        GuidPayload payload;
+        std::vector<uint8> buffer;
+        AllocationCounter counter;
+        for (auto _ : state)
+        {
+            buffer = payload.buffer;
+            benchmark::DoNotOptimize(ReplaceSequenceEraseInsert(buffer, payload.from, payload.to));
+        }
+
+        counter.Report(state);
+        state.SetBytesProcessed(int64(state.iterations()) * payload.buffer.size());
+    }
+    BENCHMARK(BM_ReplaceSequenceEraseInsert);
+
+#ifdef ARENA_REPLAY_LIBDEFLATE
+    constexpr char const* CODEC_NAME = "libdeflate";
+#else
+    constexpr char const* CODEC_NAME = "zlib";
+#endif
+
+    // Update packets are deflated and inflated one at a time while a replay
+    // is loaded; the argument is the payload size. 0 is a whole 5 minute
+    // replay, which goes through the same codec with StorageFormat 1.
+    void BM_Compress(benchmark::State& state)
+    {
+        std::vector<uint8> input = ReplayCorpus::Get().serialized;
+        if (state.range(0))
+            input.resize(std::min<size_t>(input.size(), state.range(0)));
+        std::vector<uint8> output;
+        AllocationCounter counter;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(Compress(input, output));
+
+        counter.Report(state);
+        state.SetBytesProcessed(int64(state.iterations()) * input.size());
+        state.counters["ratio"] = double(output.size()) / input.size();
+        state.SetLabel(CODEC_NAME);
+    }
+    BENCHMARK(BM_Compress)->Arg(256)->Arg(4 * 1024)->Arg(16 * 1024)->Arg(0);
+
+    void BM_Decompress(benchmark::State& state)
+    {
+        std::vector<uint8> input = ReplayCorpus::Get().serialized;
+        if (state.range(0))
+            input.resize(std::min<size_t>(input.size(), state.range(0)));
+        std::vector<uint8> compressed;
+        Compress(input, compressed);
+        std::vector<uint8> output;
+        AllocationCounter counter;
+        for (auto _ : state)
+            benchmark::DoNotOptimize(Decompress(compressed, output));
+
+        counter.Report(state);
+        state.SetBytesProcessed(int64(state.iterations()) * input.size());
+        state.SetLabel(CODEC_NAME);
+    }
+    BENCHMARK(BM_Decompress)->Arg(256)->Arg(4 * 1024)->Arg(16 * 1024)->Arg(0);
+
+    // The load and save pipeline, one stage per benchmark, over the whole
+    // synthetic replay. items_per_second counts packets (update payloads for
+    // the validate, inflate and deflate stages).
+    // a row read block by block the way a load reads it, deserialize
+    // included; the argument is the ReplayStorageFormat
+    void BM_StageDecode(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        ReplayStorageFormat const format = static_cast<ReplayStorageFormat>(state.range(0));
+        std::string const encoded = EncodeReplayContents(corpus.serialized, format, corpus.source.mapId);
+        AllocationCounter counter;
+        for (auto _ : state)
+        {
+            counter.Pause();
+            state.PauseTiming();
+            ReplayContentsReader reader(encoded);
+            std::deque<PacketRecord> packets;
+            state.ResumeTiming();
+            counter.Resume();
+
+            while (reader.Read(packets))
+                ;
+
+            counter.Pause();
+            state.PauseTiming();
+            packets.clear();
+            state.ResumeTiming();
+            counter.Resume();
+        }
+
+        counter.Report(state);
+        SetProcessed(state, corpus.source.packets.size(), encoded.size());
+        state.SetLabel(GetReplayStorageFormatName(format));
+    }
+    BENCHMARK(BM_StageDecode)->DenseRange(0, REPLAY_BENCH_LAST_FORMAT)->Unit(benchmark::kMillisecond);
+
+    void BM_StageDeserialize(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        AllocationCounter counter;
+        for (auto _ : state)
+        {
+            std::deque<PacketRecord> packets;
+            benchmark::DoNotOptimize(ReadReplayPackets(corpus.serialized, packets));
+            counter.Pause();
+            state.PauseTiming();
+            packets.clear();
+            state.ResumeTiming();
+            counter.Resume();
+        }
+
+        counter.Report(state);
+        SetProcessed(state, corpus.source.packets.size(), corpus.serialized.size());
+    }
+    BENCHMARK(BM_StageDeserialize)->Unit(benchmark::kMillisecond);
+
+    void BM_StageExtract(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        AllocationCounter counter;
+        for (auto _ : state)
+        {
+            std::unordered_set<uint64> guids;
+            for (PacketRecord const& packet : corpus.source.packets)
+            {
+                UpdateObjectParseStats stats;
+                size_t failureOffset = 0;
+                benchmark::DoNotOptimize(ExtractGuidsFromPacket(packet.packet, guids, stats, failureOffset));
+            }
+        }
+
+        counter.Report(state);
+        SetProcessed(state, corpus.source.packets.size(), corpus.packetBytes);
+    }
+    BENCHMARK(BM_StageExtract)->Unit(benchmark::kMillisecond);
+
+    void BM_StageValidate(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        AllocationCounter counter;
+        for (auto _ : state)
+        {
+            for (std::span<uint8 const> payload : corpus.updatePayloads)
+            {
+                UpdateObjectParseStats stats;
+                size_t failureOffset = 0;
+                benchmark::DoNotOptimize(ValidateUpdateObjectPayload(payload, stats, failureOffset));
+            }
+        }
+
+        counter.Report(state);
+        SetProcessed(state, corpus.updatePayloads.size(), corpus.updateBytes);
+    }
+    BENCHMARK(BM_StageValidate)->Unit(benchmark::kMicrosecond);
+
+    void BM_StageInflate(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        std::vector<uint8> scratch;
+        AllocationCounter counter;
+        for (auto _ : state)
+            for (std::vector<uint8> const& payload : corpus.deflatedPayloads)
+                benchmark::DoNotOptimize(Decompress(payload, scratch));
+
+        counter.Report(state);
+        SetProcessed(state, corpus.deflatedPayloads.size(), corpus.inflatedBytes);
+        state.SetLabel(CODEC_NAME);
+    }
+    BENCHMARK(BM_StageInflate)->Unit(benchmark::kMicrosecond);
+
+    void BM_StageDeflate(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        std::vector<uint8> scratch;
+        AllocationCounter counter;
+        for (auto _ : state)
+            for (std::vector<uint8> const& payload : corpus.inflatedPayloads)
+                benchmark::DoNotOptimize(Compress(payload, scratch));
+
+        counter.Report(state);
+        SetProcessed(state, corpus.inflatedPayloads.size(), corpus.inflatedBytes);
+        state.SetLabel(CODEC_NAME);
+    }
+    BENCHMARK(BM_StageDeflate)->Unit(benchmark::kMicrosecond);
+
+    // the argument is ArenaReplay.Load.Threads
+    void BM_StageRemap(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        uint32 const threads = uint32(state.range(0));
+        AllocationCounter counter;
+        for (auto _ : state)
+        {
+            counter.Pause();
+            state.PauseTiming();
+            MatchRecord record = corpus.source;
+            state.ResumeTiming();
+            counter.Resume();
+
+            RemapByChunk(record, threads);
+
+            counter.Pause();
+            state.PauseTiming();
+            record = {};
+            state.ResumeTiming();
+            counter.Resume();
+        }
+
+        counter.Report(state);
+        SetProcessed(state, corpus.source.packets.size(), corpus.packetBytes);
+    }
+    BENCHMARK(BM_StageRemap)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+    // the sequential part of a pooled remap: recording the object types
+    // every slice starts from
+    void BM_StageRecordTypes(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        MatchRecord record = corpus.source;
+        RemapByChunk(record, 1);
+        std::unordered_map<uint64, uint8> objectTypes;
+        AllocationCounter counter;
+        for (auto _ : state)
+        {
+            objectTypes.clear();
+            for (std::span<uint8 const> payload : corpus.updatePayloads)
+                benchmark::DoNotOptimize(RecordUpdateObjectTypes(payload, record.guidRemap, objectTypes));
+        }
+
+        counter.Report(state);
+        SetProcessed(state, corpus.updatePayloads.size(), corpus.updateBytes);
+    }
+    BENCHMARK(BM_StageRecordTypes)->Unit(benchmark::kMillisecond);
+
+    void BM_StageScan(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        MatchRecord record = corpus.source;
+        RemapByChunk(record, 1);
+        GuidPatternMatcher matcher(record.guidRemap);
+        AllocationCounter counter;
+        for (auto _ : state)
+            for (PacketRecord const& packet : record.packets)
+                benchmark::DoNotOptimize(ScanPacketForGuids(packet.packet, matcher, nullptr));
+
+        counter.Report(state);
+        SetProcessed(state, record.packets.size(), corpus.packetBytes);
+    }
+    BENCHMARK(BM_StageScan)->Unit(benchmark::kMillisecond);
+
+    void BM_StageSerialize(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        AllocationCounter counter;
+        for (auto _ : state)
+        {
+            ArenaReplayByteBuffer buffer;
+            SerializeReplayPackets(corpus.source.packets, buffer);
+            benchmark::DoNotOptimize(buffer.size());
+        }
+
+        counter.Report(state);
+        SetProcessed(state, corpus.source.packets.size(), corpus.serialized.size());
+    }
+    BENCHMARK(BM_StageSerialize)->Unit(benchmark::kMillisecond);
+
+    // the argument is the ReplayStorageFormat; "stored" is the row size over the serialized size
+    void BM_StageEncode(benchmark::State& state)
+    {
+        ReplayCorpus const& corpus = ReplayCorpus::Get();
+        ReplayStorageFormat const format = static_cast<ReplayStorageFormat>(state.range(0));
+        size_t storedSize = 0;
+        AllocationCounter counter;
+        for (auto _ : state)
+            storedSize = EncodeReplayContents(corpus.serialized, format, corpus.source.mapId).size();
+
+        counter.Report(state);
+        SetProcessed(state, corpus.source.packets.size(), corpus.serialized.size());
+        state.SetLabel(GetReplayStorageFormatName(format));
+        state.counters["stored"] = double(storedSize) / corpus.serialized.size();
+    }
+    BENCHMARK(BM_StageEncode)->DenseRange(0, REPLAY_BENCH_LAST_FORMAT)->Unit(benchmark::kMillisecond);
+}
+
+// The leak scan reports synthetic values that happen to spell a participant
+// GUID (a health of 1000 next to a 0x03 mask byte), on every iteration; the
+// log lines would only disturb the timings.
+int main(int argc, char** argv)
+{
+    sStubLogLevel = StubLogLevel::None;
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,230 @@
+#ifndef _MOD_ARENA_REPLAY_TRAFFIC_GENERATOR_H_
+#define _MOD_ARENA_REPLAY_TRAFFIC_GENERATOR_H_
+
+// Included after ArenaReplay.cpp by the tools/ targets; the packets are built
+// with the module's update object helpers.
+
+namespace
+{
+    // Synthetic arena traffic for the load test, benchmarks and tests. Every 100 ms tick each
+    // player may cast, gain or lose an aura, swing, take damage and have its
+    // health or power updated, with movement heartbeats and an occasional
+    // compressed create block mixed in. Field indices follow the 3.3.5a layout.
+    class ArenaTrafficGenerator
+    {
+    public:
+        ArenaTrafficGenerator(uint32 seed, uint32 firstPlayerCounter, uint8 playersPerTeam) : _state(seed)
+        {
+            for (uint8 i = 0; i < playersPerTeam * 2; ++i)
+                _players.push_back(firstPlayerCounter + i);
+        }
+
+        std::vector<uint64> const& Players() const { return _players; }
+
+        // The packet every session of the team would receive; the recorder
+        // keeps one copy per team.
+        void NextTick(uint32 tick, std::vector<WorldPacket>& packets)
+        {
+            packets.clear();
+            for (uint64 player : _players)
+            {
+                if (Chance(50))
+                    packets.push_back(Heartbeat(player, tick));
+                if (Chance(40))
+                    packets.push_back(PowerUpdate(player));
+                if (Chance(40))
+                    packets.push_back(HealthUpdate(player));
+                if (Chance(25))
+                {
+                    uint64 target = RandomPlayer();
+                    uint32 spellId = 1000 + Random(500);
+                    packets.push_back(SpellStart(player, target, spellId));
+                    packets.push_back(SpellGo(player, target, spellId));
+                    if (Chance(50))
+                        packets.push_back(AuraUpdate(target, player, spellId));
+                    if (Chance(60))
+                        packets.push_back(SpellDamage(player, target, spellId));
+                }
+                if (Chance(15))
+                    packets.push_back(MeleeSwing(player, RandomPlayer()));
+            }
+
+            if (tick % 50 == 0)
+                packets.push_back(CompressedCreate(RandomPlayer(), tick));
+        }
+
+    private:
+        static constexpr uint16 FIELD_TARGET = 0x12;
+        static constexpr uint16 FIELD_HEALTH = 0x18;
+        static constexpr uint16 FIELD_POWER1 = 0x19;
+
+        uint32 Random(uint32 bound)
+        {
+            _state = _state * 6364136223846793005ull + 1442695040888963407ull;
+            return static_cast<uint32>((_state >> 33) % bound);
+        }
+
+        bool Chance(uint32 percent) { return Random(100) < percent; }
+
+        uint64 RandomPlayer() { return _players[Random(static_cast<uint32>(_players.size()))]; }
+
+        static WorldPacket MakePacket(uint16 opcode, std::vector<uint8> const& payload)
+        {
+            WorldPacket packet(opcode, payload.size());
+            packet.append(payload.data(), payload.size());
+            return packet;
+        }
+
+        WorldPacket Heartbeat(uint64 player, uint32 tick)
+        {
+            std::vector<uint8> payload;
+            WritePackedGuid(payload, player);
+            WriteLittleEndian(payload, uint32(0));
+            WriteLittleEndian(payload, uint16(0));
+            WriteLittleEndian(payload, tick * 100);
+            for (uint8 i = 0; i < 4; ++i)
+                WriteLittleEndian(payload, Random(2000));
+            WriteLittleEndian(payload, uint32(0));
+            return MakePacket(MSG_MOVE_HEARTBEAT, payload);
+        }
+
+        WorldPacket PowerUpdate(uint64 player)
+        {
+            std::vector<uint8> payload;
+            WritePackedGuid(payload, player);
+            payload.push_back(0);
+            WriteLittleEndian(payload, Random(30000));
+            return MakePacket(SMSG_POWER_UPDATE, payload);
+        }
+
+        WorldPacket HealthUpdate(uint64 player)
+        {
+            std::vector<uint8> payload;
+            WriteLittleEndian(payload, uint32(1));
+            payload.push_back(0);
+            payload.push_back(static_cast<uint8>(UpdateType::Values));
+            WritePackedGuid(payload, player);
+            payload.push_back(1);
+            WriteLittleEndian(payload, (uint32(1) << FIELD_HEALTH) | (uint32(1) << FIELD_POWER1));
+            WriteLittleEndian(payload, Random(30000));
+            WriteLittleEndian(payload, Random(30000));
+            return MakePacket(SMSG_UPDATE_OBJECT, payload);
+        }
+
+        WorldPacket SpellStart(uint64 caster, uint64 target, uint32 spellId)
+        {
+            std::vector<uint8> payload;
+            WritePackedGuid(payload, caster);
+            WritePackedGuid(payload, caster);
+            payload.push_back(0);
+            WriteLittleEndian(payload, spellId);
+            WriteLittleEndian(payload, uint32(2));
+            WriteLittleEndian(payload, uint32(1500));
+            WriteLittleEndian(payload, uint32(0x2));
+            WritePackedGuid(payload, target);
+            return MakePacket(SMSG_SPELL_START, payload);
+        }
+
+        WorldPacket SpellGo(uint64 caster, uint64 target, uint32 spellId)
+        {
+            std::vector<uint8> payload;
+            WritePackedGuid(payload, caster);
+            WritePackedGuid(payload, caster);
+            payload.push_back(0);
+            WriteLittleEndian(payload, spellId);
+            WriteLittleEndian(payload, uint32(0x100));
+            WriteLittleEndian(payload, Random(100000));
+            payload.push_back(1);
+            WriteLittleEndian(payload, target);
+            payload.push_back(0);
+            WriteLittleEndian(payload, uint32(0x2));
+            WritePackedGuid(payload, target);
+            return MakePacket(SMSG_SPELL_GO, payload);
+        }
+
+        WorldPacket AuraUpdate(uint64 target, uint64 caster, uint32 spellId)
+        {
+            std::vector<uint8> payload;
+            WritePackedGuid(payload, target);
+            payload.push_back(static_cast<uint8>(Random(48)));
+            WriteLittleEndian(payload, spellId);
+            payload.push_back(0x20);
+            payload.push_back(80);
+            payload.push_back(1);
+            WritePackedGuid(payload, caster);
+            WriteLittleEndian(payload, uint32(10000));
+            WriteLittleEndian(payload, Random(10000));
+            return MakePacket(SMSG_AURA_UPDATE, payload);
+        }
+
+        WorldPacket SpellDamage(uint64 caster, uint64 target, uint32 spellId)
+        {
+            std::vector<uint8> payload;
+            WritePackedGuid(payload, target);
+            WritePackedGuid(payload, caster);
+            WriteLittleEndian(payload, spellId);
+            WriteLittleEndian(payload, Random(8000));
+            WriteLittleEndian(payload, uint32(0));
+            payload.push_back(4);
+            for (uint8 i = 0; i < 3; ++i)
+                WriteLittleEndian(payload, uint32(0));
+            payload.push_back(0);
+            payload.push_back(0);
+            WriteLittleEndian(payload, uint32(0));
+            return MakePacket(SMSG_SPELLNONMELEEDAMAGELOG, payload);
+        }
+
+        WorldPacket MeleeSwing(uint64 attacker, uint64 victim)
+        {
+            std::vector<uint8> payload;
+            WriteLittleEndian(payload, uint32(0x2));
+            WritePackedGuid(payload, attacker);
+            WritePackedGuid(payload, victim);
+            WriteLittleEndian(payload, Random(5000));
+            WriteLittleEndian(payload, uint32(0));
+            payload.push_back(1);
+            WriteLittleEndian(payload, uint32(1));
+            WriteLittleEndian(payload, Random(5000));
+            for (uint8 i = 0; i < 4; ++i)
+                WriteLittleEndian(payload, uint32(0));
+            payload.push_back(1);
+            WriteLittleEndian(payload, uint32(0));
+            WriteLittleEndian(payload, uint32(0));
+            return MakePacket(SMSG_ATTACKERSTATEUPDATE, payload);
+        }
+
+        WorldPacket CompressedCreate(uint64 player, uint32 tick)
+        {
+            std::vector<uint8> payload;
+            WriteLittleEndian(payload, uint32(1));
+            payload.push_back(0);
+            payload.push_back(static_cast<uint8>(UpdateType::CreateObject2));
+            WritePackedGuid(payload, player);
+            payload.push_back(static_cast<uint8>(TypeId::Player));
+            WriteLittleEndian(payload, uint32(0));
+            WriteLittleEndian(payload, uint16(0));
+            WriteLittleEndian(payload, tick * 100);
+            for (uint8 i = 0; i < 4; ++i)
+                WriteLittleEndian(payload, Random(2000));
+            WriteLittleEndian(payload, uint32(0));
+
+            payload.push_back(2);
+            WriteLittleEndian(payload, (uint32(3) << FIELD_TARGET) | (uint32(1) << FIELD_HEALTH) | (uint32(1) << FIELD_POWER1));
+            WriteLittleEndian(payload, uint32(0));
+            uint64 target = RandomPlayer();
+            WriteLittleEndian(payload, static_cast<uint32>(target));
+            WriteLittleEndian(payload, static_cast<uint32>(target >> 32));
+            WriteLittleEndian(payload, Random(30000));
+            WriteLittleEndian(payload, Random(30000));
+
+            std::vector<uint8> compressed;
+            Compress(payload, compressed);
+            return MakePacket(SMSG_COMPRESSED_UPDATE_OBJECT, compressed);
+        }
+
+        uint64 _state;
+        std::vector<uint64> _players;
+    };
+}
+
+#endif // _MOD_ARENA_REPLAY_TRAFFIC_GENERATOR_H_
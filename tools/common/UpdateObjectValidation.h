@@ -0,0 +1,24 @@
+#ifndef _MOD_ARENA_REPLAY_UPDATE_OBJECT_VALIDATION_H_
+#define _MOD_ARENA_REPLAY_UPDATE_OBJECT_VALIDATION_H_
+
+// Included after ArenaReplay.cpp by the tools/ targets; the module itself
+// only ever rewrites, extracts from or types update object payloads.
+
+namespace
+{
+    // Checks that the blocks parse, skipping whole ranges without copying
+    // or collecting anything.
+    struct UpdateObjectValidateMode
+    {
+        static constexpr bool Writes = false;
+        static constexpr bool Extracts = false;
+        static constexpr bool RecordsTypes = false;
+    };
+
+    bool ValidateUpdateObjectPayload(std::span<uint8 const> input, UpdateObjectParseStats& stats, size_t& failureOffset)
+    {
+        return ProcessUpdateObjectPayload<UpdateObjectValidateMode>(input, nullptr, nullptr, nullptr, nullptr, stats, failureOffset);
+    }
+}
+
+#endif // _MOD_ARENA_REPLAY_UPDATE_OBJECT_VALIDATION_H_
@@ -0,0 +1,401 @@
+// Load test of the module's hooks, run offline against the stand-ins in
+// tools/stubs. Synthetic 3v3 traffic for several concurrent arenas goes
+// through CanPacketSend for every session of the arena, OnBattlegroundEnd
+// saves every recording into an in-memory character database, then each
+// replay is requested through the gossip "Match ID" input by several viewers
+// and played back through OnBattlegroundUpdate until it ends.
+//
+//   arena_replay_loadtest [arenas] [seconds] [viewers] [spectators] [storageFormat]
+//
+// viewers request the same replay, each getting a battleground of its own
+// that shares the loaded replay; spectators are extra watchers added to
+// each of those battlegrounds.
+#include "ArenaReplay.cpp"
+#include "ArenaTrafficGenerator.h"
+#include <cinttypes>
+
+namespace
+{
+    struct LoadTestOptions
+    {
+        uint32 arenas = 20;
+        uint32 seconds = 120;
+        uint32 viewers = 2;
+        uint32 spectators = 2;
+        uint32 storageFormat = 1;
+    };
+
+    // What the module's INSERT wrote for one replay.
+    struct StoredReplay
+    {
+        std::string contents;
+        uint32 mapId = 0;
+        std::string winnerGuids;
+        std::string loserGuids;
+    };
+
+    class LatencySamples
+    {
+    public:
+        void Add(uint64 nanoseconds) { _samples.push_back(nanoseconds); }
+
+        std::string Summary()
+        {
+            if (_samples.empty())
+                return "no samples";
+
+            std::sort(_samples.begin(), _samples.end());
+            uint64 total = 0;
+            for (uint64 sample : _samples)
+                total += sample;
+
+            return Acore::StringFormat("avg {:.0f} ns, p50 {} ns, p99 {} ns, max {} ns ({} calls)",
+                double(total) / _samples.size(),
+                _samples[_samples.size() / 2],
+                _samples[std::min(_samples.size() - 1, _samples.size() * 99 / 100)],
+                _samples.back(),
+                _samples.size());
+        }
+
+    private:
+        std::vector<uint64> _samples;
+    };
+
+    uint64 ElapsedNanoseconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // the n-th "..." literal of a statement
+    std::string QuotedValue(std::string const& statement, size_t index)
+    {
+        size_t begin = 0;
+        for (size_t i = 0; i <= index; ++i)
+        {
+            begin = statement.find('"', begin);
+            if (begin == std::string::npos)
+                return {};
+
+            size_t end = statement.find('"', begin + 1);
+            if (end == std::string::npos)
+                return {};
+
+            if (i == index)
+                return statement.substr(begin + 1, end - begin - 1);
+
+            begin = end + 1;
+        }
+
+        return {};
+    }
+
+    // the first '...' literal of a statement
+    std::string SingleQuotedValue(std::string const& statement)
+    {
+        size_t begin = statement.find('\'');
+        size_t end = begin == std::string::npos ? begin : statement.find('\'', begin + 1);
+        return end == std::string::npos ? std::string() : statement.substr(begin + 1, end - begin - 1);
+    }
+
+    class InMemoryReplayTable
+    {
+    public:
+        void Capture(std::vector<std::string> const& statements)
+        {
+            for (std::string const& statement : statements)
+            {
+                if (statement.starts_with(Acore::StringFormat("INSERT INTO {} ", REPLAY_ID_BLOCK_TABLE)))
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _idBlocks[SingleQuotedValue(statement)] = _nextIdBlock;
+                    _nextIdBlock += REPLAY_ID_BLOCK_SIZE;
+                    continue;
+                }
+
+                if (!statement.starts_with("INSERT INTO `character_arena_replays` "))
+                    continue;
+
+                size_t values = statement.find("VALUES (");
+                if (values == std::string::npos)
+                    continue;
+
+                // (id, arenaTypeId, typeId, contentSize, "contents", mapId, ...
+                uint32 id = uint32(std::strtoul(statement.c_str() + values + 8, nullptr, 10));
+                std::string contents = QuotedValue(statement, 0);
+                size_t mapId = statement.find(contents) + contents.size() + 3;
+                std::lock_guard<std::mutex> lock(_mutex);
+                _replays[id] = { std::move(contents), uint32(std::strtoul(statement.c_str() + mapId, nullptr, 10)),
+                    QuotedValue(statement, 1), QuotedValue(statement, 2) };
+            }
+        }
+
+        // the row loadReplayDataForPlayer selects: the replay columns, then REPLAY_INFO_COLUMNS
+        QueryResult Query(std::string const& sql)
+        {
+            if (sql.starts_with(Acore::StringFormat("SELECT firstId FROM {} ", REPLAY_ID_BLOCK_TABLE)))
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto itr = _idBlocks.find(SingleQuotedValue(sql));
+                return itr != _idBlocks.end() ? MakeQueryResult({ { std::to_string(itr->second) } }) : nullptr;
+            }
+
+            if (sql.find(Acore::StringFormat("FROM {} WHERE id = ", REPLAY_TABLE)) == std::string::npos)
+                return nullptr;
+
+            uint32 id = uint32(std::strtoul(sql.c_str() + sql.rfind(' ') + 1, nullptr, 10));
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto itr = _replays.find(id);
+            if (itr == _replays.end())
+                return nullptr;
+
+            std::string const replayId = std::to_string(id);
+            return MakeQueryResult({ {
+                replayId, "3", std::to_string(uint32(BATTLEGROUND_NA)), "0", itr->second.contents, std::to_string(itr->second.mapId), "0",
+                itr->second.winnerGuids, itr->second.loserGuids,
+                replayId, "3", "Winners", "0", "Losers", "0", "0", "0"
+            } });
+        }
+
+        std::vector<uint32> Ids()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::vector<uint32> ids;
+            for (auto const& [id, replay] : _replays)
+                ids.push_back(id);
+
+            return ids;
+        }
+
+        size_t StoredBytes()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            size_t bytes = 0;
+            for (auto const& [id, replay] : _replays)
+                bytes += replay.contents.size();
+
+            return bytes;
+        }
+
+    private:
+        std::mutex _mutex;
+        std::map<uint32, StoredReplay> _replays;
+        std::unordered_map<std::string, uint32> _idBlocks;
+        uint32 _nextIdBlock = 1;
+    };
+
+    bool ParseOptions(int argc, char** argv, LoadTestOptions& options)
+    {
+        uint32* values[] = { &options.arenas, &options.seconds, &options.viewers, &options.spectators, &options.storageFormat };
+        for (int i = 1; i < argc; ++i)
+        {
+            if (i > int(std::size(values)))
+                return false;
+
+            char const* end = argv[i] + std::strlen(argv[i]);
+            if (std::from_chars(argv[i], end, *values[i - 1]).ptr != end)
+                return false;
+        }
+
+        options.arenas = std::clamp<uint32>(options.arenas, 1, 1000);
+        options.seconds = std::clamp<uint32>(options.seconds, 1, 3600);
+        options.viewers = std::clamp<uint32>(options.viewers, 1, 100);
+        options.spectators = std::min<uint32>(options.spectators, 100);
+        return options.storageFormat <= uint32(ReplayStorageFormat::Zstd);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    LoadTestOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        std::fprintf(stderr, "usage: %s [arenas] [seconds] [viewers] [spectators] [storageFormat]\n", argv[0]);
+        return 1;
+    }
+
+    sStubLogLevel = StubLogLevel::Error;
+    sConfigMgr->SetOption("ArenaReplay.ValidArenaDuration", "0");
+    sConfigMgr->SetOption("ArenaReplay.StorageFormat", std::to_string(options.storageFormat));
+    sArenaReplayConfig.Publish(LoadArenaReplayConfig());
+
+    InMemoryReplayTable table;
+    CharacterDatabase.writeHandler = [&table](std::vector<std::string> const& statements) { table.Capture(statements); };
+    CharacterDatabase.queryHandler = [&table](std::string const& sql) { return table.Query(sql); };
+
+    ArenaReplayServerScript serverScript;
+    ArenaReplayBGScript bgScript;
+    ReplayGossip gossip;
+
+    // record
+    uint8 const playersPerTeam = 3;
+    std::vector<std::unique_ptr<Battleground>> arenas;
+    std::vector<std::unique_ptr<Player>> players;
+    std::vector<ArenaTrafficGenerator> generators;
+    for (uint32 i = 0; i < options.arenas; ++i)
+    {
+        arenas.push_back(std::make_unique<Battleground>(i + 1, BATTLEGROUND_NA, ARENA_TYPE_3v3, 559, true));
+        generators.emplace_back(i + 1, 0x100000 + i * playersPerTeam * 2, playersPerTeam);
+        Battleground* bg = arenas.back().get();
+        std::vector<uint64> const& guids = generators.back().Players();
+        for (size_t p = 0; p < guids.size(); ++p)
+        {
+            TeamId team = p < playersPerTeam ? TEAM_ALLIANCE : TEAM_HORDE;
+            players.push_back(std::make_unique<Player>(ObjectGuid(guids[p]), Acore::StringFormat("Player{}", guids[p]), team));
+            Player* player = players.back().get();
+            player->race = team == TEAM_ALLIANCE ? RACE_HUMAN : RACE_ORC;
+            player->playerClass = uint8(CLASS_WARRIOR + p % 9);
+            bg->AddPlayer(player);
+            bgScript.OnBattlegroundAddPlayer(bg, player);
+        }
+
+        bg->SetStatus(BattlegroundStatus::STATUS_IN_PROGRESS);
+    }
+
+    LatencySamples hookLatency;
+    std::vector<WorldPacket> batch;
+    uint32 const ticks = options.seconds * 10;
+    auto recordStart = std::chrono::steady_clock::now();
+    for (uint32 tick = 0; tick < ticks; ++tick)
+    {
+        for (uint32 i = 0; i < options.arenas; ++i)
+        {
+            Battleground* bg = arenas[i].get();
+            bg->SetStartTime(tick * 100);
+            generators[i].NextTick(tick, batch);
+            for (WorldPacket& packet : batch)
+            {
+                // the core offers every packet to the hook once per receiving session
+                for (auto const& [guid, player] : bg->GetPlayers())
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    serverScript.CanPacketSend(player->GetSession(), packet);
+                    hookLatency.Add(ElapsedNanoseconds(start));
+                }
+            }
+        }
+    }
+    double const recordSeconds = ElapsedNanoseconds(recordStart) / 1e9;
+
+    size_t recordedMemory = 0;
+    size_t recordedPackets = 0;
+    for (auto const& [instanceId, record] : records)
+    {
+        recordedMemory += EstimateMatchRecordMemory(record);
+        recordedPackets += record.packets.size();
+    }
+
+    // save
+    LatencySamples saveLatency;
+    for (std::unique_ptr<Battleground>& bg : arenas)
+    {
+        bg->SetStatus(BattlegroundStatus::STATUS_WAIT_LEAVE);
+        auto start = std::chrono::steady_clock::now();
+        bgScript.OnBattlegroundEnd(bg.get(), TEAM_ALLIANCE);
+        saveLatency.Add(ElapsedNanoseconds(start));
+    }
+
+    std::vector<uint32> const replayIds = table.Ids();
+    size_t const storedBytes = table.StoredBytes();
+
+    // load and play back
+    std::vector<std::unique_ptr<Player>> watchers;
+    std::vector<Battleground*> replays;
+    LatencySamples requestLatency;
+    uint64 nextWatcherGuid = 0x200000;
+    Creature npc;
+    for (uint32 replayId : replayIds)
+    {
+        std::string const code = std::to_string(replayId);
+        for (uint32 v = 0; v < options.viewers; ++v)
+        {
+            watchers.push_back(std::make_unique<Player>(ObjectGuid(nextWatcherGuid++), "Viewer", TEAM_ALLIANCE));
+            Player* viewer = watchers.back().get();
+            auto start = std::chrono::steady_clock::now();
+            bool started = gossip.OnGossipSelectCode(viewer, &npc, GOSSIP_SENDER_MAIN, REPLAY_MATCH_ID, code.c_str());
+            requestLatency.Add(ElapsedNanoseconds(start));
+            if (!started || !viewer->GetBattleground())
+            {
+                std::fprintf(stderr, "replay %u did not start\n", replayId);
+                return 1;
+            }
+
+            Battleground* bg = viewer->GetBattleground();
+            for (uint32 s = 0; s < options.spectators; ++s)
+            {
+                watchers.push_back(std::make_unique<Player>(ObjectGuid(nextWatcherGuid++), "Spectator", TEAM_ALLIANCE));
+                watchers.back()->spectator = true;
+                bg->AddSpectator(watchers.back().get());
+            }
+
+            bg->SetStatus(BattlegroundStatus::STATUS_IN_PROGRESS);
+            replays.push_back(bg);
+        }
+    }
+
+    // one world update every 100 ms of replay time, as fast as the loader allows
+    LatencySamples updateLatency;
+    uint32 updates = 0;
+    uint64 heldPackets = 0;
+    uint64 loadedPackets = 0;
+    uint32 const diff = 100;
+    auto playbackStart = std::chrono::steady_clock::now();
+    auto const deadline = playbackStart + std::chrono::minutes(10);
+    while (!bgReplayIds.empty() && std::chrono::steady_clock::now() < deadline)
+    {
+        for (Battleground* bg : replays)
+        {
+            if (bgReplayIds.find(bg->GetInstanceID()) == bgReplayIds.end())
+                continue;
+
+            bg->SetStartTime(bg->GetStartTime() + diff);
+            auto start = std::chrono::steady_clock::now();
+            bgScript.OnBattlegroundUpdate(bg, diff);
+            updateLatency.Add(ElapsedNanoseconds(start));
+        }
+
+        for (auto const& [replayId, loaded] : loadedReplays)
+        {
+            if (std::shared_ptr<MatchRecord> match = loaded.match.lock(); match && !match->Loading())
+            {
+                heldPackets += match->packets.size();
+                loadedPackets += match->PacketCount();
+            }
+        }
+
+        ++updates;
+    }
+    double const playbackSeconds = ElapsedNanoseconds(playbackStart) / 1e9;
+
+    uint64 sentPackets = 0;
+    uint64 sentBytes = 0;
+    for (std::unique_ptr<Player> const& watcher : watchers)
+    {
+        sentPackets += watcher->GetSession()->sentPackets;
+        sentBytes += watcher->GetSession()->sentBytes;
+    }
+
+    ReplayStreamLoader::Instance().Stop();
+    ReplayWorkPool::Instance().Resize(0);
+
+    std::printf("Load test: %u arenas, %u s of traffic, %zu packets recorded in %.2f s\n",
+        options.arenas, options.seconds, recordedPackets, recordSeconds);
+    std::printf("  record hook  %s\n", hookLatency.Summary().c_str());
+    std::printf("  memory       %zu KB/match while recording\n", recordedMemory / options.arenas / 1024);
+    std::printf("  save         %s, %zu KB stored/match as %s\n", saveLatency.Summary().c_str(), storedBytes / std::max<size_t>(replayIds.size(), 1) / 1024,
+        GetReplayStorageFormatName(static_cast<ReplayStorageFormat>(options.storageFormat)));
+    std::printf("  request      %s\n", requestLatency.Summary().c_str());
+    std::printf("  playback     %zu battlegrounds, %u updates in %.2f s, %" PRIu64 " packets and %" PRIu64 " KB sent to %zu watchers\n",
+        replays.size(), updates, playbackSeconds, sentPackets, sentBytes / 1024, watchers.size());
+    std::printf("  bg update    %s\n", updateLatency.Summary().c_str());
+    std::printf("  held         %.0f%% of the packets of loaded replays on average during playback\n",
+        loadedPackets ? 100.0 * heldPackets / loadedPackets : 0.0);
+    std::printf("  %s\n", FormatArenaReplayMetrics().c_str());
+
+    if (!bgReplayIds.empty())
+    {
+        std::fprintf(stderr, "%zu replays did not finish\n", bgReplayIds.size());
+        return 1;
+    }
+
+    return 0;
+}
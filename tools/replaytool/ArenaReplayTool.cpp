@@ -0,0 +1,390 @@
+// Offline inspection and transcoding of stored replays, run against a dump
+// of the replay table instead of the live character database. Rows are
+// processed on worker threads and reported in id order.
+//
+//   arena_replay_tool [--dictionaries <dump>] inspect <dump> [threads]
+//   arena_replay_tool [--dictionaries <dump>] transcode <legacy|zlib|zstd> <dump> <output.sql> [table] [threads]
+//
+// The dump holds one "id<TAB>mapId<TAB>contents" line per replay, as written by
+//   mysql -B -N -e "SELECT id, mapId, contents FROM character_arena_replays" characters > replays.tsv
+// transcode writes one UPDATE per converted replay to output.sql, for the
+// given table (default character_arena_replays), to apply with the mysql client.
+// The zstd dictionaries are read from a dump of the same layout:
+//   mysql -B -N -e "SELECT id, mapId, dictionary FROM character_arena_replay_dictionaries" characters > dictionaries.tsv
+#include "ArenaReplay.cpp"
+#include <cinttypes>
+#include <fstream>
+
+namespace
+{
+    struct DumpRow
+    {
+        uint32 id = 0;
+        uint32 mapId = 0;
+        std::string contents;
+    };
+
+    struct OpcodeUsage
+    {
+        uint32 packets = 0;
+        uint64 bytes = 0;
+    };
+
+    struct InspectResult
+    {
+        bool decoded = false;
+        std::string line;
+        uint64 storedBytes = 0;
+        uint64 serializedBytes = 0;
+        uint32 invalidPayloads = 0;
+        std::unordered_map<uint16, OpcodeUsage> usage;
+    };
+
+    struct TranscodeResult
+    {
+        enum { Converted, Skipped, Failed } status = Failed;
+        std::string contents;
+    };
+
+    bool ParseReplayStorageFormat(std::string_view name, ReplayStorageFormat& format)
+    {
+        if (name == "legacy" || name == "0")
+            format = ReplayStorageFormat::Legacy;
+        else if (name == "zlib" || name == "1")
+            format = ReplayStorageFormat::Zlib;
+        else if (name == "zstd" || name == "2")
+            format = ReplayStorageFormat::Zstd;
+        else
+            return false;
+
+        return true;
+    }
+
+    // reads the row the way a load does; false if it could not be decoded
+    bool ReadReplayRow(ReplayContentsReader& reader, std::deque<PacketRecord>& packets)
+    {
+        while (reader.Read(packets))
+            ;
+
+        return !reader.Failed();
+    }
+
+    bool ParseNumber(std::string_view text, uint32& value)
+    {
+        return std::from_chars(text.data(), text.data() + text.size(), value).ptr == text.data() + text.size() && !text.empty();
+    }
+
+    bool ReadDump(char const* path, std::vector<DumpRow>& rows)
+    {
+        std::ifstream input(path);
+        if (!input)
+        {
+            std::fprintf(stderr, "cannot open %s\n", path);
+            return false;
+        }
+
+        std::string line;
+        for (size_t lineNumber = 1; std::getline(input, line); ++lineNumber)
+        {
+            if (line.empty())
+                continue;
+
+            size_t first = line.find('\t');
+            size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+            DumpRow row;
+            if (second == std::string::npos || !ParseNumber(std::string_view(line).substr(0, first), row.id) ||
+                !ParseNumber(std::string_view(line).substr(first + 1, second - first - 1), row.mapId))
+            {
+                std::fprintf(stderr, "%s:%zu: expected id<TAB>mapId<TAB>contents\n", path, lineNumber);
+                return false;
+            }
+
+            size_t end = line.find('\t', second + 1);
+            row.contents = line.substr(second + 1, end == std::string::npos ? end : end - second - 1);
+            rows.push_back(std::move(row));
+        }
+
+        std::sort(rows.begin(), rows.end(), [](DumpRow const& a, DumpRow const& b) { return a.id < b.id; });
+        return true;
+    }
+
+    bool LoadDictionaries(char const* path)
+    {
+#ifdef ARENA_REPLAY_ZSTD
+        std::vector<DumpRow> rows;
+        if (!ReadDump(path, rows))
+            return false;
+
+        for (DumpRow& row : rows)
+        {
+            auto data = Acore::Encoding::Base32::Decode(row.contents);
+            if (!data || !ReplayDictionaryStore::Instance().Add(row.id, row.mapId, std::move(*data)))
+            {
+                std::fprintf(stderr, "%s: dictionary %u could not be loaded\n", path, row.id);
+                return false;
+            }
+        }
+
+        return true;
+#else
+        (void)path;
+        std::fprintf(stderr, "this build has no zstd support\n");
+        return false;
+#endif
+    }
+
+    // the dictionary a zstd save on the map would use now, 0 for none
+    uint32 CurrentDictionaryId(uint32 mapId)
+    {
+#ifdef ARENA_REPLAY_ZSTD
+        if (std::shared_ptr<ReplayDictionaryStore::Dictionary const> dictionary = ReplayDictionaryStore::Instance().ForMap(mapId))
+            return dictionary->id;
+#else
+        (void)mapId;
+#endif
+        return 0;
+    }
+
+    // Runs work(i) for every row on threadCount threads.
+    template<typename Work>
+    void RunParallel(size_t count, uint32 threadCount, Work&& work)
+    {
+        std::atomic<size_t> next = 0;
+        auto worker = [&]()
+        {
+            for (size_t index; (index = next.fetch_add(1, std::memory_order_relaxed)) < count;)
+                work(index);
+        };
+
+        std::vector<std::thread> workers;
+        for (uint32 i = 1; i < threadCount; ++i)
+            workers.emplace_back(worker);
+
+        worker();
+        for (std::thread& thread : workers)
+            thread.join();
+    }
+
+    InspectResult InspectReplay(DumpRow const& row)
+    {
+        InspectResult result;
+        result.storedBytes = row.contents.size();
+
+        ReplayContentsReader reader(row.contents);
+        std::deque<PacketRecord> packets;
+        result.decoded = ReadReplayRow(reader, packets);
+        std::string storedAs = GetReplayStorageFormatName(reader.Format());
+        if (reader.DictionaryId())
+            storedAs += Acore::StringFormat(" with dictionary {}", reader.DictionaryId());
+
+        if (!result.decoded)
+        {
+            result.line = Acore::StringFormat("{}: map {}, {} bytes stored as {}, contents could not be decoded", row.id, row.mapId,
+                row.contents.size(), storedAs);
+            return result;
+        }
+
+        result.serializedBytes = reader.SerializedBytes();
+
+        std::unordered_set<uint64> guids;
+        uint32 updatePayloads = 0;
+        std::string firstInvalid;
+        for (size_t i = 0; i < packets.size(); ++i)
+        {
+            WorldPacket const& packet = packets[i].packet;
+            OpcodeUsage& entry = result.usage[packet.GetOpcode()];
+            ++entry.packets;
+            entry.bytes += packet.size();
+
+            if (packets[i].sourceGuid != 0)
+                guids.insert(packets[i].sourceGuid);
+
+            UpdateObjectParseStats stats;
+            size_t failureOffset = 0;
+            bool parsed = ExtractGuidsFromPacket(packet, guids, stats, failureOffset);
+            if (packet.GetOpcode() != SMSG_UPDATE_OBJECT && packet.GetOpcode() != SMSG_COMPRESSED_UPDATE_OBJECT)
+                continue;
+
+            ++updatePayloads;
+            if (parsed)
+                continue;
+
+            if (result.invalidPayloads++ == 0)
+                firstInvalid = Acore::StringFormat(" (first: packet {} opcode {} size {} blocks {}/{} offset {})",
+                    i, packet.GetOpcode(), packet.size(), stats.parsedBlocks, stats.blockCount, failureOffset);
+        }
+
+        uint32 duration = packets.empty() ? 0 : packets.back().timestamp - packets.front().timestamp;
+        result.line = Acore::StringFormat("{}: map {}, {} bytes stored as {}, {} serialized, {} packets over {:.1f} s{}, {} GUIDs, "
+            "{} update objects, {} failed to parse{}",
+            row.id, row.mapId, row.contents.size(), storedAs, reader.SerializedBytes(), packets.size(), duration / 1000.0,
+            reader.Truncated() ? " (truncated)" : "", guids.size(), updatePayloads, result.invalidPayloads, firstInvalid);
+        return result;
+    }
+
+    int Inspect(std::vector<DumpRow> const& rows, uint32 threadCount)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<InspectResult> results(rows.size());
+        RunParallel(rows.size(), threadCount, [&](size_t index) { results[index] = InspectReplay(rows[index]); });
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        uint32 undecodable = 0;
+        uint32 withInvalidPayloads = 0;
+        uint64 storedBytes = 0;
+        uint64 serializedBytes = 0;
+        std::unordered_map<uint16, OpcodeUsage> usage;
+        for (InspectResult const& result : results)
+        {
+            std::printf("%s\n", result.line.c_str());
+            undecodable += result.decoded ? 0 : 1;
+            withInvalidPayloads += result.invalidPayloads ? 1 : 0;
+            storedBytes += result.storedBytes;
+            serializedBytes += result.serializedBytes;
+            for (auto const& [opcode, entry] : result.usage)
+            {
+                usage[opcode].packets += entry.packets;
+                usage[opcode].bytes += entry.bytes;
+            }
+        }
+
+        std::printf("%zu replays in %lld ms on %u threads: %u could not be decoded, %u with update objects that failed to parse, "
+            "%" PRIu64 " bytes stored, %" PRIu64 " bytes serialized\n",
+            rows.size(), static_cast<long long>(elapsed), threadCount, undecodable, withInvalidPayloads, storedBytes, serializedBytes);
+
+        std::vector<std::pair<uint16, OpcodeUsage>> byBytes(usage.begin(), usage.end());
+        std::sort(byBytes.begin(), byBytes.end(), [](auto const& a, auto const& b) { return a.second.bytes > b.second.bytes; });
+        for (auto const& [opcode, entry] : byBytes)
+            std::printf("  %-48s %9u packets %12" PRIu64 " bytes\n",
+                GetOpcodeNameForLogging(static_cast<Opcodes>(opcode)).c_str(), entry.packets, entry.bytes);
+
+        return undecodable ? 1 : 0;
+    }
+
+    int Transcode(std::vector<DumpRow> const& rows, ReplayStorageFormat format, char const* outputPath, std::string const& table,
+        uint32 threadCount)
+    {
+        std::ofstream output(outputPath);
+        if (!output)
+        {
+            std::fprintf(stderr, "cannot write %s\n", outputPath);
+            return 1;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<TranscodeResult> results(rows.size());
+        RunParallel(rows.size(), threadCount, [&](size_t index)
+        {
+            DumpRow const& row = rows[index];
+            TranscodeResult& result = results[index];
+            ReplayContentsReader reader(row.contents);
+            std::deque<PacketRecord> packets;
+            if (!ReadReplayRow(reader, packets) || reader.Truncated())
+                return;
+
+            // zstd rows are redone when their map has a newer dictionary
+            if (reader.Format() == format && (format != ReplayStorageFormat::Zstd || reader.DictionaryId() == CurrentDictionaryId(row.mapId)))
+            {
+                result.status = TranscodeResult::Skipped;
+                return;
+            }
+
+            ArenaReplayByteBuffer buffer;
+            SerializeReplayPackets(packets, buffer);
+            result.contents = EncodeReplayContents(buffer.contentsAsVector(), format, row.mapId);
+            result.status = TranscodeResult::Converted;
+        });
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+        uint32 converted = 0;
+        uint32 skipped = 0;
+        uint32 failed = 0;
+        uint64 bytesBefore = 0;
+        uint64 bytesAfter = 0;
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            switch (results[i].status)
+            {
+                case TranscodeResult::Converted:
+                    output << "UPDATE `" << table << "` SET contents = \"" << results[i].contents << "\" WHERE id = " << rows[i].id << ";\n";
+                    ++converted;
+                    bytesBefore += rows[i].contents.size();
+                    bytesAfter += results[i].contents.size();
+                    break;
+                case TranscodeResult::Skipped:
+                    ++skipped;
+                    break;
+                case TranscodeResult::Failed:
+                    std::fprintf(stderr, "replay %u could not be decoded or ends in the middle of a packet\n", rows[i].id);
+                    ++failed;
+                    break;
+            }
+        }
+
+        std::printf("transcoded %u of %zu replays to %s (%u skipped, %u failed, %" PRIu64 " -> %" PRIu64 " bytes) in %lld ms on %u threads\n",
+            converted, rows.size(), GetReplayStorageFormatName(format), skipped, failed, bytesBefore, bytesAfter,
+            static_cast<long long>(elapsed), threadCount);
+        return failed || !output.flush() ? 1 : 0;
+    }
+
+    int Usage(char const* name)
+    {
+        std::fprintf(stderr,
+            "usage: %s [--dictionaries <dump>] inspect <dump> [threads]\n"
+            "       %s [--dictionaries <dump>] transcode <legacy|zlib|zstd> <dump> <output.sql> [table] [threads]\n", name, name);
+        return 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    sStubLogLevel = StubLogLevel::Error;
+    std::vector<char*> args(argv, argv + argc);
+    if (args.size() >= 3 && std::string_view(args[1]) == "--dictionaries")
+    {
+        if (!LoadDictionaries(args[2]))
+            return 1;
+
+        args.erase(args.begin() + 1, args.begin() + 3);
+        argc = static_cast<int>(args.size());
+        argv = args.data();
+    }
+
+    if (argc < 3)
+        return Usage(argv[0]);
+
+    std::string_view command = argv[1];
+    uint32 threadCount = std::max<uint32>(std::thread::hardware_concurrency(), 1);
+    std::vector<DumpRow> rows;
+    if (command == "inspect")
+    {
+        if (argc > 4 || (argc == 4 && !ParseNumber(argv[3], threadCount)))
+            return Usage(argv[0]);
+
+        if (!ReadDump(argv[2], rows))
+            return 1;
+
+        return Inspect(rows, std::clamp<uint32>(threadCount, 1, 64));
+    }
+
+    if (command == "transcode")
+    {
+        ReplayStorageFormat format = ReplayStorageFormat::Legacy;
+        if (argc < 5 || argc > 7 || !ParseReplayStorageFormat(argv[2], format) || (argc == 7 && !ParseNumber(argv[6], threadCount)))
+            return Usage(argv[0]);
+
+        if (!IsReplayStorageFormatSupported(format))
+        {
+            std::fprintf(stderr, "this build has no %s support\n", GetReplayStorageFormatName(format));
+            return 1;
+        }
+
+        if (!ReadDump(argv[3], rows))
+            return 1;
+
+        std::string table = argc >= 6 ? argv[5] : REPLAY_TABLE;
+        return Transcode(rows, format, argv[4], table, std::clamp<uint32>(threadCount, 1, 64));
+    }
+
+    return Usage(argv[0]);
+}
@@ -0,0 +1,169 @@
+#include "ArenaReplayStubs.h"
+#include <algorithm>
+#include <utility>
+
+std::atomic<StubLogLevel> sStubLogLevel = StubLogLevel::Warn;
+
+namespace
+{
+    ConfigMgr configMgr;
+    CharacterCache characterCache;
+    ArenaTeamMgr arenaTeamMgr;
+    BattlegroundMgr battlegroundMgr;
+    World world;
+}
+
+ConfigMgr* sConfigMgr = &configMgr;
+CharacterDatabaseStub CharacterDatabase;
+CharacterCache* sCharacterCache = &characterCache;
+ArenaTeamMgr* sArenaTeamMgr = &arenaTeamMgr;
+BattlegroundMgr* sBattlegroundMgr = &battlegroundMgr;
+World* sWorld = &world;
+
+QueryResult MakeQueryResult(std::vector<ResultSet::Row> const& rows)
+{
+    return rows.empty() ? nullptr : std::make_shared<ResultSet>(rows);
+}
+
+void CharacterDatabaseStub::EscapeString(std::string& text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text)
+    {
+        switch (c)
+        {
+            case '\0': escaped += "\\0"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\'': escaped += "\\'"; break;
+            case '"': escaped += "\\\""; break;
+            case '\x1A': escaped += "\\Z"; break;
+            default: escaped += c; break;
+        }
+    }
+
+    text = std::move(escaped);
+}
+
+QueryResult CharacterDatabaseStub::RunQuery(std::string const& sql)
+{
+    return queryHandler ? queryHandler(sql) : nullptr;
+}
+
+void CharacterDatabaseStub::Write(std::vector<std::string> statements)
+{
+    if (writeHandler)
+        writeHandler(statements);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _writes.push_back(std::move(statements));
+}
+
+std::vector<std::vector<std::string>> CharacterDatabaseStub::TakeWrites()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return std::exchange(_writes, {});
+}
+
+namespace Acore::Encoding::Base32
+{
+    constexpr char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+    std::string Encode(std::vector<uint8> const& data)
+    {
+        std::string encoded;
+        encoded.reserve((data.size() + 4) / 5 * 8);
+        uint32 buffer = 0;
+        int bits = 0;
+        for (uint8 byte : data)
+        {
+            buffer = (buffer << 8) | byte;
+            bits += 8;
+            while (bits >= 5)
+            {
+                bits -= 5;
+                encoded += ALPHABET[(buffer >> bits) & 0x1F];
+            }
+        }
+
+        if (bits)
+            encoded += ALPHABET[(buffer << (5 - bits)) & 0x1F];
+
+        while (encoded.size() % 8)
+            encoded += '=';
+
+        return encoded;
+    }
+
+    std::optional<std::vector<uint8>> Decode(std::string const& encoded)
+    {
+        std::vector<uint8> data;
+        data.reserve(encoded.size() * 5 / 8);
+        uint32 buffer = 0;
+        int bits = 0;
+        for (char c : encoded)
+        {
+            if (c == '=')
+                break;
+
+            char const* position = std::strchr(ALPHABET, c);
+            if (!position || !c)
+                return std::nullopt;
+
+            buffer = (buffer << 5) | uint32(position - ALPHABET);
+            bits += 5;
+            if (bits >= 8)
+            {
+                bits -= 8;
+                data.push_back(uint8(buffer >> bits));
+            }
+        }
+
+        return data;
+    }
+}
+
+CharacterCacheEntry const* CharacterCache::GetCharacterCacheByGuid(ObjectGuid guid) const
+{
+    auto itr = std::find_if(entries.begin(), entries.end(), [guid](CharacterCacheEntry const& entry) { return entry.Guid == guid; });
+    return itr != entries.end() ? &*itr : nullptr;
+}
+
+CharacterCacheEntry const* CharacterCache::GetCharacterCacheByName(std::string const& name) const
+{
+    auto itr = std::find_if(entries.begin(), entries.end(), [&name](CharacterCacheEntry const& entry) { return entry.Name == name; });
+    return itr != entries.end() ? &*itr : nullptr;
+}
+
+namespace ObjectAccessor
+{
+    Player* FindPlayer(ObjectGuid /*guid*/) { return nullptr; }
+    Player* FindConnectedPlayer(ObjectGuid /*guid*/) { return nullptr; }
+}
+
+ArenaTeam* ArenaTeamMgr::GetArenaTeamById(uint32 id)
+{
+    auto itr = teams.find(id);
+    return itr != teams.end() ? &itr->second : nullptr;
+}
+
+Battleground* BattlegroundMgr::CreateNewBattleground(BattlegroundTypeId typeId, uint32 /*bracket*/, uint8 arenaType, bool rated)
+{
+    battlegrounds.push_back(std::make_unique<Battleground>(nextInstanceId++, typeId, arenaType, 0, rated));
+    return battlegrounds.back().get();
+}
+
+void BattlegroundMgr::SendToBattleground(Player* player, uint32 instanceId, BattlegroundTypeId /*typeId*/)
+{
+    for (std::unique_ptr<Battleground>& bg : battlegrounds)
+    {
+        if (bg->GetInstanceID() == instanceId)
+        {
+            player->spectator = true;
+            bg->AddSpectator(player);
+            return;
+        }
+    }
+}
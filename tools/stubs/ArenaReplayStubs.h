@@ -0,0 +1,676 @@
+// Stand-ins for the parts of the AzerothCore API the module uses, enough to
+// build ArenaReplay.cpp outside the core for the tools and tests. Packets,
+// sessions, players and battlegrounds behave like the real ones for the
+// module's purposes; the database runs queries through a handler the tool
+// installs and keeps every write it is given.
+#ifndef _MOD_ARENA_REPLAY_STUBS_H_
+#define _MOD_ARENA_REPLAY_STUBS_H_
+
+#include <fmt/format.h>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+using uint8 = std::uint8_t;
+using uint16 = std::uint16_t;
+using uint32 = std::uint32_t;
+using uint64 = std::uint64_t;
+using int8 = std::int8_t;
+using int16 = std::int16_t;
+using int32 = std::int32_t;
+using int64 = std::int64_t;
+
+constexpr uint32 IN_MILLISECONDS = 1000;
+enum TimeConstants { MINUTE = 60, HOUR = MINUTE * 60, DAY = HOUR * 24, WEEK = DAY * 7 };
+
+namespace Acore
+{
+    template <typename... Args>
+    std::string StringFormat(std::string_view fmt, Args&&... args)
+    {
+        return fmt::format(fmt::runtime(fmt), std::forward<Args>(args)...);
+    }
+}
+
+// log
+
+enum class StubLogLevel { Debug, Info, Warn, Error, None };
+extern std::atomic<StubLogLevel> sStubLogLevel;
+
+template <typename... Args>
+void StubLog(StubLogLevel level, char const* filter, std::string_view fmt, Args&&... args)
+{
+    if (level < sStubLogLevel.load(std::memory_order_relaxed))
+        return;
+
+    std::string message = Acore::StringFormat(fmt, std::forward<Args>(args)...);
+    std::fprintf(stderr, "%s: %s\n", filter, message.c_str());
+}
+
+#define LOG_DEBUG(filter, ...) StubLog(StubLogLevel::Debug, filter, __VA_ARGS__)
+#define LOG_INFO(filter, ...) StubLog(StubLogLevel::Info, filter, __VA_ARGS__)
+#define LOG_WARN(filter, ...) StubLog(StubLogLevel::Warn, filter, __VA_ARGS__)
+#define LOG_ERROR(filter, ...) StubLog(StubLogLevel::Error, filter, __VA_ARGS__)
+
+// config
+
+class ConfigMgr
+{
+public:
+    void SetOption(std::string const& name, std::string value) { _options[name] = std::move(value); }
+
+    template <typename T>
+    T GetOption(std::string const& name, T const& def, bool /*showLogs*/ = true) const
+    {
+        auto itr = _options.find(name);
+        if (itr == _options.end())
+            return def;
+
+        if constexpr (std::is_same_v<T, std::string>)
+            return itr->second;
+        else if constexpr (std::is_same_v<T, bool>)
+            return itr->second == "1" || itr->second == "true";
+        else if constexpr (std::is_floating_point_v<T>)
+            return T(std::stod(itr->second));
+        else
+        {
+            int64 value = 0;
+            std::from_chars(itr->second.data(), itr->second.data() + itr->second.size(), value);
+            return T(value);
+        }
+    }
+
+private:
+    std::unordered_map<std::string, std::string> _options;
+};
+extern ConfigMgr* sConfigMgr;
+
+// packets
+
+class ByteBuffer
+{
+public:
+    ByteBuffer() = default;
+    explicit ByteBuffer(size_t reserve) { _storage.reserve(reserve); }
+
+    template <typename T>
+    ByteBuffer& operator<<(T value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        append(reinterpret_cast<uint8 const*>(&value), sizeof(T));
+        return *this;
+    }
+
+    template <typename T>
+    ByteBuffer& operator>>(T& value)
+    {
+        read(reinterpret_cast<uint8*>(&value), sizeof(T));
+        return *this;
+    }
+
+    void append(uint8 const* data, size_t size) { _storage.insert(_storage.end(), data, data + size); }
+    void append(char const* data, size_t size) { append(reinterpret_cast<uint8 const*>(data), size); }
+
+    void read(uint8* data, size_t size)
+    {
+        if (_rpos + size > _storage.size())
+            throw std::out_of_range("ByteBuffer read past end");
+
+        std::memcpy(data, _storage.data() + _rpos, size);
+        _rpos += size;
+    }
+
+    size_t rpos() const { return _rpos; }
+    void rpos(size_t position) { _rpos = position; }
+    size_t wpos() const { return _storage.size(); }
+    size_t size() const { return _storage.size(); }
+    bool empty() const { return _storage.empty(); }
+    void reserve(size_t size) { _storage.reserve(size); }
+    void resize(size_t size) { _storage.resize(size); }
+    void clear() { _storage.clear(); _rpos = 0; }
+    uint8* contents() { return _storage.data(); }
+    uint8 const* contents() const { return _storage.data(); }
+
+protected:
+    size_t _rpos = 0;
+    std::vector<uint8> _storage;
+};
+
+enum Opcodes : uint16
+{
+    MSG_NULL_ACTION, SMSG_NOTIFICATION, SMSG_AURA_UPDATE, SMSG_WORLD_STATE_UI_TIMER_UPDATE, SMSG_COMPRESSED_UPDATE_OBJECT, SMSG_AURA_UPDATE_ALL,
+    SMSG_NAME_QUERY_RESPONSE, SMSG_DESTROY_OBJECT, SMSG_MONSTER_MOVE, SMSG_PERIODICAURALOG, SMSG_ARENA_UNIT_DESTROYED, SMSG_SPELL_START, SMSG_SPELL_GO,
+    SMSG_CAST_FAILED, SMSG_SPELL_FAILURE, SMSG_SPELL_DELAYED, SMSG_PLAY_SPELL_IMPACT, SMSG_FORCE_RUN_SPEED_CHANGE, SMSG_ATTACKSTART, SMSG_POWER_UPDATE,
+    SMSG_ATTACKERSTATEUPDATE, SMSG_SPELLDAMAGESHIELD, SMSG_SPELLHEALLOG, SMSG_SPELLENERGIZELOG, SMSG_SPELLNONMELEEDAMAGELOG, SMSG_ATTACKSTOP, SMSG_EMOTE,
+    SMSG_AI_REACTION, SMSG_PET_NAME_QUERY_RESPONSE, SMSG_CANCEL_AUTO_REPEAT, SMSG_UPDATE_OBJECT, SMSG_FORCE_FLIGHT_SPEED_CHANGE, SMSG_GAMEOBJECT_QUERY_RESPONSE,
+    SMSG_FORCE_SWIM_SPEED_CHANGE, SMSG_GAMEOBJECT_DESPAWN_ANIM, SMSG_CANCEL_COMBAT, SMSG_DISMOUNTRESULT, SMSG_MOUNTRESULT, SMSG_DISMOUNT, SMSG_MOUNTSPECIAL_ANIM,
+    SMSG_MIRRORIMAGE_DATA, SMSG_MESSAGECHAT, SMSG_MULTIPLE_PACKETS, CMSG_CAST_SPELL, CMSG_CANCEL_CAST, CMSG_MOUNTSPECIAL_ANIM, CMSG_MESSAGECHAT,
+    MSG_MOVE_START_FORWARD, MSG_MOVE_SET_FACING, MSG_MOVE_HEARTBEAT, MSG_MOVE_JUMP, MSG_MOVE_FALL_LAND, MSG_MOVE_START_STRAFE_RIGHT, MSG_MOVE_STOP_STRAFE,
+    MSG_MOVE_START_STRAFE_LEFT, MSG_MOVE_STOP, MSG_MOVE_START_BACKWARD, MSG_MOVE_START_TURN_LEFT, MSG_MOVE_STOP_TURN, MSG_MOVE_START_TURN_RIGHT,
+    NUM_MSG_TYPES = 0x51F
+};
+
+inline std::string GetOpcodeNameForLogging(Opcodes opcode) { return fmt::format("opcode 0x{:03X}", uint32(opcode)); }
+
+class WorldPacket : public ByteBuffer
+{
+public:
+    WorldPacket() = default;
+    explicit WorldPacket(uint16 opcode, size_t reserve = 200) : ByteBuffer(reserve), m_opcode(opcode) { }
+
+    uint16 GetOpcode() const { return m_opcode; }
+    void SetOpcode(uint16 opcode) { m_opcode = opcode; }
+    void Initialize(uint16 opcode, size_t reserve = 200) { clear(); _storage.reserve(reserve); m_opcode = opcode; }
+
+private:
+    uint16 m_opcode = 0;
+};
+
+// 3.3.5a field layout, the fields the GUID rewrite looks at
+enum EObjectFields { OBJECT_FIELD_GUID = 0, OBJECT_END = 0x6 };
+enum EItemFields { ITEM_FIELD_OWNER = OBJECT_END, ITEM_FIELD_CONTAINED = OBJECT_END + 2, ITEM_FIELD_CREATOR = OBJECT_END + 4, ITEM_FIELD_GIFTCREATOR = OBJECT_END + 6, ITEM_END = OBJECT_END + 0x3A };
+enum EContainerFields { CONTAINER_END = ITEM_END + 0x4A };
+enum EUnitFields { UNIT_FIELD_CHARM = OBJECT_END, UNIT_FIELD_SUMMON = OBJECT_END + 2, UNIT_FIELD_CHARMEDBY = OBJECT_END + 6, UNIT_FIELD_SUMMONEDBY = OBJECT_END + 8,
+    UNIT_FIELD_CREATEDBY = OBJECT_END + 10, UNIT_FIELD_TARGET = OBJECT_END + 12, UNIT_FIELD_CHANNEL_OBJECT = OBJECT_END + 14, UNIT_END = OBJECT_END + 0x8E };
+enum EPlayerFields { PLAYER_FARSIGHT = UNIT_END + 0x270, PLAYER_END = UNIT_END + 0x49A };
+enum EGameObjectFields { OBJECT_FIELD_CREATED_BY = OBJECT_END, GAMEOBJECT_END = OBJECT_END + 0xC };
+enum EDynamicObjectFields { DYNAMICOBJECT_CASTER = OBJECT_END, DYNAMICOBJECT_END = OBJECT_END + 0x6 };
+enum ECorpseFields { CORPSE_FIELD_OWNER = OBJECT_END, CORPSE_END = OBJECT_END + 0x1E };
+
+// database
+
+class Field
+{
+public:
+    Field() = default;
+    explicit Field(std::optional<std::string> value) : _value(std::move(value)) { }
+
+    bool IsNull() const { return !_value; }
+
+    template <typename T>
+    T Get() const
+    {
+        if (!_value)
+            return T();
+
+        if constexpr (std::is_same_v<T, std::string>)
+            return *_value;
+        else if constexpr (std::is_same_v<T, bool>)
+            return *_value != "0";
+        else if constexpr (std::is_floating_point_v<T>)
+            return T(std::stod(*_value));
+        else
+        {
+            std::conditional_t<std::is_signed_v<T>, int64, uint64> value = 0;
+            std::from_chars(_value->data(), _value->data() + _value->size(), value);
+            return T(value);
+        }
+    }
+
+private:
+    std::optional<std::string> _value;
+};
+
+class ResultSet
+{
+public:
+    using Row = std::vector<std::optional<std::string>>;
+
+    explicit ResultSet(std::vector<Row> const& rows)
+    {
+        for (Row const& row : rows)
+            _rows.emplace_back(row.begin(), row.end());
+    }
+
+    Field* Fetch() { return _row < _rows.size() ? _rows[_row].data() : nullptr; }
+    bool NextRow() { return ++_row < _rows.size(); }
+    uint64 GetRowCount() const { return _rows.size(); }
+    uint32 GetFieldCount() const { return _rows.empty() ? 0 : uint32(_rows.front().size()); }
+
+private:
+    std::vector<std::vector<Field>> _rows;
+    size_t _row = 0;
+};
+using QueryResult = std::shared_ptr<ResultSet>;
+
+// rows of a stub query, null for an empty result like the real pool
+QueryResult MakeQueryResult(std::vector<ResultSet::Row> const& rows);
+
+class Transaction
+{
+public:
+    template <typename... Args>
+    void Append(std::string_view sql, Args&&... args)
+    {
+        if constexpr (sizeof...(Args) == 0)
+            statements.emplace_back(sql);
+        else
+            statements.push_back(Acore::StringFormat(sql, std::forward<Args>(args)...));
+    }
+
+    std::vector<std::string> statements;
+};
+using CharacterDatabaseTransaction = std::shared_ptr<Transaction>;
+
+// Synchronous queries go to queryHandler; executes and committed
+// transactions are kept in order, each transaction as one entry.
+class CharacterDatabaseStub
+{
+public:
+    template <typename... Args>
+    QueryResult Query(std::string_view sql, Args&&... args)
+    {
+        return RunQuery(Format(sql, std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    void Execute(std::string_view sql, Args&&... args) { Write({ Format(sql, std::forward<Args>(args)...) }); }
+
+    template <typename... Args>
+    void DirectExecute(std::string_view sql, Args&&... args) { Write({ Format(sql, std::forward<Args>(args)...) }); }
+
+    CharacterDatabaseTransaction BeginTransaction() { return std::make_shared<Transaction>(); }
+    void CommitTransaction(CharacterDatabaseTransaction transaction) { Write(transaction->statements); }
+    void DirectCommitTransaction(CharacterDatabaseTransaction& transaction) { Write(transaction->statements); }
+
+    void EscapeString(std::string& text);
+
+    std::function<QueryResult(std::string const& sql)> queryHandler;
+    std::function<void(std::vector<std::string> const& statements)> writeHandler;
+
+    std::vector<std::vector<std::string>> TakeWrites();
+
+private:
+    template <typename... Args>
+    static std::string Format(std::string_view sql, Args&&... args)
+    {
+        if constexpr (sizeof...(Args) == 0)
+            return std::string(sql);
+        else
+            return Acore::StringFormat(sql, std::forward<Args>(args)...);
+    }
+
+    QueryResult RunQuery(std::string const& sql);
+    void Write(std::vector<std::string> statements);
+
+    std::mutex _mutex;
+    std::vector<std::vector<std::string>> _writes;
+};
+extern CharacterDatabaseStub CharacterDatabase;
+
+namespace Acore::Encoding::Base32
+{
+    std::string Encode(std::vector<uint8> const& data);
+    std::optional<std::vector<uint8>> Decode(std::string const& encoded);
+}
+
+// objects
+
+enum class HighGuid { Player = 0 };
+
+class ObjectGuid
+{
+public:
+    ObjectGuid() = default;
+    explicit ObjectGuid(uint64 raw) : _raw(raw) { }
+
+    template <HighGuid>
+    static ObjectGuid Create(uint64 counter) { return ObjectGuid(counter); }
+
+    uint64 GetRawValue() const { return _raw; }
+    uint32 GetCounter() const { return uint32(_raw); }
+
+    bool operator==(ObjectGuid const& other) const { return _raw == other._raw; }
+    bool operator!=(ObjectGuid const& other) const { return _raw != other._raw; }
+    bool operator<(ObjectGuid const& other) const { return _raw < other._raw; }
+
+private:
+    uint64 _raw = 0;
+};
+
+enum TeamId { TEAM_ALLIANCE = 0, TEAM_HORDE = 1, TEAM_NEUTRAL = 2 };
+enum Classes { CLASS_WARRIOR = 1, CLASS_PALADIN, CLASS_HUNTER, CLASS_ROGUE, CLASS_PRIEST, CLASS_DEATH_KNIGHT, CLASS_SHAMAN, CLASS_MAGE, CLASS_WARLOCK, CLASS_UNK, CLASS_DRUID };
+enum Races { RACE_HUMAN = 1, RACE_ORC, RACE_DWARF, RACE_NIGHTELF, RACE_UNDEAD_PLAYER, RACE_TAUREN, RACE_GNOME, RACE_TROLL, RACE_GOBLIN, RACE_BLOODELF, RACE_DRAENEI };
+enum Gender { GENDER_MALE = 0, GENDER_FEMALE = 1 };
+
+struct CharacterCacheEntry
+{
+    ObjectGuid Guid;
+    std::string Name;
+    uint32 AccountId = 0;
+    uint8 Class = 0;
+    uint8 Race = 0;
+    uint8 Sex = 0;
+    uint8 Level = 0;
+};
+
+class CharacterCache
+{
+public:
+    CharacterCacheEntry const* GetCharacterCacheByGuid(ObjectGuid guid) const;
+    CharacterCacheEntry const* GetCharacterCacheByName(std::string const& name) const;
+
+    std::vector<CharacterCacheEntry> entries;
+};
+extern CharacterCache* sCharacterCache;
+
+class Battleground;
+class Player;
+
+// what the session was sent, by count and bytes
+class WorldSession
+{
+public:
+    explicit WorldSession(Player* player = nullptr) : _player(player) { }
+
+    Player* GetPlayer() const { return _player; }
+    void SetPlayer(Player* player) { _player = player; }
+
+    void SendPacket(WorldPacket const* packet)
+    {
+        ++sentPackets;
+        sentBytes += packet->size();
+        if (onSend)
+            onSend(*packet);
+    }
+
+    uint64 sentPackets = 0;
+    uint64 sentBytes = 0;
+    std::function<void(WorldPacket const&)> onSend;
+    std::vector<std::string> systemMessages;
+
+private:
+    Player* _player;
+};
+
+class Creature
+{
+public:
+    ObjectGuid GetGUID() const { return ObjectGuid(); }
+};
+
+class PlayerMenu
+{
+public:
+    void ClearMenus() { }
+    void SendCloseGossip() { }
+};
+
+class Player
+{
+public:
+    Player(ObjectGuid guid, std::string name, TeamId team) : _guid(guid), _name(std::move(name)), _team(team), _session(this) { }
+
+    WorldSession* GetSession() { return &_session; }
+    Battleground* GetBattleground() const { return _battleground; }
+    void SetBattleground(Battleground* battleground) { _battleground = battleground; }
+    ObjectGuid GetGUID() const { return _guid; }
+    TeamId GetBgTeamId() const { return _team; }
+    std::string const& GetName() const { return _name; }
+
+    bool IsSpectator() const { return spectator; }
+    bool InBattlegroundQueue() const { return false; }
+    uint8 getRace() const { return race; }
+    uint8 getClass() const { return playerClass; }
+    uint8 getGender() const { return gender; }
+
+    static TeamId TeamIdForRace(uint8 race) { return race == RACE_ORC || race == RACE_UNDEAD_PLAYER || race == RACE_TAUREN || race == RACE_TROLL || race == RACE_BLOODELF ? TEAM_HORDE : TEAM_ALLIANCE; }
+    void SetPendingSpectatorForBG(uint32 instanceId) { pendingSpectatorInstance = instanceId; }
+    uint32 AddBattlegroundQueueId(uint32 /*queueTypeId*/) { return 0; }
+    void SetBattlegroundId(uint32 /*instanceId*/, uint32 /*bgTypeId*/, uint32 /*queueSlot*/, bool /*invited*/, bool /*randomBg*/, TeamId /*teamId*/) { }
+    void SetEntryPoint() { }
+
+    PlayerMenu* PlayerTalkClass = &_menu;
+    bool spectator = false;
+    uint8 race = RACE_HUMAN;
+    uint8 playerClass = CLASS_WARRIOR;
+    uint8 gender = GENDER_MALE;
+    uint32 pendingSpectatorInstance = 0;
+
+private:
+    ObjectGuid _guid;
+    std::string _name;
+    TeamId _team;
+    WorldSession _session;
+    PlayerMenu _menu;
+    Battleground* _battleground = nullptr;
+};
+
+namespace ObjectAccessor
+{
+    Player* FindPlayer(ObjectGuid guid);
+    Player* FindConnectedPlayer(ObjectGuid guid);
+}
+
+enum BattlegroundTypeId : uint32 { BATTLEGROUND_TYPE_NONE = 0, BATTLEGROUND_AA = 6, BATTLEGROUND_NA = 4 };
+enum class BattlegroundStatus { STATUS_NONE, STATUS_WAIT_QUEUE, STATUS_WAIT_JOIN, STATUS_IN_PROGRESS, STATUS_WAIT_LEAVE };
+enum ArenaType : uint8 { ARENA_TYPE_2v2 = 2, ARENA_TYPE_3v3 = 3, ARENA_TYPE_5v5 = 5 };
+
+class Battleground
+{
+public:
+    Battleground(uint32 instanceId, BattlegroundTypeId typeId, uint8 arenaType, uint32 mapId, bool rated)
+        : _instanceId(instanceId), _typeId(typeId), _arenaType(arenaType), _mapId(mapId), _rated(rated) { }
+
+    uint32 GetInstanceID() const { return _instanceId; }
+    BattlegroundStatus GetStatus() const { return _status; }
+    void SetStatus(BattlegroundStatus status) { _status = status; }
+    uint32 GetStartTime() const { return _startTime; }
+    void SetStartTime(uint32 startTime) { _startTime = startTime; }
+    int32 GetStartDelayTime() const { return _startDelayTime; }
+    void SetStartDelayTime(int32 startDelayTime) { _startDelayTime = startDelayTime; }
+    BattlegroundTypeId GetBgTypeID() const { return _typeId; }
+    uint8 GetArenaType() const { return _arenaType; }
+    uint32 GetMapId() const { return _mapId; }
+    bool isArena() const { return _arenaType != 0; }
+    bool isRated() const { return _rated; }
+
+    std::map<ObjectGuid, Player*> const& GetPlayers() const { return _players; }
+    std::set<Player*> const& GetSpectators() const { return _spectators; }
+    void AddPlayer(Player* player) { _players[player->GetGUID()] = player; player->SetBattleground(this); }
+    void AddSpectator(Player* player) { _spectators.insert(player); player->SetBattleground(this); }
+    void RemoveSpectator(Player* player) { _spectators.erase(player); }
+
+    uint32 GetArenaTeamIdForTeam(TeamId team) const { return team; }
+    uint32 GetArenaMatchmakerRating(TeamId /*team*/) const { return 0; }
+    void IncreaseInvitedCount(TeamId /*team*/) { }
+
+private:
+    uint32 _instanceId;
+    BattlegroundTypeId _typeId;
+    uint8 _arenaType;
+    uint32 _mapId;
+    bool _rated;
+    BattlegroundStatus _status = BattlegroundStatus::STATUS_WAIT_JOIN;
+    uint32 _startTime = 0;
+    int32 _startDelayTime = 0;
+    std::map<ObjectGuid, Player*> _players;
+    std::set<Player*> _spectators;
+};
+
+class ArenaTeam
+{
+public:
+    uint32 GetId() const { return id; }
+    std::string const& GetName() const { return name; }
+    uint32 GetRating() const { return rating; }
+
+    uint32 id = 0;
+    std::string name;
+    uint32 rating = 0;
+};
+
+class ArenaTeamMgr
+{
+public:
+    ArenaTeam* GetArenaTeamById(uint32 id);
+
+    std::unordered_map<uint32, ArenaTeam> teams;
+};
+extern ArenaTeamMgr* sArenaTeamMgr;
+
+using BattlegroundQueueTypeId = uint32;
+
+// Battlegrounds created for replays, owned here.
+class BattlegroundMgr
+{
+public:
+    Battleground* CreateNewBattleground(BattlegroundTypeId typeId, uint32 bracket, uint8 arenaType, bool rated);
+    void AddBattleground(Battleground* /*bg*/) { }
+    static BattlegroundQueueTypeId BGQueueTypeId(BattlegroundTypeId typeId, uint8 arenaType) { return typeId * 16 + arenaType; }
+    void SendToBattleground(Player* player, uint32 instanceId, BattlegroundTypeId typeId);
+
+    std::vector<std::unique_ptr<Battleground>> battlegrounds;
+    uint32 nextInstanceId = 100000;
+};
+extern BattlegroundMgr* sBattlegroundMgr;
+
+inline uint32 GetBattlegroundBracketByLevel(uint32 /*mapId*/, uint32 /*level*/) { return 0; }
+
+enum WorldIntConfigs { CONFIG_MAX_PLAYER_LEVEL };
+
+class World
+{
+public:
+    uint32 getIntConfig(WorldIntConfigs /*index*/) const { return 80; }
+};
+extern World* sWorld;
+
+// chat
+
+class ChatHandler
+{
+public:
+    explicit ChatHandler(WorldSession* session) : _session(session) { }
+
+    template <typename... Args>
+    void PSendSysMessage(std::string_view fmt, Args&&... args) { SendSysMessage(Acore::StringFormat(fmt, std::forward<Args>(args)...)); }
+
+    void SendSysMessage(std::string_view message)
+    {
+        if (_session)
+            _session->systemMessages.emplace_back(message);
+        else
+            std::printf("%.*s\n", int(message.size()), message.data());
+    }
+
+    void SetSentErrorMessage(bool /*value*/) { }
+    WorldSession* GetSession() { return _session; }
+    Player* GetPlayer() { return _session ? _session->GetPlayer() : nullptr; }
+
+private:
+    WorldSession* _session;
+};
+
+enum GossipOptionIcon { GOSSIP_ICON_CHAT, GOSSIP_ICON_VENDOR, GOSSIP_ICON_TAXI, GOSSIP_ICON_TRAINER, GOSSIP_ICON_BATTLE = 9 };
+constexpr uint32 GOSSIP_SENDER_MAIN = 1;
+constexpr uint32 GOSSIP_ACTION_INFO_DEF = 1000;
+constexpr uint32 DEFAULT_GOSSIP_MESSAGE = 0xFFFFFF;
+
+inline void AddGossipItemFor(Player*, uint32, std::string const&, uint32, uint32) { }
+inline void AddGossipItemFor(Player*, uint32, std::string const&, uint32, uint32, std::string const&, uint32, bool) { }
+inline void SendGossipMenuFor(Player*, uint32, ObjectGuid) { }
+inline void CloseGossipMenuFor(Player*) { }
+
+// scripts
+
+enum ServerHook { SERVERHOOK_CAN_PACKET_SEND };
+enum ArenaHook { ARENAHOOK_ON_BEFORE_CHECK_WIN_CONDITION };
+enum AllBattlegroundHook { ALLBATTLEGROUNDHOOK_ON_BATTLEGROUND_UPDATE, ALLBATTLEGROUNDHOOK_ON_BATTLEGROUND_ADD_PLAYER, ALLBATTLEGROUNDHOOK_ON_BATTLEGROUND_END };
+enum WorldHook { WORLDHOOK_ON_AFTER_CONFIG_LOAD, WORLDHOOK_ON_STARTUP, WORLDHOOK_ON_UPDATE, WORLDHOOK_ON_SHUTDOWN, WORLDHOOK_ON_BEFORE_WORLD_INITIALIZED };
+
+class ServerScript
+{
+public:
+    ServerScript(char const* /*name*/, std::vector<uint16> /*hooks*/) { }
+    virtual ~ServerScript() = default;
+    virtual bool CanPacketSend(WorldSession* /*session*/, WorldPacket& /*packet*/) { return true; }
+};
+
+class ArenaScript
+{
+public:
+    ArenaScript(char const* /*name*/, std::vector<uint16> /*hooks*/) { }
+    virtual ~ArenaScript() = default;
+    virtual bool OnBeforeArenaCheckWinConditions(Battleground* const /*bg*/) { return true; }
+};
+
+class BGScript
+{
+public:
+    BGScript(char const* /*name*/, std::vector<uint16> /*hooks*/) { }
+    virtual ~BGScript() = default;
+    virtual void OnBattlegroundUpdate(Battleground* /*bg*/, uint32 /*diff*/) { }
+    virtual void OnBattlegroundAddPlayer(Battleground* /*bg*/, Player* /*player*/) { }
+    virtual void OnBattlegroundEnd(Battleground* /*bg*/, TeamId /*winnerTeamId*/) { }
+};
+
+class CreatureScript
+{
+public:
+    explicit CreatureScript(char const* /*name*/) { }
+    virtual ~CreatureScript() = default;
+    virtual bool OnGossipHello(Player* /*player*/, Creature* /*creature*/) { return false; }
+    virtual bool OnGossipSelect(Player* /*player*/, Creature* /*creature*/, uint32 /*sender*/, uint32 /*action*/) { return false; }
+    virtual bool OnGossipSelectCode(Player* /*player*/, Creature* /*creature*/, uint32 /*sender*/, uint32 /*action*/, char const* /*code*/) { return false; }
+};
+
+class WorldScript
+{
+public:
+    WorldScript(char const* /*name*/, std::vector<uint16> /*hooks*/) { }
+    virtual ~WorldScript() = default;
+    virtual void OnAfterConfigLoad(bool /*reload*/) { }
+    virtual void OnStartup() { }
+    virtual void OnUpdate(uint32 /*diff*/) { }
+    virtual void OnShutdown() { }
+};
+
+namespace Acore::ChatCommands
+{
+    enum Console { No, Yes };
+
+    struct ChatCommandBuilder
+    {
+        template <typename Handler>
+        ChatCommandBuilder(char const* /*name*/, Handler /*handler*/, uint32 /*security*/, Console /*console*/) { }
+        ChatCommandBuilder(char const* /*name*/, std::vector<ChatCommandBuilder> /*subCommands*/) { }
+    };
+
+    using ChatCommandTable = std::vector<ChatCommandBuilder>;
+
+    struct Tail : std::string_view
+    {
+        using std::string_view::string_view;
+        Tail(std::string_view text) : std::string_view(text) { }
+    };
+
+    template <typename T>
+    using Optional = std::optional<T>;
+}
+
+enum AccountTypes { SEC_PLAYER, SEC_MODERATOR, SEC_GAMEMASTER, SEC_ADMINISTRATOR, SEC_CONSOLE };
+
+class CommandScript
+{
+public:
+    explicit CommandScript(char const* /*name*/) { }
+    virtual ~CommandScript() = default;
+    virtual Acore::ChatCommands::ChatCommandTable GetCommands() const = 0;
+};
+
+#endif
@@ -0,0 +1 @@
+#include "ArenaReplayStubs.h"
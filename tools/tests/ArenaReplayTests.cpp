@@ -0,0 +1,656 @@
+// Unit tests for the replay storage and rewrite code, built against the
+// stand-ins in tools/stubs.
+#define CATCH_CONFIG_MAIN
+#include "ArenaReplay.cpp"
+#include "ArenaTrafficGenerator.h"
+#include "UpdateObjectValidation.h"
+#include <catch2/catch.hpp>
+#include <future>
+#include <random>
+
+namespace
+{
+    std::vector<uint8> RandomBytes(std::mt19937& random, size_t size, uint32 alphabet)
+    {
+        std::vector<uint8> bytes(size);
+        for (uint8& byte : bytes)
+            byte = uint8(random() % alphabet);
+
+        return bytes;
+    }
+
+    // reads a stored row the way a load does and serializes its packets again
+    std::vector<uint8> ReadStoredReplay(std::string const& stored, ReplayStorageFormat& format)
+    {
+        ReplayContentsReader reader(stored);
+        std::deque<PacketRecord> packets;
+        while (reader.Read(packets))
+            ;
+
+        REQUIRE(!reader.Failed());
+        REQUIRE(!reader.Truncated());
+        format = reader.Format();
+        ArenaReplayByteBuffer buffer;
+        SerializeReplayPackets(packets, buffer);
+        return buffer.contentsAsVector();
+    }
+
+    // SMSG_UPDATE_OBJECT with one block setting UNIT_FIELD_TARGET of guid,
+    // created as a unit when create is set
+    WorldPacket TargetUpdate(uint64 guid, uint64 target, bool create)
+    {
+        std::vector<uint8> payload;
+        WriteLittleEndian(payload, uint32(1));
+        payload.push_back(0);
+        payload.push_back(static_cast<uint8>(create ? UpdateType::CreateObject2 : UpdateType::Values));
+        WritePackedGuid(payload, guid);
+        if (create)
+        {
+            payload.push_back(static_cast<uint8>(TypeId::Unit));
+            for (uint32 field : { 0u, 0u, 0u, 0u, 0u, 0u, 0u })
+                WriteLittleEndian(payload, field);
+            WriteLittleEndian(payload, uint16(0));
+        }
+
+        payload.push_back(1);
+        WriteLittleEndian(payload, uint32(3) << 0x12);
+        WriteLittleEndian(payload, static_cast<uint32>(target));
+        WriteLittleEndian(payload, static_cast<uint32>(target >> 32));
+
+        WorldPacket packet(SMSG_UPDATE_OBJECT, payload.size());
+        packet.append(payload.data(), payload.size());
+        return packet;
+    }
+
+    // Reference for ReplaceSequence: the original erase/insert loop.
+    bool ReplaceSequenceReference(std::vector<uint8>& buffer, std::vector<uint8> const& from, std::vector<uint8> const& to)
+    {
+        if (from.empty() || from == to)
+            return false;
+
+        bool modified = false;
+        for (size_t i = 0; i + from.size() <= buffer.size();)
+        {
+            if (std::memcmp(buffer.data() + i, from.data(), from.size()) == 0)
+            {
+                buffer.erase(buffer.begin() + i, buffer.begin() + i + from.size());
+                buffer.insert(buffer.begin() + i, to.begin(), to.end());
+                i += to.size();
+                modified = true;
+            }
+            else
+                ++i;
+        }
+
+        return modified;
+    }
+}
+
+TEST_CASE("ReplaceSequence matches the erase/insert rewrite", "[guid]")
+{
+    std::mt19937 random(27);
+    for (uint32 round = 0; round < 2000; ++round)
+    {
+        // A small alphabet makes matches, overlaps and self-overlapping
+        // patterns such as "aa" common.
+        uint32 const alphabet = 2 + round % 3;
+        std::vector<uint8> buffer = RandomBytes(random, random() % 256, alphabet);
+        size_t const length = 1 + random() % 8;
+        std::vector<uint8> from = RandomBytes(random, length, alphabet);
+        std::vector<uint8> to = RandomBytes(random, length, alphabet);
+
+        std::vector<uint8> expected = buffer;
+        bool const expectedModified = ReplaceSequenceReference(expected, from, to);
+        bool const modified = ReplaceSequence(buffer, from, to);
+
+        INFO("round " << round);
+        REQUIRE(modified == expectedModified);
+        REQUIRE(buffer == expected);
+    }
+}
+
+TEST_CASE("ReplaceSequence refuses length-changing rewrites", "[guid]")
+{
+    std::vector<uint8> buffer = { 1, 2, 3, 1, 2, 3 };
+    std::vector<uint8> const original = buffer;
+    std::vector<uint8> const from = { 1, 2 };
+    std::vector<uint8> const to = { 9 };
+
+    REQUIRE_FALSE(ReplaceSequence(buffer, from, to));
+    REQUIRE(buffer == original);
+}
+
+TEST_CASE("Compress output is a zlib stream Decompress reads back", "[codec]")
+{
+    std::mt19937 random(29);
+    for (size_t size : { size_t(1), size_t(100), size_t(5000), size_t(300000) })
+    {
+        std::vector<uint8> input = RandomBytes(random, size, 16);
+        std::vector<uint8> compressed;
+        REQUIRE(Compress(input, compressed));
+
+        uint32 storedSize = 0;
+        std::memcpy(&storedSize, compressed.data(), sizeof(uint32));
+        REQUIRE(storedSize == size);
+
+        // the client inflates these with zlib whichever codec wrote them
+        std::vector<uint8> inflated(size);
+        uLongf inflatedSize = inflated.size();
+        REQUIRE(uncompress(inflated.data(), &inflatedSize, compressed.data() + sizeof(uint32), compressed.size() - sizeof(uint32)) == Z_OK);
+        REQUIRE(inflatedSize == size);
+        REQUIRE(inflated == input);
+
+        std::vector<uint8> output;
+        REQUIRE(Decompress(compressed, output));
+        REQUIRE(output == input);
+    }
+}
+
+TEST_CASE("A legacy save never looks like a container", "[storage]")
+{
+    // a first packet of 0x505241 bytes makes the size word spell "ARP"
+    std::vector<uint8> serialized = { 'A', 'R', 'P', 0, 0, 0, 0, 0, 30, 0 };
+    serialized.resize(serialized.size() + 0x505241, 7);
+
+    std::string stored = EncodeReplayContents(serialized, ReplayStorageFormat::Legacy, 0);
+    ReplayStorageFormat storedFormat = ReplayStorageFormat::Legacy;
+    REQUIRE(ReadStoredReplay(stored, storedFormat) == serialized);
+    REQUIRE(storedFormat == ReplayStorageFormat::Zlib);
+}
+
+TEST_CASE("Merged update objects parse and keep every block", "[playback]")
+{
+    ArenaTrafficGenerator generator(39, 1000, 3);
+    std::deque<PacketRecord> packets;
+    std::vector<WorldPacket> tickPackets;
+    for (uint32 tick = 0; tick < 300; ++tick)
+    {
+        generator.NextTick(tick, tickPackets);
+        for (WorldPacket& packet : tickPackets)
+            if (packet.GetOpcode() == SMSG_UPDATE_OBJECT)
+                packets.push_back({ tick * 100, std::move(packet) });
+    }
+
+    REQUIRE(packets.size() > 100);
+
+    size_t merges = 0;
+    for (size_t first = 0; first < packets.size();)
+    {
+        size_t count = CountMergeableUpdateObjects(packets, first, packets.back().timestamp, 0, packets.size());
+        REQUIRE(count >= 1);
+
+        WorldPacket merged;
+        MergeUpdateObjects(packets, first, count, merged);
+
+        uint32 expectedBlocks = 0;
+        size_t expectedSize = UPDATE_OBJECT_HEADER_SIZE;
+        for (size_t i = first; i < first + count; ++i)
+        {
+            WorldPacket const& packet = packets[i].packet;
+            uint32 blocks = 0;
+            std::memcpy(&blocks, packet.contents(), sizeof(blocks));
+            expectedBlocks += blocks;
+            expectedSize += packet.size() - UPDATE_OBJECT_HEADER_SIZE;
+
+            // only the head of a merge may start with its out of range list
+            if (i != first)
+                REQUIRE(packet.contents()[UPDATE_OBJECT_HEADER_SIZE] != static_cast<uint8>(UpdateType::OutOfRange));
+        }
+
+        INFO("packets " << first << " to " << first + count);
+        REQUIRE(merged.size() == expectedSize);
+        REQUIRE((count == 1 || merged.size() <= MERGED_UPDATE_OBJECT_MAX_SIZE));
+        REQUIRE(merged.contents()[UPDATE_OBJECT_HEADER_SIZE - 1] == packets[first].packet.contents()[UPDATE_OBJECT_HEADER_SIZE - 1]);
+
+        UpdateObjectParseStats stats;
+        size_t failureOffset = 0;
+        REQUIRE(ValidateUpdateObjectPayload(std::span<uint8 const>(merged.contents(), merged.size()), stats, failureOffset));
+        REQUIRE(stats.blockCount == expectedBlocks);
+        REQUIRE(stats.parsedBlocks == expectedBlocks);
+        REQUIRE(stats.bytesConsumed == merged.size());
+
+        merges += count > 1 ? 1 : 0;
+        first += count;
+    }
+
+    REQUIRE(merges > 0);
+}
+
+TEST_CASE("Every storage format of the build reads back", "[storage]")
+{
+    std::mt19937 random(41);
+    std::vector<uint8> serialized;
+    for (uint32 i = 0; i < 200; ++i)
+    {
+        std::vector<uint8> payload = RandomBytes(random, random() % 300, 8);
+        WriteLittleEndian(serialized, uint32(payload.size()));
+        WriteLittleEndian(serialized, i * 100);
+        WriteLittleEndian(serialized, uint16(SMSG_UPDATE_OBJECT));
+        serialized.insert(serialized.end(), payload.begin(), payload.end());
+    }
+
+    for (ReplayStorageFormat format : { ReplayStorageFormat::Legacy, ReplayStorageFormat::Zlib, ReplayStorageFormat::Zstd })
+    {
+        if (!IsReplayStorageFormatSupported(format))
+            continue;
+
+        INFO(GetReplayStorageFormatName(format));
+        ReplayStorageFormat storedFormat = ReplayStorageFormat::Legacy;
+        REQUIRE(ReadStoredReplay(EncodeReplayContents(serialized, format, 0), storedFormat) == serialized);
+        REQUIRE(storedFormat == format);
+    }
+}
+
+#ifdef ARENA_REPLAY_ZSTD
+TEST_CASE("A zstd row is compressed with its map's dictionary and names it", "[storage]")
+{
+    ArenaTrafficGenerator generator(53, 1000, 3);
+    MatchRecord record;
+    std::vector<WorldPacket> tickPackets;
+    for (uint32 tick = 0; tick < 100; ++tick)
+    {
+        generator.NextTick(tick, tickPackets);
+        for (WorldPacket& packet : tickPackets)
+            record.packets.push_back({ tick * 100, std::move(packet) });
+    }
+
+    ArenaReplayByteBuffer buffer;
+    SerializeReplayPackets(record.packets, buffer);
+    std::vector<uint8> const serialized = buffer.contentsAsVector();
+
+    // any content works as a raw dictionary; the newest one of a map is used
+    std::vector<uint8> content(serialized.begin(), serialized.begin() + std::min<size_t>(serialized.size(), 16 * 1024));
+    REQUIRE(ReplayDictionaryStore::Instance().Add(41, 617, content));
+    REQUIRE(ReplayDictionaryStore::Instance().Add(42, 617, content));
+
+    std::string const stored = EncodeReplayContents(serialized, ReplayStorageFormat::Zstd, 617);
+    REQUIRE(stored.size() < EncodeReplayContents(serialized, ReplayStorageFormat::Zstd, 618).size());
+
+    ReplayContentsReader reader(stored);
+    std::deque<PacketRecord> packets;
+    while (reader.Read(packets))
+        ;
+
+    REQUIRE(!reader.Failed());
+    REQUIRE(reader.DictionaryId() == 42);
+    REQUIRE(reader.SerializedBytes() == serialized.size());
+    REQUIRE(packets.size() == record.packets.size());
+
+    // a row naming a dictionary that is not loaded does not decode
+    auto container = Acore::Encoding::Base32::Decode(stored);
+    REQUIRE(container);
+    (*container)[REPLAY_CONTAINER_HEADER_SIZE] = 99;
+    ReplayContentsReader unknown(Acore::Encoding::Base32::Encode(*container));
+    while (unknown.Read(packets))
+        ;
+
+    REQUIRE(unknown.Failed());
+    REQUIRE(unknown.DictionaryId() == 99);
+}
+#endif
+
+TEST_CASE("A row read a block at a time gives the packets of the whole row", "[storage]")
+{
+    std::mt19937 random(43);
+    std::vector<uint8> serialized;
+    for (uint32 i = 0; i < 2000; ++i)
+    {
+        std::vector<uint8> payload = RandomBytes(random, random() % 600, 4);
+        WriteLittleEndian(serialized, uint32(payload.size()) | (i % 3 ? 0 : 0x80000000u));
+        WriteLittleEndian(serialized, i * 100);
+        WriteLittleEndian(serialized, uint16(SMSG_UPDATE_OBJECT));
+        if (i % 3 == 0)
+            WriteLittleEndian(serialized, uint64(i + 1));
+        serialized.insert(serialized.end(), payload.begin(), payload.end());
+    }
+
+    std::deque<PacketRecord> expected;
+    REQUIRE(ReadReplayPackets(serialized, expected) == serialized.size());
+    for (ReplayStorageFormat format : { ReplayStorageFormat::Legacy, ReplayStorageFormat::Zlib, ReplayStorageFormat::Zstd })
+    {
+        if (!IsReplayStorageFormatSupported(format))
+            continue;
+
+        INFO(GetReplayStorageFormatName(format));
+        std::string stored = EncodeReplayContents(serialized, format, 0);
+        ReplayContentsReader reader(stored);
+        std::deque<PacketRecord> packets;
+        uint32 blocks = 0;
+        for (bool more = true; more; ++blocks)
+            more = reader.Read(packets);
+
+        REQUIRE(!reader.Failed());
+        REQUIRE(!reader.Truncated());
+        REQUIRE(reader.SerializedBytes() == serialized.size());
+        REQUIRE(blocks == (stored.size() + REPLAY_DECODE_BLOCK - 1) / REPLAY_DECODE_BLOCK);
+        REQUIRE(packets.size() == expected.size());
+        for (size_t i = 0; i < packets.size(); ++i)
+        {
+            REQUIRE(packets[i].timestamp == expected[i].timestamp);
+            REQUIRE(packets[i].sourceGuid == expected[i].sourceGuid);
+            REQUIRE(packets[i].packet.GetOpcode() == expected[i].packet.GetOpcode());
+            REQUIRE(std::equal(packets[i].packet.contents(), packets[i].packet.contents() + packets[i].packet.size(),
+                expected[i].packet.contents(), expected[i].packet.contents() + expected[i].packet.size()));
+        }
+
+        ReplayContentsReader truncated(stored.substr(0, stored.size() - 8 * REPLAY_DECODE_BLOCK / 64));
+        while (truncated.Read(packets))
+            ;
+
+        REQUIRE((truncated.Failed() || truncated.Truncated()));
+    }
+}
+
+TEST_CASE("A remap on the work pool matches the remap on one thread", "[guid]")
+{
+    ArenaTrafficGenerator generator(47, 1000, 3);
+    std::vector<uint64> const& players = generator.Players();
+    MatchRecord source;
+    source.participantGuids = players;
+
+    // the players are only created inside an SMSG_MULTIPLE_PACKETS, held by
+    // the first slice; the creates of the generator are left out
+    std::vector<WorldPacket> creates;
+    for (uint64 player : players)
+        creates.push_back(TargetUpdate(player, players.front(), true));
+
+    std::vector<uint8> multipacket;
+    REQUIRE(BuildMultipacketPayload({ MultipacketCountField::None, MultipacketHeaderOrder::OpcodeThenLength, MultipacketLengthField::Length16 },
+        creates, multipacket));
+    WorldPacket wrapped(SMSG_MULTIPLE_PACKETS, multipacket.size());
+    wrapped.append(multipacket.data(), multipacket.size());
+    source.packets.push_back({ 0, std::move(wrapped) });
+
+    std::vector<WorldPacket> tickPackets;
+    size_t targetUpdates = 0;
+    for (uint32 tick = 0; tick < 300; ++tick)
+    {
+        generator.NextTick(tick, tickPackets);
+        for (WorldPacket& packet : tickPackets)
+            if (packet.GetOpcode() != SMSG_COMPRESSED_UPDATE_OBJECT)
+                source.packets.push_back({ tick * 100, std::move(packet) });
+
+        if (tick % 10 == 0)
+        {
+            source.packets.push_back({ tick * 100, TargetUpdate(players[tick % players.size()], players[(tick / 10) % players.size()], false) });
+            ++targetUpdates;
+        }
+    }
+
+    REQUIRE(source.packets.size() > 4 * REPLAY_REMAP_MIN_RANGE);
+
+    auto remap = [](MatchRecord& record, uint32 threads)
+    {
+        ReplayGuidRemapper remapper(record, threads);
+        remapper.Begin();
+        remapper.Remap(record.packets.size());
+        remapper.Finish();
+    };
+
+    MatchRecord sequential = source;
+    MatchRecord pooled = source;
+    remap(sequential, 1);
+    remap(pooled, 4);
+
+    REQUIRE(targetUpdates > 0);
+    REQUIRE(pooled.guidRemap == sequential.guidRemap);
+    REQUIRE(pooled.packets.size() == sequential.packets.size());
+    for (size_t i = 0; i < pooled.packets.size(); ++i)
+    {
+        PacketRecord const& expected = sequential.packets[i];
+        PacketRecord const& packet = pooled.packets[i];
+        INFO("packet " << i << " opcode " << packet.packet.GetOpcode());
+        REQUIRE(!expected.drop);
+        REQUIRE(packet.drop == expected.drop);
+        REQUIRE(packet.sourceGuid == expected.sourceGuid);
+        REQUIRE(std::equal(packet.packet.contents(), packet.packet.contents() + packet.packet.size(),
+            expected.packet.contents(), expected.packet.contents() + expected.packet.size()));
+    }
+}
+
+TEST_CASE("An object decoded after the ghosts are picked never shares a participant's ghost", "[guid]")
+{
+    uint64 const participant = 0x1234;
+    MatchRecord record;
+    record.participantGuids = { participant };
+    record.packets.push_back({ 0, TargetUpdate(participant, 0, true) });
+
+    // the ghosts are picked with the first chunk, the rest of the row is not decoded yet
+    ReplayGuidRemapper remapper(record, 1);
+    remapper.Extract(1);
+    remapper.Begin();
+    remapper.Remap(1);
+    uint64 const ghost = record.guidRemap.at(participant);
+    REQUIRE(record.participantGuids == std::vector<uint64>{ ghost });
+
+    // a later chunk has an object that happens to carry the ghost GUID
+    record.packets.push_back({ 6000, TargetUpdate(ghost, participant, true) });
+    record.packets.push_back({ 12000, TargetUpdate(ghost, participant, false) });
+    remapper.Extract(2);
+    remapper.Remap(2);
+    remapper.Remap(3);
+    remapper.Finish();
+
+    auto same = [](WorldPacket const& packet, WorldPacket const& expected)
+    {
+        return std::equal(packet.contents(), packet.contents() + packet.size(), expected.contents(), expected.contents() + expected.size());
+    };
+
+    // the object is moved to a ghost of its own, with the same packed length
+    std::unordered_set<uint64> created;
+    UpdateObjectParseStats stats;
+    size_t failureOffset = 0;
+    REQUIRE(ExtractGuidsFromPacket(record.packets[1].packet, created, stats, failureOffset));
+    created.erase(0);
+    created.erase(ghost);
+    REQUIRE(created.size() == 1);
+    uint64 const moved = *created.begin();
+    REQUIRE(moved != participant);
+    REQUIRE(GetPackedMask(moved) == GetPackedMask(ghost));
+
+    REQUIRE(same(record.packets[0].packet, TargetUpdate(ghost, 0, true)));
+    REQUIRE(same(record.packets[1].packet, TargetUpdate(moved, ghost, true)));
+    REQUIRE(same(record.packets[2].packet, TargetUpdate(moved, ghost, false)));
+    REQUIRE(record.guidRemap.size() == 1);
+    for (PacketRecord const& packet : record.packets)
+        REQUIRE(!packet.drop);
+}
+
+TEST_CASE("Watches being written still count until the write is done", "[watches]")
+{
+    std::vector<std::string> written;
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    bool first = true;
+    CharacterDatabase.writeHandler = [&](std::vector<std::string> const& statements)
+    {
+        written.insert(written.end(), statements.begin(), statements.end());
+        if (!std::exchange(first, false))
+            return;
+
+        started.set_value();
+        released.wait();
+    };
+
+    ReplayWatchCounter& counter = ReplayWatchCounter::Instance();
+    REQUIRE(counter.Add(7) == 1);
+    REQUIRE(counter.Add(7) == 2);
+
+    counter.Flush();
+    started.get_future().wait();
+    REQUIRE(counter.Add(7) == 3);
+    counter.Flush(); // the first write still runs, so this one waits
+
+    release.set_value();
+    counter.Flush(true);
+    REQUIRE(counter.Add(7) == 1);
+    counter.Flush(true);
+    CharacterDatabase.writeHandler = nullptr;
+
+    REQUIRE(written.size() == 6);
+    for (size_t i = 0; i < written.size(); ++i)
+    {
+        INFO(written[i]);
+        REQUIRE(written[i].starts_with(Acore::StringFormat("UPDATE {} ", i % 2 ? REPLAY_ARCHIVE_TABLE : REPLAY_TABLE)));
+        REQUIRE(written[i].find(i < 2 ? "WHEN 7 THEN 2 " : "WHEN 7 THEN 1 ") != std::string::npos);
+    }
+}
+
+TEST_CASE("Background watch flushes share one writer thread", "[watches]")
+{
+    std::vector<std::thread::id> writers;
+    CharacterDatabase.writeHandler = [&](std::vector<std::string> const&)
+    {
+        writers.push_back(std::this_thread::get_id());
+    };
+
+    ReplayWatchCounter& counter = ReplayWatchCounter::Instance();
+    for (uint32 i = 0; i < 2; ++i)
+    {
+        counter.Add(8);
+        counter.Flush();
+        counter.Flush(true); // waits for the background write, nothing is left to write
+    }
+    CharacterDatabase.writeHandler = nullptr;
+
+    REQUIRE(writers.size() == 2);
+    REQUIRE(writers[0] != std::this_thread::get_id());
+    REQUIRE(writers[0] == writers[1]);
+}
+
+TEST_CASE("Most watched pages rank unstored watches like the first page", "[lists]")
+{
+    auto row = [](uint32 id, uint32 timesWatched) -> ResultSet::Row
+    {
+        return { std::to_string(id), "3", "Winners", "2000", "Losers", "1900", std::to_string(timesWatched), "0" };
+    };
+
+    std::vector<std::string> queries;
+    CharacterDatabase.queryHandler = [&](std::string const& sql) -> QueryResult
+    {
+        queries.push_back(sql);
+        if (sql.find("timesWatched < ") != std::string::npos)
+            return MakeQueryResult({ row(50, 9), row(40, 8), row(30, 8) });
+
+        if (sql.find("WHERE id IN (") != std::string::npos)
+            return MakeQueryResult({ row(6, 9), row(5, 7) });
+
+        return nullptr;
+    };
+
+    ReplayWatchCounter& counter = ReplayWatchCounter::Instance();
+    for (uint32 i = 0; i < 3; ++i)
+        counter.Add(5);
+
+    counter.Add(6);
+    counter.Add(6);
+
+    // the previous page ended on a replay watched 10 times, with id 100
+    ReplayPageCursor cursor;
+    cursor.list = REPLAY_LIST_MOST_WATCHED;
+    cursor.key = 10;
+    cursor.lastId = 100;
+    std::vector<ReplayInfo> page = LoadMostWatchedPage(cursor, 3);
+    counter.Flush(true);
+    CharacterDatabase.queryHandler = nullptr;
+
+    // 6 is watched 11 times now, so it was on an earlier page; 5 has 10 and a lower id than 100
+    REQUIRE(page.size() == 3);
+    REQUIRE(page[0].matchId == 5);
+    REQUIRE(page[0].timesWatched == 10);
+    REQUIRE(page[1].matchId == 50);
+    REQUIRE(page[2].matchId == 40);
+    REQUIRE(queries.at(0).find("(timesWatched < 10 OR (timesWatched = 10 AND id < 100)) AND id NOT IN (") != std::string::npos);
+}
+
+TEST_CASE("A search index build keeps saves whose rows were not committed yet", "[search]")
+{
+    std::vector<uint32> stored = { 1, 2, 3 };
+    CharacterDatabase.queryHandler = [&stored](std::string const& sql) -> QueryResult
+    {
+        if (!sql.starts_with("(SELECT id, arenaTypeId, mapId") || sql.find("WHERE id > 0 ") == std::string::npos)
+            return nullptr;
+
+        std::vector<ResultSet::Row> rows;
+        for (uint32 id : stored)
+            rows.push_back({ std::to_string(id), "3", "559", "2000", "1000", "120" });
+
+        return MakeQueryResult(rows);
+    };
+
+    auto saved = [](uint32 id)
+    {
+        ReplaySearchRow row;
+        row.id = id;
+        row.arenaTypeId = 3;
+        row.mapId = 559;
+        row.timestamp = 2000;
+        return row;
+    };
+
+    auto ids = [](std::vector<ReplaySearchRow> const& rows)
+    {
+        std::vector<uint32> result;
+        for (ReplaySearchRow const& row : rows)
+            result.push_back(row.id);
+
+        return result;
+    };
+
+    ReplaySearchIndex& index = ReplaySearchIndex::Instance();
+    ReplaySearchQuery query;
+    query.arenaTypeId = 3;
+
+    // saved before the build, its insert still queued
+    index.Add(saved(10));
+    index.Build();
+    REQUIRE(ids(index.Search(query, 10)) == std::vector<uint32>{ 10, 3, 2, 1 });
+
+    // an older id handed out by another server is appended, newest save first
+    index.Add(saved(7));
+    REQUIRE(ids(index.Search(query, 10)) == std::vector<uint32>{ 7, 10, 3, 2, 1 });
+
+    stored = { 1, 2, 3, 7, 10 };
+    index.Build();
+    CharacterDatabase.queryHandler = nullptr;
+    REQUIRE(ids(index.Search(query, 10)) == std::vector<uint32>{ 10, 7, 3, 2, 1 });
+}
+
+TEST_CASE("The search index covers archived favorites", "[search]")
+{
+    std::vector<std::string> queries;
+    CharacterDatabase.queryHandler = [&queries](std::string const& sql) -> QueryResult
+    {
+        queries.push_back(sql);
+        if (sql.find("WHERE id > 0 ") != std::string::npos)
+            return MakeQueryResult({ { "4", "2", "559", "1800", "1000", "90" } });
+
+        if (sql.starts_with("SELECT id, arenaTypeId, mapId") && sql.ends_with("WHERE id = 12"))
+            return MakeQueryResult({ { "12", "2", "562", "1700", "1100", "60" } });
+
+        return nullptr;
+    };
+
+    ReplaySearchIndex& index = ReplaySearchIndex::Instance();
+    index.Build();
+    REQUIRE(queries.at(0).find(Acore::StringFormat("FROM {} WHERE id > 0 AND id NOT IN (SELECT id FROM {})", REPLAY_ARCHIVE_TABLE, REPLAY_TABLE)) != std::string::npos);
+
+    // already indexed, nothing is read
+    queries.clear();
+    index.AddFavorite(4);
+    REQUIRE(queries.empty());
+
+    // missed by the index, read back from the replay table before its week is dropped
+    index.AddFavorite(12);
+    index.AddFavorite(12);
+    CharacterDatabase.queryHandler = nullptr;
+
+    ReplaySearchQuery query;
+    query.arenaTypeId = 2;
+    std::vector<ReplaySearchRow> found = index.Search(query, 10);
+    REQUIRE(found.size() == 2);
+    REQUIRE(found[0].id == 12);
+    REQUIRE(found[0].mapId == 562);
+    REQUIRE(found[1].id == 4);
+}